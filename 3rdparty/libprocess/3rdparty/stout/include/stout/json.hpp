@@ -20,6 +20,7 @@
 #include <iostream>
 #include <limits>
 #include <map>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -29,6 +30,7 @@
 
 #include <stout/check.hpp>
 #include <stout/foreach.hpp>
+#include <stout/lambda.hpp>
 #include <stout/numify.hpp>
 #include <stout/result.hpp>
 #include <stout/strings.hpp>
@@ -586,6 +588,167 @@ inline std::ostream& operator << (std::ostream& out, const Null&)
   return out << "null";
 }
 
+
+// Writes JSON incrementally rather than building up a Value and then
+// stringifying it, so that very large documents (e.g., the state of
+// an entire cluster) never need to be held in memory as a tree. The
+// output is passed to 'sink' in chunks of roughly 'size' bytes as it
+// is written (and the remainder on 'flush'). For example:
+//
+//   JSON::Writer writer(sink);
+//   writer.beginObject();
+//   writer.field("name", "value");
+//   writer.key("values");
+//   writer.beginArray();
+//   writer.value(1);
+//   writer.value(object); // Any existing Value, e.g., an Object.
+//   writer.endArray();
+//   writer.endObject();
+//   writer.flush();
+//
+// Nesting is CHECKed: an object must alternate between keys and
+// values and every begin must be matched by an end.
+class Writer
+{
+public:
+  explicit Writer(
+      const lambda::function<void(const std::string&)>& _sink,
+      size_t _size = 64 * 1024)
+    : sink(_sink), size(_size) {}
+
+  void beginObject()
+  {
+    separate();
+    out << "{";
+    scopes.push_back(Scope(true));
+  }
+
+  void endObject()
+  {
+    CHECK(!scopes.empty() && scopes.back().object && !scopes.back().keyed);
+    scopes.pop_back();
+    out << "}";
+    written();
+  }
+
+  void beginArray()
+  {
+    separate();
+    out << "[";
+    scopes.push_back(Scope(false));
+  }
+
+  void endArray()
+  {
+    CHECK(!scopes.empty() && !scopes.back().object);
+    scopes.pop_back();
+    out << "]";
+    written();
+  }
+
+  // Writes the key of the next field of the current object, which
+  // must be followed by a value (or a nested object or array).
+  void key(const std::string& key)
+  {
+    CHECK(!scopes.empty() && scopes.back().object && !scopes.back().keyed);
+
+    Scope& scope = scopes.back();
+    if (!scope.first) {
+      out << ",";
+    }
+    scope.first = false;
+    scope.keyed = true;
+
+    out << String(key) << ":";
+  }
+
+  // Writes a value as the value of the current field, the next
+  // element of the current array, or the entire document.
+  void value(const Value& value)
+  {
+    separate();
+    out << value;
+    written();
+  }
+
+  // Overloads to avoid copying objects and arrays into a Value.
+  void value(const Object& object)
+  {
+    separate();
+    out << object;
+    written();
+  }
+
+  void value(const Array& array)
+  {
+    separate();
+    out << array;
+    written();
+  }
+
+  template <typename T>
+  void field(const std::string& key, const T& value)
+  {
+    this->key(key);
+    this->value(value);
+  }
+
+  // Passes anything that has been written but not yet passed to the
+  // sink.
+  void flush()
+  {
+    const std::string chunk = out.str();
+    if (!chunk.empty()) {
+      sink(chunk);
+      out.str("");
+    }
+  }
+
+private:
+  struct Scope
+  {
+    explicit Scope(bool _object)
+      : object(_object), first(true), keyed(false) {}
+
+    bool object; // Otherwise this is an array.
+    bool first; // No fields (or elements) have been written yet.
+    bool keyed; // A key has been written without its value.
+  };
+
+  // Prepares for writing a value in the current scope.
+  void separate()
+  {
+    if (scopes.empty()) {
+      return;
+    }
+
+    Scope& scope = scopes.back();
+    if (scope.object) {
+      CHECK(scope.keyed) << "Expecting a key before a value in an object";
+      scope.keyed = false;
+    } else {
+      if (!scope.first) {
+        out << ",";
+      }
+      scope.first = false;
+    }
+  }
+
+  // Passes a chunk to the sink once enough has been written.
+  void written()
+  {
+    if (static_cast<size_t>(out.tellp()) >= size) {
+      flush();
+    }
+  }
+
+  const lambda::function<void(const std::string&)> sink;
+  const size_t size;
+
+  std::ostringstream out;
+  std::vector<Scope> scopes;
+};
+
 namespace internal {
 
 inline Value convert(const picojson::value& value)
@@ -7,6 +7,7 @@
 #include <sys/stat.h>
 
 #include <string>
+#include <vector>
 
 #include <stout/gtest.hpp>
 #include <stout/json.hpp>
@@ -14,6 +15,7 @@
 #include <stout/strings.hpp>
 
 using std::string;
+using std::vector;
 
 using boost::get;
 
@@ -607,3 +609,83 @@ TEST(JsonTest, ContainsObject)
       "}");
   EXPECT_FALSE(nested.contains(nestedTest.get()));
 }
+
+
+TEST(JsonTest, Writer)
+{
+  string output;
+
+  JSON::Writer writer([&output](const string& chunk) {
+    output += chunk;
+  });
+
+  JSON::Object nested;
+  nested.values["a"] = 1;
+  nested.values["b"] = "\"quoted\"";
+
+  JSON::Array array;
+  array.values.push_back(true);
+  array.values.push_back(JSON::Null());
+
+  writer.beginObject();
+  writer.field("array", array);
+  writer.key("empty");
+  writer.beginObject();
+  writer.endObject();
+  writer.key("values");
+  writer.beginArray();
+  writer.value(1.5);
+  writer.value("string");
+  writer.value(nested);
+  writer.beginArray();
+  writer.endArray();
+  writer.endArray();
+  writer.field("zero", 0);
+  writer.endObject();
+
+  // Nothing is passed to the sink until enough has been written.
+  EXPECT_TRUE(output.empty());
+
+  writer.flush();
+
+  JSON::Array values;
+  values.values.push_back(1.5);
+  values.values.push_back("string");
+  values.values.push_back(nested);
+  values.values.push_back(JSON::Array());
+
+  JSON::Object expected;
+  expected.values["array"] = array;
+  expected.values["empty"] = JSON::Object();
+  expected.values["values"] = values;
+  expected.values["zero"] = 0;
+
+  // NOTE: The fields are written in the same (sorted) order in which
+  // a JSON::Object stringifies them.
+  EXPECT_EQ(stringify(expected), output);
+}
+
+
+TEST(JsonTest, WriterChunks)
+{
+  vector<string> chunks;
+
+  JSON::Writer writer(
+      [&chunks](const string& chunk) { chunks.push_back(chunk); },
+      16);
+
+  writer.beginArray();
+  for (int i = 0; i < 100; i++) {
+    writer.value(i);
+  }
+  writer.endArray();
+  writer.flush();
+
+  JSON::Array expected;
+  for (int i = 0; i < 100; i++) {
+    expected.values.push_back(i);
+  }
+
+  EXPECT_LT(1u, chunks.size());
+  EXPECT_EQ(stringify(expected), strings::join("", chunks));
+}
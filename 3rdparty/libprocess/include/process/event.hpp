@@ -35,6 +35,11 @@ struct EventVisitor
 
 struct Event
 {
+  Event() : next(NULL) {}
+
+  // NOTE: A copy of an event is never part of a mailbox.
+  Event(const Event&) : next(NULL) {}
+
   virtual ~Event() {}
 
   virtual void visit(EventVisitor* visitor) const = 0;
@@ -69,6 +74,14 @@ struct Event
     }
     return *result;
   }
+
+private:
+  friend class ProcessBase;
+  friend class ProcessManager;
+
+  // Intrusive link used to queue this event in a process' mailbox
+  // without having to allocate a separate node.
+  Event* next;
 };
 
 
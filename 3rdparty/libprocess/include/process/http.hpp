@@ -368,6 +368,15 @@ struct Accepted : Response
 };
 
 
+struct NotModified : Response
+{
+  NotModified()
+  {
+    status = "304 Not Modified";
+  }
+};
+
+
 struct TemporaryRedirect : Response
 {
   explicit TemporaryRedirect(const std::string& url)
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <map>
 #include <queue>
 #include <vector>
@@ -190,7 +191,14 @@ protected:
     size_t count = 0U;
 
     synchronized (mutex) {
-      count = std::count_if(events.begin(), events.end(), isEventType<T>);
+      Event* lists[] = { injected.load(), head, incoming.load() };
+      for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (Event* event = lists[i]; event != NULL; event = event->next) {
+          if (isEventType<T>(event)) {
+            count++;
+          }
+        }
+      }
     }
 
     return count;
@@ -203,14 +211,19 @@ private:
   friend void* schedule(void*);
 
   // Process states.
-  enum {
+  enum ProcessState
+  {
     BOTTOM,
     READY,
     RUNNING,
     BLOCKED,
     TERMINATING,
     TERMINATED
-  } state;
+  };
+
+  // NOTE: Senders transition a process from BLOCKED to READY (see
+  // 'enqueue') without holding any lock, hence this is atomic.
+  std::atomic<ProcessState> state;
 
   template<typename T>
   static bool isEventType(const Event* event)
@@ -218,13 +231,19 @@ private:
     return event->is<T>();
   }
 
-  // Mutex protecting internals.
+  // Mutex serializing the worker that takes events off the mailbox
+  // with anyone inspecting the mailbox (e.g., 'eventCount'). Senders
+  // never acquire it.
   // TODO(benh): Consider replacing with a spinlock, on multi-core systems.
   std::recursive_mutex mutex;
 
   // Enqueue the specified message, request, or function call.
   void enqueue(Event* event, bool inject = false);
 
+  // Takes the next event off the mailbox, or returns NULL if there is
+  // none. Must only be called by the worker running this process.
+  Event* dequeue();
+
   // Delegates for messages.
   std::map<std::string, UPID> delegates;
 
@@ -244,12 +263,23 @@ private:
   // Static assets(s) to provide.
   std::map<std::string, Asset> assets;
 
-  // Queue of received events, requires lock()ed access!
-  std::deque<Event*> events;
+  // The mailbox of received events. Senders push events onto one of
+  // two intrusive lock-free stacks (newest event first): 'injected'
+  // for events that must be served before anything else and
+  // 'incoming' for everything else. The worker running this process
+  // moves them, in order, onto the 'head' list which requires
+  // lock()ed access!
+  std::atomic<Event*> injected;
+  std::atomic<Event*> incoming;
+  Event* head;
 
   // Active references.
   int refs;
 
+  // Index of the worker thread that last ran this process, or -1 if
+  // the process has not yet run on a worker thread.
+  int worker;
+
   // Process PID.
   UPID pid;
 };
@@ -6,6 +6,7 @@
 #include <google/protobuf/message.h>
 #include <google/protobuf/repeated_field.h>
 
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -114,18 +115,25 @@ protected:
     send(from, message);
   }
 
+  // NOTE: Each installed handler parses every message it handles into
+  // the same instance of M, which lets protocol buffers reuse the
+  // memory allocated for the fields of previous messages rather than
+  // allocating it again for each message. This is safe because a
+  // process only handles one message at a time, but it means that
+  // handlers must not hold on to references into the message (or its
+  // fields) after they return.
+  //
   // TODO(vinod): Use ENUM_PARAMS for the overloads.
   // Installs that take the sender as the first argument.
   template <typename M>
   void install(void (T::*method)(const process::UPID&, const M&))
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&handlerM<M>,
-                   t, method,
+                   t, method, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M>
@@ -146,13 +154,12 @@ protected:
       void (T::*method)(const process::UPID&, P1C),
       P1 (M::*param1)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&handler1<M, P1, P1C>,
-                   t, method, param1,
+                   t, method, param1, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -163,13 +170,12 @@ protected:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&handler2<M, P1, P1C, P2, P2C>,
-                   t, method, p1, p2,
+                   t, method, p1, p2, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -182,13 +188,12 @@ protected:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&handler3<M, P1, P1C, P2, P2C, P3, P3C>,
-                   t, method, p1, p2, p3,
+                   t, method, p1, p2, p3, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -203,13 +208,12 @@ protected:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&handler4<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C>,
-                   t, method, p1, p2, p3, p4,
+                   t, method, p1, p2, p3, p4, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -226,13 +230,12 @@ protected:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&handler5<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C, P5, P5C>,
-                   t, method, p1, p2, p3, p4, p5,
+                   t, method, p1, p2, p3, p4, p5, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -251,27 +254,25 @@ protected:
       P5 (M::*p5)() const,
       P6 (M::*p6)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&handler6<M, P1, P1C, P2, P2C, P3, P3C,
                                 P4, P4C, P5, P5C, P6, P6C>,
-                   t, method, p1, p2, p3, p4, p5, p6,
+                   t, method, p1, p2, p3, p4, p5, p6, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   // Installs that do not take the sender.
   template <typename M>
   void install(void (T::*method)(const M&))
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&_handlerM<M>,
-                   t, method,
+                   t, method, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M>
@@ -292,13 +293,12 @@ protected:
       void (T::*method)(P1C),
       P1 (M::*param1)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&_handler1<M, P1, P1C>,
-                   t, method, param1,
+                   t, method, param1, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -309,13 +309,12 @@ protected:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&_handler2<M, P1, P1C, P2, P2C>,
-                   t, method, p1, p2,
+                   t, method, p1, p2, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -328,13 +327,12 @@ protected:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&_handler3<M, P1, P1C, P2, P2C, P3, P3C>,
-                   t, method, p1, p2, p3,
+                   t, method, p1, p2, p3, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -349,13 +347,12 @@ protected:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&_handler4<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C>,
-                   t, method, p1, p2, p3, p4,
+                   t, method, p1, p2, p3, p4, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -372,13 +369,12 @@ protected:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&_handler5<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C, P5, P5C>,
-                   t, method, p1, p2, p3, p4, p5,
+                   t, method, p1, p2, p3, p4, p5, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   template <typename M,
@@ -397,35 +393,63 @@ protected:
       P5 (M::*p5)() const,
       P6 (M::*p6)() const)
   {
-    google::protobuf::Message* m = new M();
+    std::shared_ptr<M> m(new M());
     T* t = static_cast<T*>(this);
     protobufHandlers[m->GetTypeName()] =
       lambda::bind(&_handler6<M, P1, P1C, P2, P2C, P3, P3C,
                                  P4, P4C, P5, P5C, P6, P6C>,
-                   t, method, p1, p2, p3, p4, p5, p6,
+                   t, method, p1, p2, p3, p4, p5, p6, m,
                    lambda::_1, lambda::_2);
-    delete m;
   }
 
   using process::Process<T>::install;
 
 private:
+  // Messages larger than this are not kept around for reuse (see
+  // 'recycle') to bound the memory retained by each handler.
+  static const size_t MAX_RECYCLED_MESSAGE_SIZE = 64 * 1024;
+
+  // Parses 'data' into 'm' (which gets cleared first), returning
+  // false (and logging why) if the result isn't initialized.
+  template <typename M>
+  static bool parse(M* m, const std::string& data)
+  {
+    m->ParseFromArray(data.data(), data.size());
+
+    if (!m->IsInitialized()) {
+      LOG(WARNING) << "Initialization errors: "
+                   << m->InitializationErrorString();
+      return false;
+    }
+
+    return true;
+  }
+
+  // Prepares 'm' for reuse after handling a message that was 'size'
+  // bytes serialized. Clearing a message keeps the memory allocated
+  // for its fields, so for large messages we release it instead.
+  template <typename M>
+  static void recycle(M* m, size_t size)
+  {
+    if (size > MAX_RECYCLED_MESSAGE_SIZE) {
+      M().Swap(m);
+    }
+  }
+
   // Handlers that take the sender as the first argument.
   template <typename M>
   static void handlerM(
       T* t,
       void (T::*method)(const process::UPID&, const M&),
+      const std::shared_ptr<M>& m,
       const process::UPID& sender,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender, m);
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(sender, *m);
     }
+
+    recycle(m.get(), data.size());
   }
 
   static void handler0(
@@ -443,17 +467,15 @@ private:
       T* t,
       void (T::*method)(const process::UPID&, P1C),
       P1 (M::*p1)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID& sender,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender, google::protobuf::convert((&m->*p1)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(sender, google::protobuf::convert((m.get()->*p1)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -464,19 +486,17 @@ private:
       void (T::*method)(const process::UPID&, P1C, P2C),
       P1 (M::*p1)() const,
       P2 (M::*p2)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID& sender,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
+    if (parse(m.get(), data)) {
       (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+                   google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -489,20 +509,18 @@ private:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const,
       P3 (M::*p3)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID& sender,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
+    if (parse(m.get(), data)) {
       (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+                   google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -517,21 +535,19 @@ private:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const,
       P4 (M::*p4)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID& sender,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
+    if (parse(m.get(), data)) {
       (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+                   google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()),
+                   google::protobuf::convert((m.get()->*p4)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -548,22 +564,20 @@ private:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const,
       P5 (M::*p5)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID& sender,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
+    if (parse(m.get(), data)) {
       (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()),
-                   google::protobuf::convert((&m->*p5)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+                   google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()),
+                   google::protobuf::convert((m.get()->*p4)()),
+                   google::protobuf::convert((m.get()->*p5)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -582,23 +596,21 @@ private:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const,
       P6 (M::*p6)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID& sender,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
+    if (parse(m.get(), data)) {
       (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()),
-                   google::protobuf::convert((&m->*p5)()),
-                   google::protobuf::convert((&m->*p6)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+                   google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()),
+                   google::protobuf::convert((m.get()->*p4)()),
+                   google::protobuf::convert((m.get()->*p5)()),
+                   google::protobuf::convert((m.get()->*p6)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
 
@@ -607,17 +619,15 @@ private:
   static void _handlerM(
       T* t,
       void (T::*method)(const M&),
+      const std::shared_ptr<M>& m,
       const process::UPID&,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(m);
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(*m);
     }
+
+    recycle(m.get(), data.size());
   }
 
   static void _handler0(
@@ -635,17 +645,15 @@ private:
       T* t,
       void (T::*method)(P1C),
       P1 (M::*p1)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID&,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(google::protobuf::convert((m.get()->*p1)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -656,18 +664,16 @@ private:
       void (T::*method)(P1C, P2C),
       P1 (M::*p1)() const,
       P2 (M::*p2)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID&,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -680,19 +686,17 @@ private:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const,
       P3 (M::*p3)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID&,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -707,20 +711,18 @@ private:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const,
       P4 (M::*p4)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID&,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()),
+                   google::protobuf::convert((m.get()->*p4)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -737,21 +739,19 @@ private:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const,
       P5 (M::*p5)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID&,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()),
-                   google::protobuf::convert((&m->*p5)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()),
+                   google::protobuf::convert((m.get()->*p4)()),
+                   google::protobuf::convert((m.get()->*p5)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   template <typename M,
@@ -770,22 +770,20 @@ private:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const,
       P6 (M::*p6)() const,
+      const std::shared_ptr<M>& m,
       const process::UPID&,
       const std::string& data)
   {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()),
-                   google::protobuf::convert((&m->*p5)()),
-                   google::protobuf::convert((&m->*p6)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
+    if (parse(m.get(), data)) {
+      (t->*method)(google::protobuf::convert((m.get()->*p1)()),
+                   google::protobuf::convert((m.get()->*p2)()),
+                   google::protobuf::convert((m.get()->*p3)()),
+                   google::protobuf::convert((m.get()->*p4)()),
+                   google::protobuf::convert((m.get()->*p5)()),
+                   google::protobuf::convert((m.get()->*p6)()));
     }
+
+    recycle(m.get(), data.size());
   }
 
   typedef lambda::function<
@@ -1,6 +1,8 @@
 #ifndef __PROCESS_SOCKET_HPP__
 #define __PROCESS_SOCKET_HPP__
 
+#include <sys/uio.h> // For struct iovec.
+
 #include <memory>
 
 #include <process/address.hpp>
@@ -73,6 +75,14 @@ public:
     virtual Future<size_t> send(const char* data, size_t size) = 0;
     virtual Future<size_t> sendfile(int fd, off_t offset, size_t size) = 0;
 
+    // Sends the data described by the 'count' I/O vectors with a
+    // single "gather" write where possible, returning the number of
+    // bytes sent (which, like 'send', might be less than the total).
+    // The I/O vectors and the data they describe must remain valid
+    // until the returned future has completed. The default
+    // implementation only sends the first (non-empty) I/O vector.
+    virtual Future<size_t> send(const struct iovec* iov, int count);
+
     // An overload of 'recv', receives data based on the specified
     // 'size' parameter:
     //
@@ -201,6 +211,11 @@ public:
     return impl->sendfile(fd, offset, size);
   }
 
+  Future<size_t> send(const struct iovec* iov, int count) const
+  {
+    return impl->send(iov, count);
+  }
+
   Future<std::string> recv(const Option<ssize_t>& size)
   {
     return impl->recv(size);
@@ -46,6 +46,7 @@ public:
 
 private:
   friend class Clock;
+  friend class TimerWheel;
 
   Timer(long _id,
         const Timeout& _t,
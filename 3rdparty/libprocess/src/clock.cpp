@@ -19,6 +19,7 @@
 #include <stout/unreachable.hpp>
 
 #include "event_loop.hpp"
+#include "timer_wheel.hpp"
 
 using std::list;
 using std::map;
@@ -27,10 +28,9 @@ using std::set;
 
 namespace process {
 
-// We store the timers in a map of lists indexed by the timeout of the
-// timer so that we can have two timers that have the same timeout. We
-// exploit that the map is SORTED!
-static map<Time, list<Timer>>* timers = new map<Time, list<Timer>>();
+// We store the timers in a hierarchical timing wheel so that creating
+// and canceling a timer is O(1) no matter how many timers there are.
+static TimerWheel* timers = new TimerWheel();
 static recursive_mutex* timers_mutex = new recursive_mutex();
 
 
@@ -71,26 +71,26 @@ set<Time>* ticks = new set<Time>();
 // so that it's clear from the callsite that the use of 'timers' is
 // within a 'synchronized' block.
 //
-// TODO(benh): Create a generic 'Timers' abstraction which hides this
-// and more away (i.e., all manipulations of 'timers' below).
-Option<Time> next(const map<Time, list<Timer>>& timers)
+// NOTE: The time returned might be earlier than when the next timer
+// actually elapses (see TimerWheel::next), in which case the 'tick'
+// scheduled for that time doesn't expire any timers but just
+// schedules the next 'tick'.
+Option<Time> next(const TimerWheel& timers)
 {
-  if (!timers.empty()) {
-    Time first = timers.begin()->first;
+  Option<Time> first = timers.next();
 
+  if (first.isSome()) {
     // If the clock is paused and no timers are expired, the
     // timers cannot fire until the clock is advanced, so we
     // return None() here. Note that we pass NULL to ensure
     // that this looks at the global clock, since this can be
     // called from a Process context through Clock::timer.
-    if (Clock::paused() && first > Clock::now(NULL)) {
+    if (Clock::paused() && first.get() > Clock::now(NULL)) {
       return None();
     }
-
-    return first;
   }
 
-  return None();
+  return first;
 }
 
 
@@ -104,7 +104,7 @@ void tick(const Time& time);
 // a 'synchronized' block.
 // TODO(bmahler): Consider taking an optional 'now' to avoid
 // excessive syscalls via Clock::now(NULL).
-void scheduleTick(const map<Time, list<Timer>>& timers, set<Time>* ticks)
+void scheduleTick(const TimerWheel& timers, set<Time>* ticks)
 {
   // Determine when the next 'tick' should fire.
   const Option<Time> next = clock::next(timers);
@@ -136,12 +136,12 @@ void tick(const Time& time)
 
     VLOG(3) << "Handling timers up to " << now;
 
-    foreachkey (const Time& timeout, *timers) {
-      if (timeout > now) {
-        break;
-      }
+    // Remove all of the timers that timed out in one batch.
+    timedout = timers->advance(now);
 
-      VLOG(3) << "Have timeout(s) at " << timeout;
+    if (!timedout.empty()) {
+      VLOG(3) << "Have " << timedout.size() << " timeout(s) up to "
+              << timedout.back().timeout().time();
 
       // Need to toggle 'settling' so that we don't prematurely say
       // we're settled until after the timers are executed below,
@@ -149,17 +149,11 @@ void tick(const Time& time)
       if (clock::paused) {
         clock::settling = true;
       }
-
-      foreach (const Timer& timer, (*timers)[timeout]) {
-        timedout.push_back(timer);
-      }
     }
 
-    // Now erase the range of timers that timed out.
-    timers->erase(timers->begin(), timers->upper_bound(now));
-
     // Okay, so the timeout for the next timer should not have fired.
-    CHECK(timers->empty() || (timers->begin()->first > now));
+    Option<Time> next = timers->next();
+    CHECK(next.isNone() || next.get() > now);
 
     // Remove this tick from the scheduled 'ticks', it may have
     // been removed already if the clock was paused / manipulated
@@ -176,9 +170,8 @@ void tick(const Time& time)
   // that will expire before the paused time and we've finished
   // executing expired timers.
   synchronized (timers_mutex) {
-    if (clock::paused &&
-        (timers->size() == 0 ||
-         timers->begin()->first > *clock::current)) {
+    Option<Time> next = timers->next();
+    if (clock::paused && (next.isNone() || next.get() > *clock::current)) {
       VLOG(3) << "Clock has settled";
       clock::settling = false;
     }
@@ -247,17 +240,14 @@ Timer Clock::timer(
 
   // Add the timer.
   synchronized (timers_mutex) {
-    if (timers->size() == 0 ||
-        timer.timeout().time() < timers->begin()->first) {
-      // Need to interrupt the loop to update/set timer repeat.
-      (*timers)[timer.timeout().time()].push_back(timer);
+    Option<Time> next = timers->next();
 
+    timers->add(timer);
+
+    if (next.isNone() || timer.timeout().time() < next.get()) {
+      // Need to interrupt the loop to update/set timer repeat.
       // Schedule another "tick" if necessary.
       clock::scheduleTick(*timers, clock::ticks);
-    } else {
-      // Timer repeat is adequate, just add the timeout.
-      CHECK(timers->size() >= 1);
-      (*timers)[timer.timeout().time()].push_back(timer);
     }
   }
 
@@ -269,17 +259,8 @@ bool Clock::cancel(const Timer& timer)
 {
   bool canceled = false;
   synchronized (timers_mutex) {
-    // Check if the timeout is still pending, and if so, erase it. In
-    // addition, erase an empty list if we just removed the last
-    // timeout.
-    Time time = timer.timeout().time();
-    if (timers->count(time) > 0) {
-      canceled = true;
-      (*timers)[time].remove(timer);
-      if ((*timers)[time].empty()) {
-        timers->erase(time);
-      }
-    }
+    // Check if the timeout is still pending, and if so, erase it.
+    canceled = timers->remove(timer);
   }
 
   return canceled;
@@ -423,11 +404,12 @@ bool Clock::settled()
   synchronized (timers_mutex) {
     CHECK(clock::paused);
 
+    Option<Time> next = timers->next();
+
     if (clock::settling) {
       VLOG(3) << "Clock still not settled";
       return false;
-    } else if (timers->size() == 0 ||
-               timers->begin()->first > *clock::current) {
+    } else if (next.isNone() || next.get() > *clock::current) {
       VLOG(3) << "Clock is settled";
       return true;
     }
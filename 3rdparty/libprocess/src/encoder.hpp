@@ -4,15 +4,23 @@
 #include <stdint.h>
 #include <time.h>
 
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <list>
 #include <map>
 #include <sstream>
+#include <string>
+#include <vector>
 
+#include <process/future.hpp>
 #include <process/http.hpp>
 #include <process/process.hpp>
 
 #include <stout/foreach.hpp>
 #include <stout/gzip.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/nothing.hpp>
 #include <stout/numify.hpp>
 #include <stout/os.hpp>
 
@@ -21,6 +29,10 @@ namespace process {
 
 const uint32_t GZIP_MINIMUM_BODY_LENGTH = 1024;
 
+// Terminates the single chunk holding a message's body and then the
+// chunked body itself.
+const char MESSAGE_BODY_TRAILER[] = "\r\n0\r\n\r\n";
+
 // Forward declarations.
 class Encoder;
 
@@ -52,11 +64,26 @@ private:
 };
 
 
+// Encodes data as a sequence of segments that get sent with a single
+// "gather" write (see Socket::send), so that large payloads that have
+// already been serialized (e.g., message bodies) don't need to be
+// copied into a single buffer along with their HTTP framing.
 class DataEncoder : public Encoder
 {
 public:
-  DataEncoder(const network::Socket& s, const std::string& _data)
-    : Encoder(s), data(_data), index(0) {}
+  DataEncoder(const network::Socket& s, const std::string& data)
+    : Encoder(s), size(0), index(0)
+  {
+    append(std::string(data));
+  }
+
+  DataEncoder(const network::Socket& s, std::vector<std::string>&& buffers)
+    : Encoder(s), size(0), index(0)
+  {
+    foreach (std::string& buffer, buffers) {
+      append(std::move(buffer));
+    }
+  }
 
   virtual ~DataEncoder() {}
 
@@ -65,12 +92,35 @@ public:
     return Encoder::DATA;
   }
 
-  virtual const char* next(size_t* length)
+  // Returns the I/O vectors that describe all of the remaining data
+  // and sets 'count' to the number of them and 'length' to the number
+  // of bytes they span. The I/O vectors are valid until the next call
+  // to 'next' or until this encoder is deleted.
+  virtual const struct iovec* next(int* count, size_t* length)
   {
-    size_t temp = index;
-    index = data.size();
-    *length = data.size() - temp;
-    return data.data() + temp;
+    pending.clear();
+
+    // Skip the segments that have already been sent, starting in the
+    // middle of a segment if it was only partially sent.
+    size_t offset = index;
+    foreach (const struct iovec& segment, segments) {
+      if (offset >= segment.iov_len) {
+        offset -= segment.iov_len;
+        continue;
+      }
+
+      struct iovec iov;
+      iov.iov_base = static_cast<char*>(segment.iov_base) + offset;
+      iov.iov_len = segment.iov_len - offset;
+      pending.push_back(iov);
+
+      offset = 0;
+    }
+
+    *count = pending.size();
+    *length = size - index;
+    index = size;
+    return pending.data();
   }
 
   virtual void backup(size_t length)
@@ -82,20 +132,114 @@ public:
 
   virtual size_t remaining() const
   {
-    return data.size() - index;
+    return size - index;
+  }
+
+protected:
+  explicit DataEncoder(const network::Socket& s)
+    : Encoder(s), size(0), index(0) {}
+
+  // Appends the first 'length' bytes (or all) of 'data', which this
+  // encoder takes ownership of.
+  void append(std::string&& data, size_t length = std::string::npos)
+  {
+    buffers.push_back(std::move(data));
+    append(buffers.back().data(), std::min(length, buffers.back().size()));
+  }
+
+  // Appends 'length' bytes at 'data' without copying them. The caller
+  // must ensure they remain valid for the lifetime of this encoder.
+  void append(const char* data, size_t length)
+  {
+    if (length > 0) {
+      struct iovec segment;
+      segment.iov_base = const_cast<char*>(data);
+      segment.iov_len = length;
+      segments.push_back(segment);
+      size += length;
+    }
   }
 
 private:
-  const std::string data;
+  // NOTE: We use a list so that appending a buffer doesn't move the
+  // strings (and thus their data) that the segments point into.
+  std::list<std::string> buffers;
+
+  std::vector<struct iovec> segments;
+  std::vector<struct iovec> pending; // See 'next'.
+  size_t size;
   size_t index;
 };
 
 
+// Coalesces the data of multiple data encoders for the same socket
+// so that it gets sent with a single gather write. The batch takes
+// ownership of the encoders, which keep the data alive.
+class BatchEncoder : public DataEncoder
+{
+public:
+  explicit BatchEncoder(const network::Socket& s) : DataEncoder(s) {}
+
+  virtual ~BatchEncoder()
+  {
+    // Only a batch that was sent in its entirety has been flushed,
+    // otherwise sending failed (or the socket was closed).
+    if (remaining() == 0) {
+      promise.set(Nothing());
+    }
+
+    foreach (DataEncoder* encoder, encoders) {
+      delete encoder;
+    }
+  }
+
+  void add(DataEncoder* encoder)
+  {
+    int count;
+    size_t length;
+    const struct iovec* iov = encoder->next(&count, &length);
+
+    for (int i = 0; i < count; i++) {
+      append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    }
+
+    encoders.push_back(encoder);
+  }
+
+  // Returns the number of encoders in this batch.
+  size_t size() const
+  {
+    return encoders.size();
+  }
+
+  // Returns a future that is satisfied once all of the data in this
+  // batch has been sent.
+  Future<Nothing> flushed()
+  {
+    return promise.future();
+  }
+
+private:
+  std::vector<DataEncoder*> encoders;
+  Promise<Nothing> promise;
+};
+
+
 class MessageEncoder : public DataEncoder
 {
 public:
   MessageEncoder(const network::Socket& s, Message* _message)
-    : DataEncoder(s, encode(_message)), message(_message) {}
+    : DataEncoder(s), message(_message)
+  {
+    // The body is sent straight out of the message (which we own)
+    // rather than being copied next to the HTTP framing.
+    append(header(message));
+
+    if (message != NULL && message->body.size() > 0) {
+      append(message->body.data(), message->body.size());
+      append(MESSAGE_BODY_TRAILER, strlen(MESSAGE_BODY_TRAILER));
+    }
+  }
 
   virtual ~MessageEncoder()
   {
@@ -105,6 +249,21 @@ public:
   }
 
   static std::string encode(Message* message)
+  {
+    std::string encoded = header(message);
+
+    if (message != NULL && message->body.size() > 0) {
+      encoded += message->body;
+      encoded += MESSAGE_BODY_TRAILER;
+    }
+
+    return encoded;
+  }
+
+private:
+  // Returns the request line and headers, including the size of the
+  // body's chunk if it has a body.
+  static std::string header(Message* message)
   {
     std::ostringstream out;
 
@@ -128,10 +287,6 @@ public:
       if (message->body.size() > 0) {
         out << "Transfer-Encoding: chunked\r\n\r\n"
             << std::hex << message->body.size() << "\r\n";
-        out.write(message->body.data(), message->body.size());
-        out << "\r\n"
-            << "0\r\n"
-            << "\r\n";
       } else {
         out << "\r\n";
       }
@@ -140,7 +295,6 @@ public:
     return out.str();
   }
 
-private:
   Message* message;
 };
 
@@ -152,11 +306,28 @@ public:
       const network::Socket& s,
       const http::Response& response,
       const http::Request& request)
-    : DataEncoder(s, encode(response, request)) {}
+    : DataEncoder(s)
+  {
+    std::string body;
+    append(header(response, request, &body));
+    append(std::move(body));
+  }
 
   static std::string encode(
       const http::Response& response,
       const http::Request& request)
+  {
+    std::string body;
+    return header(response, request, &body) + body;
+  }
+
+private:
+  // Returns the status line and headers of the response and sets
+  // 'body' to the (possibly compressed or truncated) body to send.
+  static std::string header(
+      const http::Response& response,
+      const http::Request& request,
+      std::string* body)
   {
     std::ostringstream out;
 
@@ -184,18 +355,18 @@ public:
     headers["Date"] = date;
 
     // Should we compress this response?
-    std::string body = response.body;
+    *body = response.body;
 
     if (response.type == http::Response::BODY &&
         response.body.length() >= GZIP_MINIMUM_BODY_LENGTH &&
         !headers.contains("Content-Encoding") &&
         request.accepts("gzip")) {
-      Try<std::string> compressed = gzip::compress(body);
+      Try<std::string> compressed = gzip::compress(*body);
       if (compressed.isError()) {
         LOG(WARNING) << "Failed to gzip response body: " << compressed.error();
       } else {
-        body = compressed.get();
-        headers["Content-Length"] = stringify(body.length());
+        *body = compressed.get();
+        headers["Content-Length"] = stringify(body->length());
         headers["Content-Encoding"] = "gzip";
       }
     }
@@ -211,7 +382,7 @@ public:
       out << "Content-Length: 0\r\n";
     } else if (response.type == http::Response::BODY &&
                !headers.contains("Content-Length")) {
-      out << "Content-Length: " << body.size() << "\r\n";
+      out << "Content-Length: " << body->size() << "\r\n";
     }
 
     // Use a CRLF to mark end of headers.
@@ -222,11 +393,11 @@ public:
       // If the Content-Length header was supplied, only write as much data
       // as the length specifies.
       Result<uint32_t> length = numify<uint32_t>(headers.get("Content-Length"));
-      if (length.isSome() && length.get() <= body.length()) {
-        out.write(body.data(), length.get());
-      } else {
-        out.write(body.data(), body.size());
+      if (length.isSome() && length.get() <= body->length()) {
+        body->resize(length.get());
       }
+    } else {
+      body->clear();
     }
 
     return out.str();
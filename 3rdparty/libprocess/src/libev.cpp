@@ -1,11 +1,21 @@
 #include <ev.h>
+#include <pthread.h>
 
 #include <mutex>
 #include <queue>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
 
 #include <stout/duration.hpp>
+#include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
 #include <stout/nothing.hpp>
+#include <stout/numify.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/try.hpp>
 
 #include "event_loop.hpp"
 #include "libev.hpp"
@@ -14,44 +24,80 @@ namespace process {
 
 // Defines the initial values for all of the declarations made in
 // libev.hpp (since these need to live in the static data space).
-struct ev_loop* loop = NULL;
+std::vector<Loop*>* loops = new std::vector<Loop*>();
 
-ev_async async_watcher;
+ThreadLocal<Loop>* _loop_ = new ThreadLocal<Loop>();
 
-std::queue<ev_io*>* watchers = new std::queue<ev_io*>();
 
-std::mutex* watchers_mutex = new std::mutex();
+void handle_async(struct ev_loop* _, ev_async* watcher, int revents)
+{
+  Loop* loop = (Loop*) watcher->data;
 
-std::queue<lambda::function<void(void)>>* functions =
-  new std::queue<lambda::function<void(void)>>();
+  // Take all of the queued functions before running any of them so
+  // that the mutex is not held while they run (a function may need to
+  // enqueue a function on another loop, which could otherwise
+  // deadlock with that loop doing the same to us).
+  std::queue<lambda::function<void(void)>> functions;
 
-ThreadLocal<bool>* _in_event_loop_ = new ThreadLocal<bool>();
+  synchronized (loop->mutex) {
+    std::swap(functions, loop->functions);
+  }
+
+  while (!functions.empty()) {
+    (functions.front())();
+    functions.pop();
+  }
+}
 
 
-void handle_async(struct ev_loop* loop, ev_async* _, int revents)
+void EventLoop::initialize()
 {
-  synchronized (watchers_mutex) {
-    // Start all the new I/O watchers.
-    while (!watchers->empty()) {
-      ev_io* watcher = watchers->front();
-      watchers->pop();
-      ev_io_start(loop, watcher);
+  // Allow the number of I/O threads (and hence event loops) to be
+  // overridden, e.g., for measuring how I/O throughput scales with
+  // the number of threads.
+  long threads = 1;
+
+  Option<std::string> value = os::getenv("LIBPROCESS_NUM_IO_THREADS");
+  if (value.isSome()) {
+    Try<long> number = numify<long>(value.get());
+    if (number.isError() || number.get() <= 0) {
+      LOG(FATAL) << "LIBPROCESS_NUM_IO_THREADS=" << value.get()
+                 << " is not a valid number of threads";
     }
+    threads = number.get();
+  }
+
+  // NOTE: With EVFLAG_AUTO libev picks the best backend available on
+  // the platform, i.e., epoll on Linux, so each loop ends up with its
+  // own epoll instance.
+  for (long i = 0; i < threads; i++) {
+    Loop* loop = new Loop();
+
+    loop->loop = i == 0
+      ? ev_default_loop(EVFLAG_AUTO)
+      : ev_loop_new(EVFLAG_AUTO);
 
-    while (!functions->empty()) {
-      (functions->front())();
-      functions->pop();
+    if (loop->loop == NULL) {
+      LOG(FATAL) << "Failed to initialize, ev_loop_new";
     }
-  }
-}
 
+    loop->async_watcher.data = loop;
+    ev_async_init(&loop->async_watcher, handle_async);
+    ev_async_start(loop->loop, &loop->async_watcher);
 
-void EventLoop::initialize()
-{
-  loop = ev_default_loop(EVFLAG_AUTO);
+    loops->push_back(loop);
+  }
 
-  ev_async_init(&async_watcher, handle_async);
-  ev_async_start(loop, &async_watcher);
+  // The first loop gets run by the caller of EventLoop::run, we start
+  // a thread for each of the others here.
+  for (size_t i = 1; i < loops->size(); i++) {
+    pthread_t thread; // For now, not saving handles on our threads.
+    if (pthread_create(&thread, NULL, &EventLoop::run, (*loops)[i]) != 0) {
+      LOG(FATAL) << "Failed to initialize, pthread_create";
+    }
+  }
+
+  VLOG(1) << "Created " << loops->size() << " I/O threads";
 }
 
 
@@ -89,7 +135,7 @@ Future<Nothing> delay(
   const double repeat = 0.0;
 
   ev_timer_init(timer, handle_delay, after, repeat);
-  ev_timer_start(loop, timer);
+  ev_timer_start(loops->front()->loop, timer);
 
   return Nothing();
 }
@@ -113,13 +159,15 @@ double EventLoop::time()
 }
 
 
-void* EventLoop::run(void*)
+void* EventLoop::run(void* arg)
 {
-  __in_event_loop__ = true;
+  Loop* loop = arg == NULL ? loops->front() : (Loop*) arg;
+
+  *_loop_ = loop;
 
-  ev_loop(loop, 0);
+  ev_loop(loop->loop, 0);
 
-  __in_event_loop__ = false;
+  *_loop_ = NULL;
 
   return NULL;
 }
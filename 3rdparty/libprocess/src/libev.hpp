@@ -5,6 +5,7 @@
 
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include <process/future.hpp>
 #include <process/owned.hpp>
@@ -15,32 +16,40 @@
 
 namespace process {
 
-// Event loop.
-extern struct ev_loop* loop;
+// An event loop along with what's necessary to run functions within
+// it from other threads. Each loop is run by its own thread (see
+// EventLoop::initialize).
+struct Loop
+{
+  struct ev_loop* loop;
+
+  // Asynchronous watcher for interrupting the loop to specifically
+  // deal with functions (via run_in_event_loop).
+  ev_async async_watcher;
+
+  // Queue of functions to be invoked asynchronously within the loop
+  // (protected by 'mutex').
+  std::mutex mutex;
+  std::queue<lambda::function<void(void)>> functions;
+};
 
-// Asynchronous watcher for interrupting loop to specifically deal
-// with IO watchers and functions (via run_in_event_loop).
-extern ev_async async_watcher;
 
-// Queue of I/O watchers to be asynchronously added to the event loop
-// (protected by 'watchers' below).
-// TODO(benh): Replace this queue with functions that we put in
-// 'functions' below that perform the ev_io_start themselves.
-extern std::queue<ev_io*>* watchers;
-extern std::mutex* watchers_mutex;
+// All of the event loops. The first loop is libev's default loop,
+// which is also used for timers (see EventLoop::delay), while I/O is
+// spread across all of the loops by file descriptor (see 'loop_for')
+// so that polling isn't serialized through a single thread.
+extern std::vector<Loop*>* loops;
 
-// Queue of functions to be invoked asynchronously within the vent
-// loop (protected by 'watchers' above).
-extern std::queue<lambda::function<void(void)>>* functions;
+// Per thread pointer to the loop that the thread is running, or NULL
+// if the thread is not running an event loop.
+extern ThreadLocal<Loop>* _loop_;
 
-// Per thread bool pointer. The extra level of indirection from
-// _in_event_loop_ to __in_event_loop__ is used in order to take
-// advantage of the ThreadLocal operators without needing the extra
-// dereference as well as lazily construct the actual bool.
-extern ThreadLocal<bool>* _in_event_loop_;
 
-#define __in_event_loop__ *(*_in_event_loop_ == NULL ?               \
-  *_in_event_loop_ = new bool(false) : *_in_event_loop_)
+// Returns the loop that polls the specified file descriptor.
+inline Loop* loop_for(int fd)
+{
+  return (*loops)[fd % loops->size()];
+}
 
 
 // Wrapper around function we want to run in the event loop.
@@ -58,12 +67,14 @@ void _run_in_event_loop(
 }
 
 
-// Helper for running a function in the event loop.
+// Helper for running a function in the specified event loop.
 template <typename T>
-Future<T> run_in_event_loop(const lambda::function<Future<T>(void)>& f)
+Future<T> run_in_event_loop(
+    Loop* loop,
+    const lambda::function<Future<T>(void)>& f)
 {
   // If this is already the event loop then just run the function.
-  if (__in_event_loop__) {
+  if (*_loop_ == loop) {
     return f();
   }
 
@@ -72,16 +83,24 @@ Future<T> run_in_event_loop(const lambda::function<Future<T>(void)>& f)
   Future<T> future = promise->future();
 
   // Enqueue the function.
-  synchronized (watchers_mutex) {
-    functions->push(lambda::bind(&_run_in_event_loop<T>, f, promise));
+  synchronized (loop->mutex) {
+    loop->functions.push(lambda::bind(&_run_in_event_loop<T>, f, promise));
   }
 
   // Interrupt the loop.
-  ev_async_send(loop, &async_watcher);
+  ev_async_send(loop->loop, &loop->async_watcher);
 
   return future;
 }
 
+
+// Helper for running a function in the first event loop.
+template <typename T>
+Future<T> run_in_event_loop(const lambda::function<Future<T>(void)>& f)
+{
+  return run_in_event_loop(loops->front(), f);
+}
+
 } // namespace process {
 
 #endif // __LIBEV_HPP__
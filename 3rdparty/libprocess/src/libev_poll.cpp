@@ -78,13 +78,13 @@ namespace io {
 namespace internal {
 
 // Helper/continuation of 'poll' on future discard.
-void _poll(const std::shared_ptr<ev_async>& async)
+void _poll(Loop* loop, const std::shared_ptr<ev_async>& async)
 {
-  ev_async_send(loop, async.get());
+  ev_async_send(loop->loop, async.get());
 }
 
 
-Future<short> poll(int fd, short events)
+Future<short> poll(Loop* loop, int fd, short events)
 {
   Poll* poll = new Poll();
 
@@ -97,7 +97,7 @@ Future<short> poll(int fd, short events)
 
   // Initialize and start the async watcher.
   ev_async_init(poll->watcher.async.get(), discard_poll);
-  ev_async_start(loop, poll->watcher.async.get());
+  ev_async_start(loop->loop, poll->watcher.async.get());
 
   // Make sure we stop polling if a discard occurs on our future.
   // Note that it's possible that we'll invoke '_poll' when someone
@@ -105,11 +105,11 @@ Future<short> poll(int fd, short events)
   // in this case while we will interrupt the event loop since the
   // async watcher has already been stopped we won't cause
   // 'discard_poll' to get invoked.
-  future.onDiscard(lambda::bind(&_poll, poll->watcher.async));
+  future.onDiscard(lambda::bind(&_poll, loop, poll->watcher.async));
 
   // Initialize and start the I/O watcher.
   ev_io_init(poll->watcher.io.get(), polled, fd, events);
-  ev_io_start(loop, poll->watcher.io.get());
+  ev_io_start(loop->loop, poll->watcher.io.get());
 
   return future;
 }
@@ -123,7 +123,12 @@ Future<short> poll(int fd, short events)
 
   // TODO(benh): Check if the file descriptor is non-blocking?
 
-  return run_in_event_loop<short>(lambda::bind(&internal::poll, fd, events));
+  // Each file descriptor is always polled in the same event loop.
+  Loop* loop = loop_for(fd);
+
+  return run_in_event_loop<short>(
+      loop,
+      lambda::bind(&internal::poll, loop, fd, events));
 }
 
 } // namespace io {
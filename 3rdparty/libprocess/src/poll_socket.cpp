@@ -1,5 +1,12 @@
+#include <limits.h> // For IOV_MAX.
+
 #include <netinet/tcp.h>
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
 #include <process/io.hpp>
 #include <process/network.hpp>
 #include <process/socket.hpp>
@@ -161,6 +168,49 @@ Future<size_t> socket_send_data(int s, const char* data, size_t size)
 }
 
 
+Future<size_t> socket_send_iovec(int s, const struct iovec* iov, int count)
+{
+  CHECK(count > 0);
+
+  // We use 'sendmsg' rather than 'writev' so that we can pass
+  // MSG_NOSIGNAL, like we do for 'send' above.
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = const_cast<struct iovec*>(iov);
+  message.msg_iovlen = std::min(count, IOV_MAX);
+
+  while (true) {
+    ssize_t length = sendmsg(s, &message, MSG_NOSIGNAL);
+
+    if (length < 0 && (errno == EINTR)) {
+      // Interrupted, try again now.
+      continue;
+    } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // Might block, try again later.
+      return io::poll(s, io::WRITE)
+        .then(lambda::bind(&internal::socket_send_iovec, s, iov, count));
+    } else if (length <= 0) {
+      // Socket error or closed.
+      if (length < 0) {
+        const char* error = strerror(errno);
+        VLOG(1) << "Socket error while sending: " << error;
+      } else {
+        VLOG(1) << "Socket closed while sending";
+      }
+      if (length == 0) {
+        return length;
+      } else {
+        return Failure(ErrnoError("Socket sendmsg failed"));
+      }
+    } else {
+      CHECK(length > 0);
+
+      return length;
+    }
+  }
+}
+
+
 Future<size_t> socket_send_file(int s, int fd, off_t offset, size_t size)
 {
   CHECK(size > 0);
@@ -212,5 +262,12 @@ Future<size_t> PollSocketImpl::sendfile(int fd, off_t offset, size_t size)
     .then(lambda::bind(&internal::socket_send_file, get(), fd, offset, size));
 }
 
+
+Future<size_t> PollSocketImpl::send(const struct iovec* iov, int count)
+{
+  return io::poll(get(), io::WRITE)
+    .then(lambda::bind(&internal::socket_send_iovec, get(), iov, count));
+}
+
 } // namespace network {
 } // namespace process {
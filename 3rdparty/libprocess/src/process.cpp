@@ -26,6 +26,7 @@
 #include <sys/uio.h>
 
 #include <algorithm>
+#include <atomic>
 #include <deque>
 #include <fstream>
 #include <iomanip>
@@ -39,6 +40,7 @@
 #include <sstream>
 #include <stack>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -66,12 +68,17 @@
 #include <process/time.hpp>
 #include <process/timer.hpp>
 
+#include <process/metrics/counter.hpp>
+#include <process/metrics/gauge.hpp>
 #include <process/metrics/metrics.hpp>
+#include <process/metrics/timer.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/duration.hpp>
 #include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
 #include <stout/net.hpp>
+#include <stout/numify.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
 #include <stout/path.hpp>
@@ -265,6 +272,10 @@ public:
   SocketManager();
   ~SocketManager();
 
+  // Adds the metrics of the socket manager, which requires the
+  // metrics process to be running.
+  void initialize();
+
   void accepted(const Socket& socket);
 
   void link(ProcessBase* process, const UPID& to);
@@ -279,12 +290,20 @@ public:
 
   Encoder* next(int s);
 
+  // Sends the data that has been queued on the socket while waiting
+  // for the batching delay (see 'delayed').
+  void flush(int s);
+
   void close(int s);
 
   void exited(const Address& address);
   void exited(ProcessBase* process);
 
 private:
+  // Coalesces 'encoder' with the data encoders queued after it on the
+  // socket, up to the batching byte budget. Requires 'mutex'.
+  Encoder* coalesce(int s, Encoder* encoder);
+
   // TODO(bmahler): Leverage a bidirectional multimap instead, or
   // hide the complexity of manipulating 'links' through methods.
   struct
@@ -324,6 +343,43 @@ private:
   // Map from socket to outgoing queue.
   map<int, queue<Encoder*>> outgoing;
 
+  // Map from socket to the bytes queued on it while waiting for the
+  // batching delay to elapse before sending on the (idle) socket.
+  map<int, size_t> delayed;
+
+  // Outbound batching: data encoders that get queued on a socket
+  // while it's sending are coalesced and sent with a single gather
+  // write (see 'coalesce'). Batches are bounded by 'max_bytes', which
+  // can be set via LIBPROCESS_BATCH_MAX_BYTES (e.g., '256KB', while
+  // '0B' disables batching). By default batching only happens when a socket is
+  // already busy, but sending a message on an idle socket can also be
+  // delayed by up to 'max_delay' (LIBPROCESS_BATCH_MAX_DELAY) in
+  // order to form larger batches.
+  struct Batching
+  {
+    Batching();
+
+    Bytes max_bytes;
+    Duration max_delay;
+  } batching;
+
+  // Metrics.
+  struct Metrics
+  {
+    Metrics()
+      : batches("libprocess/outbound_batches"),
+        batched_messages("libprocess/outbound_batched_messages"),
+        batch_flush("libprocess/outbound_batch_flush", Hours(1)) {}
+
+    // Together these give the average number of messages (or HTTP
+    // responses) per batch.
+    process::metrics::Counter batches;
+    process::metrics::Counter batched_messages;
+
+    // The time from when a batch is formed until all of it is sent.
+    process::metrics::Timer<Milliseconds> batch_flush;
+  } metrics;
+
   // HTTP proxies.
   map<int, HttpProxy*> proxies;
 
@@ -332,6 +388,49 @@ private:
 };
 
 
+// Queue of runnable processes owned by a single worker thread. The
+// owning worker pops processes off the front while idle workers steal
+// processes off the back. Each queue has its own lock so that workers
+// only contend with each other when stealing.
+struct RunQueue
+{
+  explicit RunQueue(int _index)
+    : index(_index),
+      active(false),
+      retire(false),
+      busy(false),
+      resumed(0),
+      sampled(0),
+      idle(0) {}
+
+  // Index of this queue (and its worker) in 'ProcessManager::runqs'.
+  const int index;
+
+  std::mutex mutex;
+  std::deque<ProcessBase*> processes;
+
+  // Whether this queue currently has a worker, processes are only
+  // ever enqueued on active queues (protected by 'mutex').
+  bool active;
+
+  // Set to ask the worker to exit, and cleared by the worker once it
+  // has (see 'ProcessManager::retire').
+  std::atomic<bool> retire;
+
+  // Whether the worker is running a process and how many processes
+  // it has run, which get sampled in order to detect workers that are
+  // blocked (see 'ProcessManager::monitor').
+  std::atomic<bool> busy;
+  std::atomic<uint64_t> resumed;
+
+  // Only accessed by the monitor thread: the value of 'resumed' at
+  // the last sample and the number of consecutive samples for which
+  // the worker has been idle.
+  uint64_t sampled;
+  int idle;
+};
+
+
 class ProcessManager
 {
 public:
@@ -363,6 +462,19 @@ public:
 
   void installFirewall(vector<Owned<FirewallRule>>&& rules);
 
+  // Creates the worker threads (and their run queues).
+  void init_threads();
+
+  // Adds the metrics for the worker threads.
+  void initialize();
+
+  // Periodically resizes the pool of worker threads (see
+  // 'ProcessManager::monitor').
+  static void* monitor(void*);
+
+  // Makes the worker of the run queue exit.
+  void retire(RunQueue* runq);
+
   void enqueue(ProcessBase* process);
   ProcessBase* dequeue();
 
@@ -382,9 +494,30 @@ private:
   // Gates for waiting threads (protected by processes_mutex).
   map<ProcessBase*, Gate*> gates;
 
-  // Queue of runnable processes (implemented using list).
-  list<ProcessBase*> runq;
-  std::recursive_mutex runq_mutex;
+  // Starts a worker thread (and activates its run queue).
+  void grow();
+
+  // Returns the total number of processes in the run queues.
+  size_t depth();
+
+  // Returns the fraction of the worker threads running a process.
+  double utilization();
+
+  // Queues of runnable processes, one per worker thread that could be
+  // running. This is only written to in 'init_threads' and is
+  // read-only afterwards, only the first 'workers' queues are active.
+  vector<RunQueue*> runqs;
+
+  // The number of worker threads (i.e., active run queues), which
+  // changes between 'minimum' and 'maximum' as workers block or sit
+  // idle. Only the monitor thread increments this.
+  std::atomic<size_t> workers;
+  size_t minimum;
+  size_t maximum;
+
+  // Used to spread processes that are enqueued by non-worker threads
+  // (e.g., the event loop) across the run queues.
+  unsigned int next;
 
   // Number of running processes, to support Clock::settle operation.
   int running;
@@ -401,6 +534,15 @@ static uint32_t __id__ = 0;
 // Server socket listen backlog.
 static const int LISTEN_BACKLOG = 500000;
 
+// How often the pool of worker threads gets resized. A worker that
+// has been running the same process for longer than this is
+// considered blocked and gets compensated for with another worker.
+static const Duration WORKER_MONITOR_INTERVAL = Milliseconds(100);
+
+// How long a worker beyond the minimum number of workers can sit idle
+// before it exits.
+static const Duration WORKER_IDLE_TIMEOUT = Seconds(10);
+
 // Local server socket.
 static Socket* __s__ = NULL;
 
@@ -434,6 +576,9 @@ ThreadLocal<ProcessBase>* _process_ = new ThreadLocal<ProcessBase>();
 // Per thread executor pointer.
 ThreadLocal<Executor>* _executor_ = new ThreadLocal<Executor>();
 
+// Per thread run queue pointer (NULL for non-worker threads).
+static ThreadLocal<RunQueue>* _runq_ = new ThreadLocal<RunQueue>();
+
 // TODO(dhamon): Reintroduce this when it is plumbed through to Statistics.
 // const Duration LIBPROCESS_STATISTICS_WINDOW = Days(1);
 
@@ -533,7 +678,11 @@ static Message* parse(Request* request)
   message->name = name;
   message->from = from.get();
   message->to = to;
-  message->body = request->body;
+
+  // The request body can be large (e.g., a message with many tasks)
+  // and isn't needed once it's been parsed as a message, so we move
+  // it rather than copy it.
+  message->body = std::move(request->body);
 
   return message;
 }
@@ -609,19 +758,42 @@ void decode_recv(
 
 void* schedule(void* arg)
 {
+  RunQueue* runq = static_cast<RunQueue*>(arg);
+
+  *_runq_ = runq;
+
   do {
+    // NOTE: The monitor may also withdraw the request to retire (see
+    // 'ProcessManager::monitor'), hence we claim it atomically.
+    if (runq->retire.exchange(false)) {
+      process_manager->retire(runq);
+      return NULL;
+    }
+
     ProcessBase* process = process_manager->dequeue();
     if (process == NULL) {
       Gate::state_t old = gate->approach();
       process = process_manager->dequeue();
       if (process == NULL) {
+        // We're woken up via the gate when asked to retire, but the
+        // gate may have been opened before we approached it.
+        if (runq->retire.load()) {
+          gate->leave();
+          continue;
+        }
         gate->arrive(old); // Wait at gate if idle.
         continue;
       } else {
         gate->leave();
       }
     }
+
+    runq->resumed++;
+    runq->busy = true;
+
     process_manager->resume(process);
+
+    runq->busy = false;
   } while (true);
 }
 
@@ -762,23 +934,7 @@ void initialize(const string& delegate)
   socket_manager = new SocketManager();
 
   // Setup processing threads.
-  // We create no fewer than 8 threads because some tests require
-  // more worker threads than 'sysconf(_SC_NPROCESSORS_ONLN)' on
-  // computers with fewer cores.
-  // e.g. https://issues.apache.org/jira/browse/MESOS-818
-  //
-  // TODO(xujyan): Use a smarter algorithm to allocate threads.
-  // Allocating a static number of threads can cause starvation if
-  // there are more waiting Processes than the number of worker
-  // threads.
-  long cpus = std::max(8L, sysconf(_SC_NPROCESSORS_ONLN));
-
-  for (int i = 0; i < cpus; i++) {
-    pthread_t thread; // For now, not saving handles on our threads.
-    if (pthread_create(&thread, NULL, schedule, NULL) != 0) {
-      LOG(FATAL) << "Failed to initialize, pthread_create";
-    }
-  }
+  process_manager->init_threads();
 
   // Initialize the event loop.
   EventLoop::initialize();
@@ -923,6 +1079,9 @@ void initialize(const string& delegate)
   MetricsProcess* metricsProcess = MetricsProcess::instance();
   CHECK_NOTNULL(metricsProcess);
 
+  socket_manager->initialize();
+  process_manager->initialize();
+
   // Initialize the mime types.
   mime::initialize();
 
@@ -935,8 +1094,7 @@ void initialize(const string& delegate)
 
   new Route("/__processes__", None(), __processes__);
 
-  VLOG(1) << "libprocess is initialized on " << address() << " for " << cpus
-          << " cpus";
+  VLOG(1) << "libprocess is initialized on " << address();
 }
 
 
@@ -1148,16 +1306,20 @@ void HttpProxy::stream(
   bool finished = false; // Whether we're done streaming.
 
   if (chunk.isReady()) {
-    std::ostringstream out;
+    vector<string> buffers;
 
     if (chunk.get().empty()) {
       // Finished reading.
-      out << "0\r\n" << "\r\n";
+      buffers.push_back("0\r\n\r\n");
       finished = true;
     } else {
+      std::ostringstream out;
       out << std::hex << chunk.get().size() << "\r\n";
-      out << chunk.get();
-      out << "\r\n";
+
+      // Avoid copying the chunk into the same buffer as its framing.
+      buffers.push_back(out.str());
+      buffers.push_back(chunk.get());
+      buffers.push_back("\r\n");
 
       // Keep reading.
       reader.read()
@@ -1166,7 +1328,7 @@ void HttpProxy::stream(
 
     // Always persist the connection when streaming is not finished.
     socket_manager->send(
-        new DataEncoder(socket, out.str()),
+        new DataEncoder(socket, std::move(buffers)),
         finished ? request.keepAlive : true);
   } else if (chunk.isFailed()) {
     VLOG(1) << "Failed to read from stream: " << chunk.failure();
@@ -1188,12 +1350,51 @@ void HttpProxy::stream(
 }
 
 
+SocketManager::Batching::Batching()
+  : max_bytes(Kilobytes(64)),
+    max_delay(Duration::zero())
+{
+  Option<string> value = os::getenv("LIBPROCESS_BATCH_MAX_BYTES");
+  if (value.isSome()) {
+    Try<Bytes> bytes = Bytes::parse(value.get());
+    if (bytes.isError()) {
+      LOG(FATAL) << "LIBPROCESS_BATCH_MAX_BYTES=" << value.get()
+                 << " is not a valid number of bytes: " << bytes.error();
+    }
+    max_bytes = bytes.get();
+  }
+
+  value = os::getenv("LIBPROCESS_BATCH_MAX_DELAY");
+  if (value.isSome()) {
+    Try<Duration> delay = Duration::parse(value.get());
+    if (delay.isError()) {
+      LOG(FATAL) << "LIBPROCESS_BATCH_MAX_DELAY=" << value.get()
+                 << " is not a valid duration: " << delay.error();
+    }
+    max_delay = delay.get();
+  }
+
+  // Delaying without batching would only add latency.
+  if (max_bytes == Bytes(0)) {
+    max_delay = Duration::zero();
+  }
+}
+
+
 SocketManager::SocketManager() {}
 
 
 SocketManager::~SocketManager() {}
 
 
+void SocketManager::initialize()
+{
+  process::metrics::add(metrics.batches);
+  process::metrics::add(metrics.batched_messages);
+  process::metrics::add(metrics.batch_flush);
+}
+
+
 void SocketManager::accepted(const Socket& socket)
 {
   synchronized (mutex) {
@@ -1382,9 +1583,11 @@ void send(Encoder* encoder, Socket* socket)
 {
   switch (encoder->kind()) {
     case Encoder::DATA: {
+      int count;
       size_t size;
-      const char* data = reinterpret_cast<DataEncoder*>(encoder)->next(&size);
-      socket->send(data, size)
+      const struct iovec* iov =
+        reinterpret_cast<DataEncoder*>(encoder)->next(&count, &size);
+      socket->send(iov, count)
         .onAny(lambda::bind(
             &internal::_send,
             lambda::_1,
@@ -1544,6 +1747,7 @@ void SocketManager::send(Message* message)
 
   Option<Socket> socket = None();
   bool connect = false;
+  Encoder* encoder = NULL; // Non-null if it should be sent now.
 
   synchronized (mutex) {
     // Check if there is already a socket.
@@ -1560,14 +1764,40 @@ void SocketManager::send(Message* message)
         dispose.insert(socket.get());
       }
 
-      if (outgoing.count(socket.get()) > 0) {
-        outgoing[socket.get()].push(new MessageEncoder(socket.get(), message));
+      if (outgoing.count(s) > 0) {
+        outgoing[s].push(new MessageEncoder(socket.get(), message));
+
+        // The message gets sent after the data ahead of it, unless
+        // we're waiting for the batching delay and the queued data
+        // has now reached the byte budget, in which case we send it
+        // all without waiting any longer.
+        if (delayed.count(s) == 0) {
+          return;
+        }
+
+        delayed[s] += outgoing[s].back()->remaining();
+
+        if (delayed[s] < batching.max_bytes.bytes()) {
+          return;
+        }
+
+        delayed.erase(s);
+        encoder = next(s);
+      } else if (batching.max_delay > Duration::zero()) {
+        // Wait a bit for more messages to coalesce with this one.
+        outgoing[s].push(new MessageEncoder(socket.get(), message));
+        delayed[s] = outgoing[s].back()->remaining();
+
+        Clock::timer(
+            batching.max_delay,
+            lambda::bind(&SocketManager::flush, this, s));
         return;
       } else {
         // Initialize the outgoing queue.
-        outgoing[socket.get()];
-      }
+        outgoing[s];
 
+        encoder = new MessageEncoder(socket.get(), message);
+      }
     } else {
       // No peristent or temporary socket to the socket address
       // currently exists, so we create a temporary one.
@@ -1601,12 +1831,10 @@ void SocketManager::send(Message* message)
           lambda::_1,
           new Socket(socket.get()),
           message));
-  } else {
+  } else if (encoder != NULL) {
     // If we're not connecting and we haven't added the encoder to
     // the 'outgoing' queue then schedule it to be sent.
-    internal::send(
-        new MessageEncoder(socket.get(), message),
-        new Socket(socket.get()));
+    internal::send(encoder, new Socket(socket.get()));
   }
 }
 
@@ -1636,7 +1864,7 @@ Encoder* SocketManager::next(int s)
         // More messages!
         Encoder* encoder = outgoing[s].front();
         outgoing[s].pop();
-        return encoder;
+        return coalesce(s, encoder);
       } else {
         // No more messages ... erase the outgoing queue.
         outgoing.erase(s);
@@ -1690,6 +1918,65 @@ Encoder* SocketManager::next(int s)
 }
 
 
+Encoder* SocketManager::coalesce(int s, Encoder* encoder)
+{
+  queue<Encoder*>& encoders = outgoing[s];
+
+  // NOTE: Data encoders that follow a file encoder can't be coalesced
+  // with the data encoders ahead of it without reordering the data.
+  size_t bytes = encoder->remaining();
+
+  if (encoder->kind() != Encoder::DATA ||
+      encoders.empty() ||
+      encoders.front()->kind() != Encoder::DATA ||
+      bytes >= batching.max_bytes.bytes()) {
+    return encoder;
+  }
+
+  BatchEncoder* batch = new BatchEncoder(encoder->socket());
+  batch->add(reinterpret_cast<DataEncoder*>(encoder));
+
+  while (!encoders.empty() &&
+         encoders.front()->kind() == Encoder::DATA &&
+         bytes < batching.max_bytes.bytes()) {
+    DataEncoder* next = reinterpret_cast<DataEncoder*>(encoders.front());
+    encoders.pop();
+
+    bytes += next->remaining();
+    batch->add(next);
+  }
+
+  ++metrics.batches;
+  metrics.batched_messages += batch->size();
+  metrics.batch_flush.time(batch->flushed());
+
+  return batch;
+}
+
+
+void SocketManager::flush(int s)
+{
+  Encoder* encoder = NULL;
+
+  synchronized (mutex) {
+    // The data might already have been sent because it reached the
+    // byte budget, or the socket might have been closed. If the file
+    // descriptor got reused by another socket that's also waiting for
+    // the batching delay we just end up sending its data early.
+    if (delayed.count(s) == 0) {
+      return;
+    }
+
+    delayed.erase(s);
+    encoder = next(s);
+  }
+
+  if (encoder != NULL) {
+    internal::send(encoder, new Socket(encoder->socket()));
+  }
+}
+
+
 void SocketManager::close(int s)
 {
   HttpProxy* proxy = NULL; // Non-null if needs to be terminated.
@@ -1712,6 +1999,8 @@ void SocketManager::close(int s)
         outgoing.erase(s);
       }
 
+      delayed.erase(s);
+
       // Clean up after sockets used for remote communication.
       if (addresses.count(s) > 0) {
         const Address& address = addresses[s];
@@ -1883,7 +2172,11 @@ void SocketManager::exited(ProcessBase* process)
 
 
 ProcessManager::ProcessManager(const string& _delegate)
-  : delegate(_delegate)
+  : delegate(_delegate),
+    workers(0),
+    minimum(0),
+    maximum(0),
+    next(0)
 {
   running = 0;
   __sync_synchronize(); // Ensure write to 'running' visible in other threads.
@@ -2162,6 +2455,14 @@ void ProcessManager::resume(ProcessBase* process)
 {
   __process__ = process;
 
+  // Remember which worker ran this process so that it gets enqueued
+  // on the same worker the next time it becomes runnable. Threads
+  // that donate themselves (see 'ProcessManager::wait') are not
+  // workers and so they don't change the process' affinity.
+  if (*_runq_ != NULL) {
+    process->worker = (*_runq_)->index;
+  }
+
   VLOG(2) << "Resuming " << process->pid << " at " << Clock::now();
 
   bool terminate = false;
@@ -2176,18 +2477,35 @@ void ProcessManager::resume(ProcessBase* process)
     catch (...) { terminate = true; }
   }
 
-  while (!terminate && !blocked) {
-    Event* event = NULL;
+  process->state = ProcessBase::RUNNING;
 
-    synchronized (process->mutex) {
-      if (process->events.size() > 0) {
-        event = process->events.front();
-        process->events.pop_front();
-        process->state = ProcessBase::RUNNING;
-      } else {
-        process->state = ProcessBase::BLOCKED;
-        blocked = true;
+  while (!terminate && !blocked) {
+    Event* event = process->dequeue();
+
+    if (event == NULL) {
+      // Once we are blocked a sender can make us ready and another
+      // worker can run us to termination, after which the process
+      // may get deleted. Hold a reference while we still look at the
+      // process below, since 'cleanup' waits for all references.
+      ProcessReference reference(process);
+
+      process->state = ProcessBase::BLOCKED;
+
+      // A sender might have pushed an event after we found the
+      // mailbox empty but before we blocked, in which case it saw us
+      // running and didn't make us runnable. If so, try and take
+      // ourselves back from blocked to running, unless a sender has
+      // already made us ready (and enqueued us) in the meantime.
+      if (process->injected.load() != NULL ||
+          process->incoming.load() != NULL) {
+        ProcessBase::ProcessState state = ProcessBase::BLOCKED;
+        if (process->state.compare_exchange_strong(
+                state, ProcessBase::RUNNING)) {
+          continue;
+        }
       }
+
+      blocked = true;
     }
 
     if (!blocked) {
@@ -2279,21 +2597,19 @@ void ProcessManager::cleanup(ProcessBase* process)
   // the process we are cleaning up will get dropped (since it's
   // terminating) and eliminates the potential of enqueueing them on
   // another process that gets spawned with the same PID.
-  deque<Event*> events;
-
-  synchronized (process->mutex) {
-    process->state = ProcessBase::TERMINATING;
-    events = process->events;
-    process->events.clear();
-  }
+  process->state = ProcessBase::TERMINATING;
 
   // Delete pending events.
-  while (!events.empty()) {
-    Event* event = events.front();
-    events.pop_front();
+  Event* event = NULL;
+  while ((event = process->dequeue()) != NULL) {
     delete event;
   }
 
+  // Events that were enqueued by senders that raced with us setting
+  // the terminating state above (see ProcessBase::enqueue). These are
+  // collected while holding the processes lock but deleted after.
+  Event* events = NULL;
+
   // Possible gate non-libprocess threads are waiting at.
   Gate* gate = NULL;
 
@@ -2307,9 +2623,15 @@ void ProcessManager::cleanup(ProcessBase* process)
       __sync_synchronize();
     }
 
-    synchronized (process->mutex) {
-      CHECK(process->events.empty());
+    // Now that there are no more references no sender can still be
+    // in the middle of enqueueing an event, so take whatever made it
+    // into the mailbox after we started terminating.
+    while ((event = process->dequeue()) != NULL) {
+      event->next = events;
+      events = event;
+    }
 
+    synchronized (process->mutex) {
       processes.erase(process->pid.id);
 
       // Lookup gate to wake up waiting threads.
@@ -2361,6 +2683,13 @@ void ProcessManager::cleanup(ProcessBase* process)
       gate->open();
     }
   }
+
+  // Delete the events that raced with terminating the process.
+  while (events != NULL) {
+    event = events;
+    events = events->next;
+    delete event;
+  }
 }
 
 
@@ -2435,23 +2764,37 @@ bool ProcessManager::wait(const UPID& pid)
       // Check if it is runnable in order to donate this thread.
       if (process->state == ProcessBase::BOTTOM ||
           process->state == ProcessBase::READY) {
-        synchronized (runq_mutex) {
-          list<ProcessBase*>::iterator it =
-            find(runq.begin(), runq.end(), process);
-          if (it != runq.end()) {
-            // Found it! Remove it from the run queue since we'll be
-            // donating our thread and also increment 'running' before
-            // leaving this 'runq' protected critical section so that
-            // everyone that is waiting for the processes to settle
-            // continue to wait (otherwise they could see nothing in
-            // 'runq' and 'running' equal to 0 between when we exit
-            // this critical section and increment 'running').
-            runq.erase(it);
-            __sync_fetch_and_add(&running, 1);
-          } else {
-            // Another thread has resumed the process ...
-            process = NULL;
+        bool found = false;
+
+        // The process may have been stolen by another worker, so we
+        // have to look through all of the run queues.
+        foreach (RunQueue* runq, runqs) {
+          synchronized (runq->mutex) {
+            deque<ProcessBase*>::iterator it = find(
+                runq->processes.begin(), runq->processes.end(), process);
+            if (it != runq->processes.end()) {
+              // Found it! Remove it from the run queue since we'll be
+              // donating our thread and also increment 'running'
+              // before leaving this 'runq' protected critical section
+              // so that everyone that is waiting for the processes to
+              // settle continue to wait (otherwise they could see
+              // nothing in the run queues and 'running' equal to 0
+              // between when we exit this critical section and
+              // increment 'running').
+              runq->processes.erase(it);
+              __sync_fetch_and_add(&running, 1);
+              found = true;
+            }
           }
+
+          if (found) {
+            break;
+          }
+        }
+
+        if (!found) {
+          // Another thread has resumed the process ...
+          process = NULL;
         }
       } else {
         // Process is not runnable, so no need to donate ...
@@ -2493,45 +2836,351 @@ void ProcessManager::installFirewall(vector<Owned<FirewallRule>>&& rules)
 }
 
 
+void ProcessManager::init_threads()
+{
+  // We start with a worker thread per core (but at least 8) and then
+  // start more workers (up to 'maximum') when processes block a
+  // worker, e.g., doing synchronous I/O or waiting on another
+  // process, since otherwise the runnable processes starve. These
+  // extra workers exit once they sit idle. Detecting a blocked worker
+  // takes at least WORKER_MONITOR_INTERVAL, hence the floor: some
+  // tests (and programs) require more worker threads than
+  // 'sysconf(_SC_NPROCESSORS_ONLN)' on computers with fewer cores
+  // (e.g. https://issues.apache.org/jira/browse/MESOS-818) and would
+  // otherwise stall on every blocking call.
+  long threads = std::max(8L, sysconf(_SC_NPROCESSORS_ONLN));
+
+  // Allow the number of worker threads to be overridden, e.g., for
+  // measuring how throughput scales with the number of threads.
+  Option<string> value = os::getenv("LIBPROCESS_NUM_WORKER_THREADS");
+  if (value.isSome()) {
+    Try<long> number = numify<long>(value.get());
+    if (number.isError() || number.get() <= 0) {
+      LOG(FATAL) << "LIBPROCESS_NUM_WORKER_THREADS=" << value.get()
+                 << " is not a valid number of threads";
+    }
+    threads = number.get();
+  }
+
+  long limit = std::max(64L, 4 * threads);
+
+  value = os::getenv("LIBPROCESS_MAX_WORKER_THREADS");
+  if (value.isSome()) {
+    Try<long> number = numify<long>(value.get());
+    if (number.isError() || number.get() < threads) {
+      LOG(FATAL) << "LIBPROCESS_MAX_WORKER_THREADS=" << value.get()
+                 << " is not a valid number of threads (must be at least "
+                 << threads << ")";
+    }
+    limit = number.get();
+  }
+
+  minimum = threads;
+  maximum = limit;
+
+  // NOTE: All of the run queues must exist before any worker thread
+  // is started since workers steal from each other's queues.
+  for (size_t i = 0; i < maximum; i++) {
+    runqs.push_back(new RunQueue(i));
+  }
+
+  for (size_t i = 0; i < minimum; i++) {
+    grow();
+  }
+
+  pthread_t thread; // For now, not saving handles on our threads.
+  if (pthread_create(&thread, NULL, &ProcessManager::monitor, this) != 0) {
+    LOG(FATAL) << "Failed to initialize, pthread_create";
+  }
+
+  VLOG(1) << "Created " << minimum << " worker threads (up to "
+          << maximum << ")";
+}
+
+
+void ProcessManager::initialize()
+{
+  // NOTE: Gauges must be evaluated by a process, we use the metrics
+  // process since these only read counters that are updated by the
+  // worker threads themselves.
+  const UPID pid = MetricsProcess::instance()->self();
+
+  process::metrics::add(process::metrics::Gauge(
+      "libprocess/worker_threads",
+      defer(pid, [this]() -> Future<double> {
+        return static_cast<double>(workers.load());
+      })));
+
+  process::metrics::add(process::metrics::Gauge(
+      "libprocess/worker_utilization",
+      defer(pid, [this]() -> Future<double> {
+        return utilization();
+      })));
+
+  process::metrics::add(process::metrics::Gauge(
+      "libprocess/run_queue_depth",
+      defer(pid, [this]() -> Future<double> {
+        return static_cast<double>(depth());
+      })));
+}
+
+
+void* ProcessManager::monitor(void* arg)
+{
+  ProcessManager* manager = static_cast<ProcessManager*>(arg);
+
+  // The run queue of the worker that was last asked to retire, until
+  // it either has or the request gets withdrawn.
+  RunQueue* retiring = NULL;
+
+  // Waits for the worker that claimed the request to retire to finish
+  // doing so, which doesn't block (see 'ProcessManager::retire'), since
+  // workers are always added and retired at the end of 'runqs'.
+  auto retired = [manager, &retiring]() {
+    while (manager->workers.load() > static_cast<size_t>(retiring->index)) {
+      std::this_thread::yield();
+    }
+    retiring = NULL;
+  };
+
+  do {
+    os::sleep(WORKER_MONITOR_INTERVAL);
+
+    if (retiring != NULL && !retiring->retire.load()) {
+      retired();
+    }
+
+    size_t size = manager->workers.load();
+
+    // Count the workers that have been running the same process since
+    // the last sample, i.e., for at least WORKER_MONITOR_INTERVAL.
+    size_t blocked = 0;
+
+    for (size_t i = 0; i < size; i++) {
+      RunQueue* runq = manager->runqs[i];
+
+      const uint64_t resumed = runq->resumed.load();
+
+      if (resumed != runq->sampled) {
+        runq->idle = 0;
+      } else if (runq->busy.load()) {
+        runq->idle = 0;
+        blocked++;
+      } else {
+        runq->idle++;
+      }
+
+      runq->sampled = resumed;
+    }
+
+    // Compensate for each blocked worker while processes are waiting
+    // to be run, otherwise they could be starved.
+    const size_t target =
+      std::min(manager->maximum, manager->minimum + blocked);
+
+    if (size < target && manager->depth() > 0) {
+      // A worker that is still to retire (e.g., it has since started
+      // running a process that blocks) gets to stay instead, unless
+      // it has already claimed the request.
+      if (retiring != NULL) {
+        if (retiring->retire.exchange(false)) {
+          retiring = NULL;
+        } else {
+          retired();
+          size = manager->workers.load();
+        }
+      }
+
+      for (size_t i = size; i < target; i++) {
+        manager->grow();
+      }
+
+      VLOG(1) << "Increased worker threads from " << size << " to " << target
+              << " to compensate for " << blocked << " blocked workers";
+      continue;
+    }
+
+    // Retire the last worker if it has been idle for long enough.
+    // NOTE: Only the last worker can be retired so that the active
+    // run queues stay contiguous, which means idle workers may
+    // linger while a later worker is still busy.
+    if (retiring == NULL && size > manager->minimum) {
+      RunQueue* runq = manager->runqs[size - 1];
+      if (WORKER_MONITOR_INTERVAL * runq->idle >= WORKER_IDLE_TIMEOUT) {
+        retiring = runq;
+        runq->retire = true;
+        gate->open(true);
+      }
+    }
+  } while (true);
+
+  return NULL;
+}
+
+
+void ProcessManager::grow()
+{
+  const size_t index = workers.load();
+
+  CHECK_LT(index, runqs.size());
+
+  RunQueue* runq = runqs[index];
+
+  CHECK(!runq->retire.load());
+
+  synchronized (runq->mutex) {
+    runq->active = true;
+  }
+
+  runq->sampled = runq->resumed.load();
+  runq->idle = 0;
+
+  workers++;
+
+  pthread_t thread; // For now, not saving handles on our threads.
+  if (pthread_create(&thread, NULL, schedule, runq) != 0) {
+    LOG(FATAL) << "Failed to initialize, pthread_create";
+  }
+}
+
+
+void ProcessManager::retire(RunQueue* runq)
+{
+  CHECK_EQ(static_cast<size_t>(runq->index) + 1, workers.load());
+
+  // Deactivate the run queue so that nothing else gets enqueued on
+  // it and hand off anything that did to the first worker.
+  deque<ProcessBase*> processes;
+
+  synchronized (runq->mutex) {
+    runq->active = false;
+    std::swap(processes, runq->processes);
+  }
+
+  if (!processes.empty()) {
+    synchronized (runqs[0]->mutex) {
+      foreach (ProcessBase* process, processes) {
+        runqs[0]->processes.push_back(process);
+      }
+    }
+
+    gate->open(false);
+  }
+
+  workers--;
+
+  VLOG(1) << "Decreased worker threads to " << workers.load();
+}
+
+
+size_t ProcessManager::depth()
+{
+  size_t depth = 0;
+
+  foreach (RunQueue* runq, runqs) {
+    synchronized (runq->mutex) {
+      depth += runq->processes.size();
+    }
+  }
+
+  return depth;
+}
+
+
+double ProcessManager::utilization()
+{
+  const size_t size = workers.load();
+
+  size_t busy = 0;
+  for (size_t i = 0; i < size; i++) {
+    if (runqs[i]->busy.load()) {
+      busy++;
+    }
+  }
+
+  return size == 0 ? 0.0 : static_cast<double>(busy) / size;
+}
+
+
 void ProcessManager::enqueue(ProcessBase* process)
 {
   CHECK(process != NULL);
 
-  // TODO(benh): Check and see if this process has it's own thread. If
-  // it does, push it on that threads runq, and wake up that thread if
-  // it's not running. Otherwise, check and see which thread this
-  // process was last running on, and put it on that threads runq.
+  // Put the process back on the run queue of the worker thread that
+  // last ran it, since that worker is the most likely to still have
+  // the process in its cache. If the process has never run, use the
+  // run queue of the current worker thread or, if the process is
+  // being enqueued from a non-worker thread, pick one round-robin.
+  // NOTE: 'process->worker' is only a hint and is read without
+  // synchronization with 'resume'.
+  RunQueue* runq = NULL;
+  if (process->worker >= 0) {
+    runq = runqs[process->worker];
+  } else if (*_runq_ != NULL) {
+    runq = *_runq_;
+  } else {
+    runq = runqs[__sync_fetch_and_add(&next, 1) % workers.load()];
+  }
 
-  synchronized (runq_mutex) {
-    CHECK(find(runq.begin(), runq.end(), process) == runq.end());
-    runq.push_back(process);
+  // The worker may have since retired, in which case we pick another
+  // run queue round-robin.
+  while (true) {
+    synchronized (runq->mutex) {
+      if (runq->active) {
+        runq->processes.push_back(process);
+        break;
+      }
+    }
+
+    runq = runqs[__sync_fetch_and_add(&next, 1) % workers.load()];
   }
 
-  // Wake up the processing thread if necessary.
-  gate->open();
+  // Wake up a processing thread if necessary. Waking up a single
+  // thread is sufficient since any idle worker will steal the
+  // process if its own worker is busy.
+  gate->open(false);
 }
 
 
 ProcessBase* ProcessManager::dequeue()
 {
-  // TODO(benh): Remove a process from this thread's runq. If there
-  // are no processes to run, and this is not a dedicated thread, then
-  // steal one from another threads runq.
+  RunQueue* runq = *_runq_;
+  CHECK_NOTNULL(runq);
 
   ProcessBase* process = NULL;
 
-  synchronized (runq_mutex) {
-    if (!runq.empty()) {
-      process = runq.front();
-      runq.pop_front();
+  // Try our own run queue first.
+  synchronized (runq->mutex) {
+    if (!runq->processes.empty()) {
+      process = runq->processes.front();
+      runq->processes.pop_front();
       // Increment the running count of processes in order to support
       // the Clock::settle() operation (this must be done atomically
-      // with removing the process from the runq).
+      // with removing the process from the run queue).
       __sync_fetch_and_add(&running, 1);
+      return process;
     }
   }
 
-  return process;
+  // Otherwise try and steal a process off the back of another
+  // worker's run queue, starting with our neighbor so that thieves
+  // spread out across the queues.
+  const size_t size = workers.load();
+
+  for (size_t i = 1; i < size; i++) {
+    RunQueue* victim = runqs[(runq->index + i) % size];
+
+    synchronized (victim->mutex) {
+      if (!victim->processes.empty()) {
+        process = victim->processes.back();
+        victim->processes.pop_back();
+        __sync_fetch_and_add(&running, 1);
+        return process;
+      }
+    }
+  }
+
+  return NULL;
 }
 
 
@@ -2555,24 +3204,32 @@ void ProcessManager::settle()
 
     done = true; // Assume to start that we are settled.
 
-    synchronized (runq_mutex) {
-      if (!runq.empty()) {
+    // Lock all of the run queues (always in the same order) so that
+    // we get a consistent view of the run queues and 'running'.
+    foreach (RunQueue* runq, runqs) {
+      runq->mutex.lock();
+    }
+
+    foreach (RunQueue* runq, runqs) {
+      if (!runq->processes.empty()) {
         done = false;
-        continue;
+        break;
       }
+    }
 
-      // Read barrier for 'running'.
-      __sync_synchronize();
+    // Read barrier for 'running'.
+    __sync_synchronize();
 
-      if (running > 0) {
-        done = false;
-        continue;
-      }
+    if (done && running > 0) {
+      done = false;
+    }
 
-      if (!Clock::settled()) {
-        done = false;
-        continue;
-      }
+    if (done && !Clock::settled()) {
+      done = false;
+    }
+
+    foreach (RunQueue* runq, runqs) {
+      runq->mutex.unlock();
     }
   } while (!done);
 }
@@ -2646,8 +3303,16 @@ Future<Response> ProcessManager::__processes__(const Request&)
       } visitor(&events);
 
       synchronized (process->mutex) {
-        foreach (Event* event, process->events) {
-          event->visit(&visitor);
+        Event* lists[] = {
+          process->injected.load(),
+          process->head,
+          process->incoming.load()
+        };
+
+        foreach (Event* event, lists) {
+          for (; event != NULL; event = event->next) {
+            event->visit(&visitor);
+          }
         }
       }
 
@@ -2666,8 +3331,14 @@ ProcessBase::ProcessBase(const string& id)
 
   state = ProcessBase::BOTTOM;
 
+  injected = NULL;
+  incoming = NULL;
+  head = NULL;
+
   refs = 0;
 
+  worker = -1;
+
   pid.id = id != "" ? id : ID::generate();
   pid.address = __address__;
 
@@ -2687,25 +3358,77 @@ void ProcessBase::enqueue(Event* event, bool inject)
 {
   CHECK(event != NULL);
 
+  // Take a reference for the duration of the enqueue so that
+  // 'ProcessManager::cleanup', which waits for all references to be
+  // released after setting the terminating state, can't miss an
+  // event that we push after it has emptied the mailbox.
+  __sync_fetch_and_add(&refs, 1);
+
+  ProcessState current = state.load();
+
+  if (current == TERMINATING || current == TERMINATED) {
+    delete event;
+  } else {
+    std::atomic<Event*>& stack = inject ? injected : incoming;
+
+    // NOTE: The push must be sequentially consistent (not just a
+    // release) since it pairs with the worker storing BLOCKED and
+    // then checking the mailbox (see ProcessManager::resume): each
+    // side writes one location and then reads the other, and with
+    // weaker orderings both could miss each other's write, leaving
+    // the process blocked with events queued.
+    event->next = stack.load(std::memory_order_relaxed);
+    while (!stack.compare_exchange_weak(
+        event->next, event, std::memory_order_seq_cst)) {}
+
+    // Make the process runnable if it was blocked. If the process is
+    // running then the worker running it will observe the event
+    // before it blocks (see ProcessManager::resume).
+    ProcessState blocked = BLOCKED;
+    if (state.compare_exchange_strong(blocked, READY)) {
+      process_manager->enqueue(this);
+    }
+  }
+
+  __sync_fetch_and_sub(&refs, 1);
+}
+
+
+Event* ProcessBase::dequeue()
+{
   synchronized (mutex) {
-    if (state != TERMINATING && state != TERMINATED) {
-      if (!inject) {
-        events.push_back(event);
-      } else {
-        events.push_front(event);
+    // Injected events get served before anything else, most recently
+    // injected first, which is exactly the order of the stack.
+    if (injected.load(std::memory_order_relaxed) != NULL) {
+      Event* first = injected.exchange(NULL, std::memory_order_acquire);
+      Event* last = first;
+      while (last->next != NULL) {
+        last = last->next;
       }
 
-      if (state == BLOCKED) {
-        state = READY;
-        process_manager->enqueue(this);
+      last->next = head;
+      head = first;
+    }
+
+    // Take all of the incoming events at once and append them in the
+    // order that they were sent (i.e., reverse the stack).
+    if (head == NULL && incoming.load(std::memory_order_relaxed) != NULL) {
+      Event* event = incoming.exchange(NULL, std::memory_order_acquire);
+      while (event != NULL) {
+        Event* next = event->next;
+        event->next = head;
+        head = event;
+        event = next;
       }
+    }
 
-      CHECK(state == BOTTOM ||
-            state == READY ||
-            state == RUNNING);
-    } else {
-      delete event;
+    Event* event = head;
+    if (event != NULL) {
+      head = event->next;
+      event->next = NULL;
     }
+
+    return event;
   }
 }
 
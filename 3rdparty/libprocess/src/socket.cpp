@@ -210,6 +210,18 @@ static Future<Nothing> _send(
 }
 
 
+Future<size_t> Socket::Impl::send(const struct iovec* iov, int count)
+{
+  for (int i = 0; i < count; i++) {
+    if (iov[i].iov_len > 0) {
+      return send(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    }
+  }
+
+  return Failure("No data to send");
+}
+
+
 Future<Nothing> Socket::Impl::send(const std::string& _data)
 {
   Owned<string> data(new string(_data));
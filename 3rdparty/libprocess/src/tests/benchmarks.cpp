@@ -20,34 +20,55 @@
 
 #include <gmock/gmock.h>
 
+#include <sys/wait.h>
+
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include <process/collect.hpp>
+#include <process/dispatch.hpp>
 #include <process/future.hpp>
 #include <process/gmock.hpp>
 #include <process/gtest.hpp>
 #include <process/owned.hpp>
 #include <process/process.hpp>
+#include <process/socket.hpp>
+#include <process/subprocess.hpp>
+#include <process/timer.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/duration.hpp>
 #include <stout/gtest.hpp>
 #include <stout/hashset.hpp>
+#include <stout/os.hpp>
 #include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
 
 using namespace process;
 
+using process::network::Address;
+using process::network::Socket;
+
 using std::cout;
 using std::endl;
 using std::list;
+using std::map;
 using std::ostringstream;
 using std::string;
 using std::vector;
 
+using testing::WithParamInterface;
+
+// The path of this binary, used to re-run a benchmark in a subprocess.
+static string executable;
+
 int main(int argc, char** argv)
 {
+  executable = argv[0];
+
   // Initialize Google Mock/Test.
   testing::InitGoogleMock(&argc, argv);
 
@@ -368,3 +389,310 @@ TEST(Process, Process_BENCHMARK_LargeNumberOfLinks)
     delete process;
   }
 }
+
+
+// A process that bounces a message back and forth with a peer until
+// the requested number of round trips has completed.
+class PingPongProcess : public Process<PingPongProcess>
+{
+public:
+  explicit PingPongProcess(size_t _roundtrips)
+    : roundtrips(_roundtrips), count(0) {}
+
+  virtual ~PingPongProcess() {}
+
+  Future<Nothing> run(const PID<PingPongProcess>& peer)
+  {
+    dispatch(peer, &PingPongProcess::ping, self());
+    return done.future();
+  }
+
+  void ping(const PID<PingPongProcess>& from)
+  {
+    dispatch(from, &PingPongProcess::pong, self());
+  }
+
+  void pong(const PID<PingPongProcess>& from)
+  {
+    if (++count == roundtrips) {
+      done.set(Nothing());
+    } else {
+      dispatch(from, &PingPongProcess::ping, self());
+    }
+  }
+
+private:
+  const size_t roundtrips;
+  size_t count;
+  Promise<Nothing> done;
+};
+
+
+// Runs the (disabled) test 'test' of this binary in a subprocess
+// with 'environment' added to its environment. This lets a benchmark
+// vary settings that libprocess only reads once, when it is
+// initialized, such as the number of threads it starts.
+static void run(const string& test, const map<string, string>& environment)
+{
+  map<string, string> variables = os::environment();
+  foreachpair (const string& name, const string& value, environment) {
+    variables[name] = value;
+  }
+
+  vector<string> argv = {
+    executable,
+    "--gtest_filter=" + test,
+    "--gtest_also_run_disabled_tests"
+  };
+
+  Try<Subprocess> s = subprocess(
+      executable,
+      argv,
+      Subprocess::FD(STDIN_FILENO),
+      Subprocess::FD(STDOUT_FILENO),
+      Subprocess::FD(STDERR_FILENO),
+      None(),
+      variables);
+
+  ASSERT_SOME(s);
+
+  AWAIT_READY_FOR(s.get().status(), Minutes(10));
+  ASSERT_SOME(s.get().status().get());
+
+  int status = s.get().status().get().get();
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    << test << " failed with status " << status;
+}
+
+
+class Process_BENCHMARK_Test : public ::testing::Test,
+                               public WithParamInterface<size_t> {};
+
+
+// The scalability benchmark is parameterized by the number of worker
+// threads.
+INSTANTIATE_TEST_CASE_P(
+    WorkerThreads,
+    Process_BENCHMARK_Test,
+    ::testing::Values(1U, 2U, 4U, 8U, 16U, 32U));
+
+
+// Measures how the aggregate message throughput scales with the
+// number of worker threads. Since libprocess starts its workers when
+// it is initialized, each thread count gets its own subprocess.
+TEST_P(Process_BENCHMARK_Test, ThreadScalability)
+{
+  const string threads = stringify(GetParam());
+
+  // NOTE: We also cap the number of workers so that libprocess does
+  // not start more of them when it sees the workers busy for a while.
+  run("Process.DISABLED_Process_BENCHMARK_PingPong",
+      {{"LIBPROCESS_NUM_WORKER_THREADS", threads},
+       {"LIBPROCESS_MAX_WORKER_THREADS", threads}});
+}
+
+
+// Measures the aggregate message throughput of many independent
+// pairs of processes, which stresses the run queues of the process
+// manager rather than any single process. Run by ThreadScalability
+// for each number of worker threads.
+TEST(Process, DISABLED_Process_BENCHMARK_PingPong)
+{
+  // Enough pairs to keep all of the worker threads busy.
+  const size_t pairs = 64;
+  const size_t roundtrips = 50000;
+
+  vector<Owned<PingPongProcess>> processes;
+  for (size_t i = 0; i < 2 * pairs; i++) {
+    processes.push_back(Owned<PingPongProcess>(
+        new PingPongProcess(roundtrips)));
+    spawn(processes.back().get());
+  }
+
+  Stopwatch watch;
+  watch.start();
+
+  list<Future<Nothing>> futures;
+  for (size_t i = 0; i < pairs; i++) {
+    PID<PingPongProcess> peer = processes[2 * i + 1]->self();
+    futures.push_back(dispatch(
+        processes[2 * i]->self(), &PingPongProcess::run, peer));
+  }
+
+  AWAIT_READY_FOR(collect(futures), Minutes(5));
+
+  Duration elapsed = watch.elapsed();
+
+  // Each round trip is made up of two messages.
+  double throughput = (2 * roundtrips * pairs) / elapsed.secs();
+
+  cout << os::getenv("LIBPROCESS_NUM_WORKER_THREADS").get("default")
+       << " worker threads sent " << (2 * roundtrips * pairs)
+       << " messages in " << elapsed << " (" << throughput
+       << " messages / sec)" << endl;
+
+  foreach (const Owned<PingPongProcess>& process, processes) {
+    terminate(process.get());
+    wait(process.get());
+  }
+}
+
+
+// Measures creating and then canceling a large number of timers, as
+// is done for offer timeouts by a master with many outstanding offers.
+TEST(Process, Process_BENCHMARK_Timers)
+{
+  // Unlike the other benchmarks we don't spawn any processes, so
+  // make sure libprocess (and the event loop) has been initialized.
+  process::initialize();
+
+  const size_t timerCount = 1000000;
+
+  vector<Timer> timers;
+  timers.reserve(timerCount);
+
+  Stopwatch watch;
+  watch.start();
+
+  // Spread the timeouts across several levels of the timing wheel.
+  for (size_t i = 0; i < timerCount; i++) {
+    timers.push_back(Clock::timer(
+        Minutes(5) + Milliseconds(i % 100000), []() {}));
+  }
+
+  cout << "Created " << timerCount << " timers in " << watch.elapsed() << endl;
+
+  watch.start(); // Reset.
+
+  foreach (const Timer& timer, timers) {
+    EXPECT_TRUE(Clock::cancel(timer));
+  }
+
+  cout << "Canceled " << timerCount << " timers in " << watch.elapsed()
+       << endl;
+}
+
+
+class Socket_BENCHMARK_Test : public ::testing::Test,
+                              public WithParamInterface<size_t> {};
+
+
+// The I/O scalability benchmark is parameterized by the number of I/O
+// threads, i.e., by the number of event loops that the connections
+// are spread across.
+INSTANTIATE_TEST_CASE_P(
+    IOThreads,
+    Socket_BENCHMARK_Test,
+    ::testing::Values(1U, 2U, 4U, 8U));
+
+
+// Measures how connection establishment and data transfer scale with
+// the number of I/O threads. Since libprocess starts its event loops
+// when it is initialized, each thread count gets its own subprocess.
+TEST_P(Socket_BENCHMARK_Test, IOScalability)
+{
+  run("Socket.DISABLED_Socket_BENCHMARK_Transfer",
+      {{"LIBPROCESS_NUM_IO_THREADS", stringify(GetParam())}});
+}
+
+
+// Receives from the socket until 'remaining' bytes have been received.
+static Future<Nothing> receive(
+    Socket socket,
+    const std::shared_ptr<char>& data,
+    size_t size,
+    size_t remaining)
+{
+  if (remaining == 0) {
+    return Nothing();
+  }
+
+  return socket.recv(data.get(), size)
+    .then([=](size_t length) -> Future<Nothing> {
+      if (length == 0) {
+        return Failure("Socket closed with " + stringify(remaining) +
+                       " bytes remaining");
+      }
+      return receive(socket, data, size, remaining - length);
+    });
+}
+
+
+// Measures how quickly connections can be established and how much
+// data can be pushed through them, which stresses the event loop(s)
+// rather than the worker threads. Run by IOScalability for each
+// number of I/O threads.
+TEST(Socket, DISABLED_Socket_BENCHMARK_Transfer)
+{
+  const size_t connections = 256;
+  const Bytes total = Megabytes(256);
+  const size_t bytes = total.bytes() / connections;
+
+  Try<Socket> create = Socket::create();
+  ASSERT_SOME(create);
+
+  Socket server = create.get();
+
+  Try<Address> address = server.bind(Address::LOCALHOST_ANY());
+  ASSERT_SOME(address);
+
+  ASSERT_SOME(server.listen(connections));
+
+  vector<Socket> clients;
+  vector<Socket> accepted;
+
+  Stopwatch watch;
+  watch.start();
+
+  list<Future<Nothing>> connects;
+  for (size_t i = 0; i < connections; i++) {
+    create = Socket::create();
+    ASSERT_SOME(create);
+
+    Socket client = create.get();
+    clients.push_back(client);
+    connects.push_back(client.connect(address.get()));
+  }
+
+  // NOTE: We accept the connections one at a time since concurrent
+  // accepts on the same socket race with each other.
+  for (size_t i = 0; i < connections; i++) {
+    Future<Socket> socket = server.accept();
+    AWAIT_READY(socket);
+    accepted.push_back(socket.get());
+  }
+
+  AWAIT_READY(collect(connects));
+
+  Duration elapsed = watch.elapsed();
+
+  const string threads =
+    os::getenv("LIBPROCESS_NUM_IO_THREADS").get("default");
+
+  cout << threads << " I/O threads established " << connections
+       << " connections in " << elapsed
+       << " (" << connections / elapsed.secs() << " connections / sec)"
+       << endl;
+
+  const string payload(bytes, 'x');
+
+  watch.start(); // Reset.
+
+  list<Future<Nothing>> futures;
+  for (size_t i = 0; i < connections; i++) {
+    const size_t size = 64 * 1024;
+    std::shared_ptr<char> data(new char[size], std::default_delete<char[]>());
+    futures.push_back(receive(accepted[i], data, size, bytes));
+    futures.push_back(clients[i].send(payload));
+  }
+
+  AWAIT_READY_FOR(collect(futures), Minutes(5));
+
+  elapsed = watch.elapsed();
+
+  cout << threads << " I/O threads transferred "
+       << Bytes(bytes * connections) << " over "
+       << connections << " connections in " << elapsed << " ("
+       << (bytes * connections / elapsed.secs()) / Megabytes(1).bytes()
+       << " MB / sec)" << endl;
+}
@@ -4,10 +4,14 @@
 #include <string>
 #include <vector>
 
+#include <process/future.hpp>
+#include <process/gtest.hpp>
 #include <process/http.hpp>
+#include <process/message.hpp>
 #include <process/socket.hpp>
 
 #include <stout/gtest.hpp>
+#include <stout/stringify.hpp>
 
 #include "encoder.hpp"
 #include "decoder.hpp"
@@ -15,6 +19,8 @@
 using namespace process;
 using namespace process::http;
 
+using process::network::Socket;
+
 using std::deque;
 using std::string;
 using std::vector;
@@ -47,6 +53,118 @@ TEST(Encoder, Response)
 }
 
 
+// Concatenates the data described by the specified I/O vectors.
+static string join(const struct iovec* iov, int count)
+{
+  string result;
+  for (int i = 0; i < count; i++) {
+    result.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+  }
+  return result;
+}
+
+
+// Tests that the I/O vectors of a MessageEncoder describe the same
+// data as MessageEncoder::encode, including after partial sends that
+// end in the middle of a segment or on the boundary between segments.
+TEST(Encoder, Message)
+{
+  Try<Socket> socket = Socket::create();
+  ASSERT_SOME(socket);
+
+  Message* message = new Message();
+  message->name = "name";
+  message->from = UPID("from@127.0.0.1:5050");
+  message->to = UPID("to@127.0.0.1:5051");
+  message->body = string(4096, 'x');
+
+  const string encoded = MessageEncoder::encode(message);
+
+  // The encoder takes ownership of the message.
+  MessageEncoder encoder(socket.get(), message);
+
+  int count;
+  size_t size;
+  const struct iovec* iov = encoder.next(&count, &size);
+
+  EXPECT_EQ(3, count);
+  EXPECT_EQ(encoded.size(), size);
+  EXPECT_EQ(encoded, join(iov, count));
+  EXPECT_EQ(0u, encoder.remaining());
+
+  // Only the first 10 bytes were sent.
+  encoder.backup(size - 10);
+  EXPECT_EQ(encoded.size() - 10, encoder.remaining());
+
+  iov = encoder.next(&count, &size);
+
+  EXPECT_EQ(3, count);
+  EXPECT_EQ(encoded.size() - 10, size);
+  EXPECT_EQ(encoded.substr(10), join(iov, count));
+
+  // Now everything but the trailer was sent.
+  const size_t trailer = strlen(MESSAGE_BODY_TRAILER);
+  encoder.backup(trailer);
+
+  iov = encoder.next(&count, &size);
+
+  EXPECT_EQ(1, count);
+  EXPECT_EQ(MESSAGE_BODY_TRAILER, join(iov, count));
+  EXPECT_EQ(0u, encoder.remaining());
+}
+
+
+// Tests that a BatchEncoder sends the data of its encoders in order
+// and is only considered flushed once all of the data was sent.
+TEST(Encoder, Batch)
+{
+  Try<Socket> socket = Socket::create();
+  ASSERT_SOME(socket);
+
+  string expected;
+
+  BatchEncoder* batch = new BatchEncoder(socket.get());
+
+  for (int i = 0; i < 3; i++) {
+    Message* message = new Message();
+    message->name = "name" + stringify(i);
+    message->from = UPID("from@127.0.0.1:5050");
+    message->to = UPID("to@127.0.0.1:5051");
+    message->body = string(100 * (i + 1), 'x');
+
+    expected += MessageEncoder::encode(message);
+
+    batch->add(new MessageEncoder(socket.get(), message));
+  }
+
+  EXPECT_EQ(3u, batch->size());
+  EXPECT_EQ(expected.size(), batch->remaining());
+
+  Future<Nothing> flushed = batch->flushed();
+
+  int count;
+  size_t size;
+  const struct iovec* iov = batch->next(&count, &size);
+
+  EXPECT_EQ(9, count);
+  EXPECT_EQ(expected, join(iov, count));
+
+  delete batch;
+
+  AWAIT_READY(flushed);
+
+  // A batch that wasn't sent in its entirety isn't flushed.
+  batch = new BatchEncoder(socket.get());
+  batch->add(new DataEncoder(socket.get(), "data"));
+
+  flushed = batch->flushed();
+
+  delete batch;
+
+  EXPECT_TRUE(flushed.isPending());
+}
+
+
 TEST(Encoder, AcceptableEncodings)
 {
   // Create requests that do not accept gzip encoding.
@@ -5,6 +5,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#include <mutex>
 #include <string>
 #include <sstream>
 #include <tuple>
@@ -22,12 +23,14 @@
 #include <process/gc.hpp>
 #include <process/gmock.hpp>
 #include <process/gtest.hpp>
+#include <process/latch.hpp>
 #include <process/network.hpp>
 #include <process/owned.hpp>
 #include <process/process.hpp>
 #include <process/run.hpp>
 #include <process/socket.hpp>
 #include <process/time.hpp>
+#include <process/timer.hpp>
 
 #include <stout/duration.hpp>
 #include <stout/gtest.hpp>
@@ -38,6 +41,7 @@
 #include <stout/os.hpp>
 #include <stout/stringify.hpp>
 #include <stout/stopwatch.hpp>
+#include <stout/synchronized.hpp>
 #include <stout/try.hpp>
 
 #include "encoder.hpp"
@@ -979,6 +983,125 @@ TEST(Process, Delay)
 }
 
 
+// Tests that timers with timeouts spanning many orders of magnitude
+// fire in order and only once their timeout has elapsed, and that
+// canceled timers never fire.
+TEST(Process, Timers)
+{
+  Clock::pause();
+
+  std::mutex mutex;
+  vector<size_t> fired;
+
+  const Duration durations[] = {
+    Days(3),
+    Milliseconds(1),
+    Microseconds(1500),
+    Seconds(70),
+    Hours(2),
+    Milliseconds(65),
+    Seconds(70)
+  };
+
+  vector<Timer> timers;
+  for (size_t i = 0; i < sizeof(durations) / sizeof(durations[0]); i++) {
+    timers.push_back(Clock::timer(durations[i], [&mutex, &fired, i]() {
+      synchronized (mutex) {
+        fired.push_back(i);
+      }
+    }));
+  }
+
+  EXPECT_TRUE(Clock::cancel(timers[6]));
+  EXPECT_FALSE(Clock::cancel(timers[6]));
+
+  Clock::advance(Milliseconds(1));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ(vector<size_t>({1}), fired);
+  }
+
+  Clock::advance(Microseconds(499));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ(vector<size_t>({1}), fired);
+  }
+
+  Clock::advance(Microseconds(1));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ(vector<size_t>({1, 2}), fired);
+  }
+
+  Clock::advance(Seconds(70));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ(vector<size_t>({1, 2, 5, 3}), fired);
+  }
+
+  Clock::advance(Days(3));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ(vector<size_t>({1, 2, 5, 3, 4, 0}), fired);
+  }
+
+  EXPECT_FALSE(Clock::cancel(timers[0]));
+
+  Clock::resume();
+}
+
+
+class BlockingProcess : public Process<BlockingProcess>
+{
+public:
+  explicit BlockingProcess(Latch* _latch) : latch(_latch) {}
+
+  void block() { latch->await(); }
+
+  Nothing ping() { return Nothing(); }
+
+private:
+  Latch* latch;
+};
+
+
+// Tests that processes still get run when all of the worker threads
+// are blocked, since additional workers get started to compensate.
+TEST(Process, BlockedWorkers)
+{
+  // Block more processes than there are worker threads to start with
+  // so that every worker gets blocked.
+  const size_t blocked = 2 * std::max(8L, sysconf(_SC_NPROCESSORS_ONLN));
+
+  Latch latch;
+
+  vector<BlockingProcess*> processes;
+  for (size_t i = 0; i < blocked + 1; i++) {
+    processes.push_back(new BlockingProcess(&latch));
+    spawn(processes.back());
+  }
+
+  for (size_t i = 0; i < blocked; i++) {
+    dispatch(processes[i], &BlockingProcess::block);
+  }
+
+  AWAIT_READY(dispatch(processes[blocked], &BlockingProcess::ping));
+
+  latch.trigger();
+
+  foreach (BlockingProcess* process, processes) {
+    terminate(process);
+    wait(process);
+    delete process;
+  }
+}
+
+
 class OrderProcess : public Process<OrderProcess>
 {
 public:
@@ -0,0 +1,177 @@
+#include <gmock/gmock.h>
+
+#include <string>
+
+#include <process/future.hpp>
+#include <process/gmock.hpp>
+#include <process/gtest.hpp>
+#include <process/process.hpp>
+#include <process/protobuf.hpp>
+
+#include <stout/nothing.hpp>
+
+// Generated from stout's protobuf_tests.proto (checked in).
+#include "protobuf_tests.pb.h"
+
+using namespace process;
+
+using std::string;
+
+using testing::_;
+using testing::DoAll;
+using testing::Invoke;
+
+
+class MessageProcess : public ProtobufProcess<MessageProcess>
+{
+public:
+  MessageProcess()
+  {
+    install<tests::Message>(&MessageProcess::handle);
+  }
+
+  MOCK_METHOD2(handle, void(const UPID&, const tests::Message&));
+};
+
+
+// Returns a message with only the required fields set.
+static tests::Message initialized()
+{
+  tests::Message message;
+  message.set_b(true);
+  message.set_str("string");
+  message.set_bytes("bytes");
+  message.set_f(1.0);
+  message.set_d(1.0);
+  message.set_e(tests::ONE);
+  message.mutable_nested();
+  return message;
+}
+
+
+// Sends 'message' to 'pid' even if it is not initialized.
+static void deliver(const UPID& pid, const tests::Message& message)
+{
+  string data;
+  message.SerializePartialToString(&data);
+  post(pid, message.GetTypeName(), data.data(), data.size());
+}
+
+
+// Tests that a handler's message gets reused without leaking fields
+// from one message into the next.
+TEST(ProtobufProcess, Reuse)
+{
+  MessageProcess process;
+  PID<MessageProcess> pid = spawn(process);
+
+  tests::Message first = initialized();
+  first.set_int32(42);
+  first.add_repeated_string("a");
+  first.add_repeated_string("b");
+  first.add_repeated_string("c");
+  first.add_repeated_int32(1);
+  first.mutable_nested()->set_str("nested");
+
+  tests::Message second = initialized();
+  second.add_repeated_string("d");
+
+  Future<tests::Message> received1;
+  Future<tests::Message> received2;
+  EXPECT_CALL(process, handle(_, _))
+    .WillOnce(FutureArg<1>(&received1))
+    .WillOnce(FutureArg<1>(&received2));
+
+  deliver(pid, first);
+  deliver(pid, second);
+
+  AWAIT_READY(received1);
+  EXPECT_EQ(first.SerializeAsString(), received1.get().SerializeAsString());
+
+  AWAIT_READY(received2);
+  EXPECT_EQ(second.SerializeAsString(), received2.get().SerializeAsString());
+  EXPECT_FALSE(received2.get().has_int32());
+  ASSERT_EQ(1, received2.get().repeated_string_size());
+  EXPECT_EQ("d", received2.get().repeated_string(0));
+  EXPECT_EQ(0, received2.get().repeated_int32_size());
+  EXPECT_FALSE(received2.get().nested().has_str());
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Tests that the memory held for a large message is released rather
+// than kept around for the next message.
+TEST(ProtobufProcess, ReuseAfterLargeMessage)
+{
+  MessageProcess process;
+  PID<MessageProcess> pid = spawn(process);
+
+  // Larger than the 64KB that handlers keep around for reuse.
+  tests::Message large = initialized();
+  large.set_bytes(string(128 * 1024, 'x'));
+
+  tests::Message small = initialized();
+
+  // The message passed to the handler is the one that gets reused,
+  // so look at the space it uses before it gets copied.
+  int space = 0;
+
+  Future<tests::Message> received;
+  Future<Nothing> handled;
+  EXPECT_CALL(process, handle(_, _))
+    .WillOnce(FutureArg<1>(&received))
+    .WillOnce(DoAll(
+        Invoke([&space](const UPID&, const tests::Message& message) {
+          space = message.SpaceUsed();
+        }),
+        FutureSatisfy(&handled)));
+
+  deliver(pid, large);
+  deliver(pid, small);
+
+  AWAIT_READY(received);
+  EXPECT_EQ(large.bytes(), received.get().bytes());
+
+  AWAIT_READY(handled);
+  EXPECT_GT(64 * 1024, space);
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Tests that malformed and uninitialized messages are dropped
+// without invoking the handler or affecting the next message.
+TEST(ProtobufProcess, DropInvalidMessages)
+{
+  MessageProcess process;
+  PID<MessageProcess> pid = spawn(process);
+
+  // Missing all of the required fields.
+  tests::Message uninitialized;
+  uninitialized.set_int32(42);
+  uninitialized.add_repeated_string("a");
+
+  Future<tests::Message> received;
+  EXPECT_CALL(process, handle(_, _))
+    .WillOnce(FutureArg<1>(&received));
+
+  deliver(pid, uninitialized);
+
+  // Not a valid encoding of any message.
+  const string malformed = "\xff\xff\xff";
+  post(pid, tests::Message().GetTypeName(), malformed.data(), malformed.size());
+
+  // Messages are handled in order, so the handler would have been
+  // invoked for the ones above before this one.
+  deliver(pid, initialized());
+
+  AWAIT_READY(received);
+  EXPECT_FALSE(received.get().has_int32());
+  EXPECT_EQ(0, received.get().repeated_string_size());
+
+  terminate(process);
+  wait(process);
+}
@@ -0,0 +1,289 @@
+#ifndef __TIMER_WHEEL_HPP__
+#define __TIMER_WHEEL_HPP__
+
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+#include <process/time.hpp>
+#include <process/timer.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/none.hpp>
+#include <stout/option.hpp>
+
+namespace process {
+
+// A hierarchical timing wheel (see "Hashed and Hierarchical Timing
+// Wheels" by Varghese and Lauck) that stores timers with O(1)
+// insertion and cancellation and expires them in batches.
+//
+// Time is divided into 'ticks' of RESOLUTION. The wheel has LEVELS
+// levels of SLOTS slots each, where a slot at level 'k' spans
+// SLOTS^k ticks. A timer is stored at the level of the most
+// significant group of bits in which its tick differs from the
+// wheel's 'cursor' (the last tick that was advanced to), which
+// guarantees that all of the timers in a slot at level 'k' expire
+// before any timer in a later slot at the same level. When the
+// cursor reaches the beginning of a slot the timers in that slot are
+// redistributed ("cascaded") to the lower levels. Each level keeps a
+// bitmap of its non-empty slots so that arbitrarily large jumps in
+// time (e.g., when advancing a paused clock) only visit non-empty
+// slots.
+//
+// Timers whose tick has been reached but whose timeout has not (since
+// a tick is coarser than a Time) are kept on a separate 'due' list
+// and compared against the exact time.
+//
+// NOTE: This is not thread-safe and requires external
+// synchronization.
+class TimerWheel
+{
+public:
+  TimerWheel() : cursor(0)
+  {
+    for (int level = 0; level < LEVELS; level++) {
+      occupied[level] = 0;
+    }
+  }
+
+  bool empty() const { return locations.empty(); }
+
+  size_t size() const { return locations.size(); }
+
+  void add(const Timer& timer)
+  {
+    CHECK_EQ(0u, locations.count(timer.id)) << "Timer already added";
+
+    std::list<Timer> timers;
+    timers.push_back(timer);
+    place(&timers, timers.begin());
+  }
+
+  // Returns true if the timer was pending (and hence was removed).
+  bool remove(const Timer& timer)
+  {
+    auto iterator = locations.find(timer.id);
+    if (iterator == locations.end()) {
+      return false;
+    }
+
+    const Location& location = iterator->second;
+
+    location.slot->erase(location.timer);
+
+    if (location.slot != &due && location.slot->empty()) {
+      occupied[location.level] &= ~(1ULL << location.index);
+    }
+
+    locations.erase(iterator);
+
+    return true;
+  }
+
+  // Returns a lower bound on the timeout of the earliest pending
+  // timer, or none if there aren't any timers. The bound is exact if
+  // the earliest timer is due or at the lowest level of the wheel,
+  // otherwise it's the beginning of the slot of the timer (which is
+  // when the timer gets cascaded).
+  Option<Time> next() const
+  {
+    Option<Time> result = None();
+
+    foreach (const Timer& timer, due) {
+      if (result.isNone() || timer.timeout().time() < result.get()) {
+        result = timer.timeout().time();
+      }
+    }
+
+    Option<Slot> slot = nextSlot();
+    if (slot.isSome()) {
+      Time time = Time::epoch() + Nanoseconds(slot.get().tick * RESOLUTION);
+      if (result.isNone() || time < result.get()) {
+        result = time;
+      }
+    }
+
+    return result;
+  }
+
+  // Removes and returns all of the timers that have a timeout at or
+  // before 'now', ordered by their timeouts (timers with equal
+  // timeouts are returned in the order they were added).
+  std::list<Timer> advance(const Time& now)
+  {
+    const uint64_t target = ticks(now);
+
+    // Cascade slots in the order that they begin, until the next
+    // non-empty slot begins after the target tick. Note that all of
+    // the slots below the level of the earliest slot are empty, so
+    // jumping the cursor to the beginning of that slot never skips
+    // over any timers.
+    Option<Slot> next = nextSlot();
+    while (next.isSome() && next.get().tick <= target) {
+      const Slot& slot = next.get();
+
+      cursor = slot.tick;
+
+      std::list<Timer>& timers = slots[slot.level][slot.index];
+      occupied[slot.level] &= ~(1ULL << slot.index);
+
+      while (!timers.empty()) {
+        place(&timers, timers.begin());
+      }
+
+      next = nextSlot();
+    }
+
+    if (target > cursor) {
+      cursor = target;
+    }
+
+    std::list<Timer> expired;
+
+    std::list<Timer>::iterator iterator = due.begin();
+    while (iterator != due.end()) {
+      if (iterator->timeout().time() <= now) {
+        locations.erase(iterator->id);
+        expired.splice(expired.end(), due, iterator++);
+      } else {
+        ++iterator;
+      }
+    }
+
+    expired.sort(
+        [](const Timer& left, const Timer& right) {
+          return left.timeout().time() < right.timeout().time();
+        });
+
+    return expired;
+  }
+
+private:
+  // The number of slots at each level must be no more than the
+  // number of bits in the 'occupied' bitmaps.
+  static const int BITS = 6;
+  static const int SLOTS = 1 << BITS;
+  static const int LEVELS = (64 + BITS - 1) / BITS;
+
+  // The duration of a tick, in nanoseconds.
+  static const int64_t RESOLUTION = 1000000;
+
+  struct Slot
+  {
+    int level;
+    int index;
+    uint64_t tick; // The tick at which this slot begins.
+  };
+
+  struct Location
+  {
+    std::list<Timer>* slot;
+    std::list<Timer>::iterator timer;
+    int level;
+    int index;
+  };
+
+  static uint64_t ticks(const Time& time)
+  {
+    const int64_t nanos = time.duration().ns();
+    return nanos > 0 ? static_cast<uint64_t>(nanos / RESOLUTION) : 0;
+  }
+
+  // Returns the level to store a tick at, relative to the cursor.
+  int levelOf(uint64_t tick) const
+  {
+    const uint64_t difference = tick ^ cursor;
+    if (difference == 0) {
+      return 0;
+    }
+    return (63 - __builtin_clzll(difference)) / BITS;
+  }
+
+  static int indexOf(uint64_t tick, int level)
+  {
+    return (tick >> (level * BITS)) & (SLOTS - 1);
+  }
+
+  // Moves the timer from 'from' to the slot (or the due list) that
+  // it belongs in relative to the current cursor.
+  void place(std::list<Timer>* from, std::list<Timer>::iterator timer)
+  {
+    const uint64_t tick = ticks(timer->timeout().time());
+
+    Location location;
+
+    if (tick <= cursor) {
+      location.slot = &due;
+      location.level = -1;
+      location.index = -1;
+    } else {
+      location.level = levelOf(tick);
+      location.index = indexOf(tick, location.level);
+      location.slot = &slots[location.level][location.index];
+      occupied[location.level] |= 1ULL << location.index;
+    }
+
+    // NOTE: Splicing does not invalidate the iterator.
+    location.slot->splice(location.slot->end(), *from, timer);
+    location.timer = timer;
+
+    locations[timer->id] = location;
+  }
+
+  // Returns the earliest non-empty slot.
+  Option<Slot> nextSlot() const
+  {
+    for (int level = 0; level < LEVELS; level++) {
+      // Only slots after the cursor's slot at each level can be
+      // occupied (see 'place').
+      const int index = indexOf(cursor, level);
+      const uint64_t later =
+        index == SLOTS - 1 ? 0 : occupied[level] & (~0ULL << (index + 1));
+
+      if (later != 0) {
+        const int next = __builtin_ctzll(later);
+
+        // The beginning of the slot shares all of the cursor's bits
+        // above this level.
+        const int shift = (level + 1) * BITS;
+        const uint64_t prefix =
+          shift >= 64 ? 0 : (cursor >> shift) << shift;
+
+        // NOTE: The first non-empty slot at the lowest non-empty
+        // level always begins before any slot at a higher level.
+        Slot slot;
+        slot.level = level;
+        slot.index = next;
+        slot.tick = prefix | (static_cast<uint64_t>(next) << (level * BITS));
+        return slot;
+      }
+    }
+
+    return None();
+  }
+
+  // The last tick that the wheel was advanced to.
+  uint64_t cursor;
+
+  std::list<Timer> slots[LEVELS][SLOTS];
+  uint64_t occupied[LEVELS];
+
+  // Timers whose tick has been reached but not their timeout.
+  std::list<Timer> due;
+
+  // Where each timer is stored, for O(1) removal.
+  //
+  // NOTE: We use std::unordered_map rather than stout's hashmap here
+  // because the Boost implementation it's built on is several times
+  // slower at inserting, which dominates the cost of adding a timer.
+  std::unordered_map<uint64_t, Location> locations;
+};
+
+} // namespace process {
+
+#endif // __TIMER_WHEEL_HPP__
@@ -317,6 +317,12 @@ private:
   // ensure this is warranted.
   bool _contains(const Resource& that) const;
 
+  // Similar to 'operator += (const Resource&)' and 'operator -=
+  // (const Resource&)' but skip the validity and emptiness checks of
+  // 'that', which can be assumed when it is inside a Resources.
+  void _add(const Resource& that);
+  void _subtract(const Resource& that);
+
   // Similar to the public 'find', but only for a single Resource
   // object. The target resource may span multiple roles, so this
   // returns Resources.
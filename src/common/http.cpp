@@ -24,6 +24,8 @@
 
 #include <mesos/resources.hpp>
 
+#include <process/http.hpp>
+
 #include <stout/foreach.hpp>
 #include <stout/protobuf.hpp>
 #include <stout/stringify.hpp>
@@ -33,6 +35,10 @@
 
 #include "messages/messages.hpp"
 
+using process::http::OK;
+using process::http::Pipe;
+using process::http::Response;
+
 using std::map;
 using std::set;
 using std::string;
@@ -278,5 +284,42 @@ JSON::Object model(
 }
 
 
+Response streamJSON(
+    const lambda::function<void(JSON::Writer*)>& write,
+    const Option<string>& jsonp)
+{
+  Pipe pipe;
+  Pipe::Writer body = pipe.writer();
+
+  OK response;
+  response.type = Response::PIPE;
+  response.reader = pipe.reader();
+
+  if (jsonp.isSome()) {
+    response.headers["Content-Type"] = "text/javascript";
+    body.write(jsonp.get() + "(");
+  } else {
+    response.headers["Content-Type"] = "application/json";
+  }
+
+  // NOTE: If the client goes away the writes fail, which we ignore.
+  JSON::Writer writer([body](const string& chunk) mutable {
+    body.write(chunk);
+  });
+
+  write(&writer);
+
+  writer.flush();
+
+  if (jsonp.isSome()) {
+    body.write(");");
+  }
+
+  body.close();
+
+  return response;
+}
+
+
 }  // namespace internal {
 }  // namespace mesos {
@@ -19,11 +19,16 @@
 #ifndef __COMMON_HTTP_HPP__
 #define __COMMON_HTTP_HPP__
 
+#include <string>
 #include <vector>
 
 #include <mesos/mesos.hpp>
 
+#include <process/http.hpp>
+
 #include <stout/json.hpp>
+#include <stout/lambda.hpp>
+#include <stout/option.hpp>
 
 namespace mesos {
 
@@ -49,6 +54,21 @@ JSON::Object model(
     const TaskState& state,
     const std::vector<TaskStatus>& statuses);
 
+
+// Returns an OK response whose JSON body is generated by 'write'
+// using a JSON::Writer, for endpoints whose output is large enough
+// that building it as a JSON::Value first would be expensive (e.g.,
+// '/state.json'). The output is written into the response's pipe in
+// chunks (sent with a "chunked" 'Transfer-Encoding'). An optional
+// 'jsonp' callback is handled the same way as by 'process::http::OK'.
+//
+// NOTE: 'write' runs to completion before this returns and the pipe
+// is unbounded, so the entire output is still held in memory at once.
+// This only avoids building (and then stringifying) a JSON::Value.
+process::http::Response streamJSON(
+    const lambda::function<void(JSON::Writer*)>& write,
+    const Option<std::string>& jsonp = None());
+
 } // namespace internal {
 } // namespace mesos {
 
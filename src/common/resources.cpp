@@ -18,8 +18,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <glog/logging.h>
@@ -35,6 +37,7 @@
 
 using std::map;
 using std::ostream;
+using std::pair;
 using std::set;
 using std::string;
 using std::vector;
@@ -426,6 +429,9 @@ Option<Error> Resources::validate(const Resource& resource)
       return Error("Invalid ranges resource");
     }
 
+    vector<pair<uint64_t, uint64_t>> ranges;
+    ranges.reserve(resource.ranges().range_size());
+
     for (int i = 0; i < resource.ranges().range_size(); i++) {
       const Value::Range& range = resource.ranges().range(i);
 
@@ -434,12 +440,17 @@ Option<Error> Resources::validate(const Resource& resource)
         return Error("Invalid ranges resource: begin > end");
       }
 
-      // Ensure ranges don't overlap (but not necessarily coalesced).
-      for (int j = i + 1; j < resource.ranges().range_size(); j++) {
-        if (range.begin() <= resource.ranges().range(j).begin() &&
-            resource.ranges().range(j).begin() <= range.end()) {
-          return Error("Invalid ranges resource: overlapping ranges");
-        }
+      ranges.push_back(std::make_pair(range.begin(), range.end()));
+    }
+
+    // Ensure ranges don't overlap (but not necessarily coalesced).
+    // Sorting first keeps this O(n log n) for heavily fragmented
+    // port ranges, where a pairwise check is quadratic.
+    std::sort(ranges.begin(), ranges.end());
+
+    for (size_t i = 1; i < ranges.size(); i++) {
+      if (ranges[i].first <= ranges[i - 1].second) {
+        return Error("Invalid ranges resource: overlapping ranges");
       }
     }
   } else if (resource.type() == Value::SET) {
@@ -588,7 +599,7 @@ bool Resources::contains(const Resources& that) const
       return false;
     }
 
-    remaining -= resource;
+    remaining._subtract(resource);
   }
 
   return true;
@@ -607,10 +618,14 @@ bool Resources::contains(const Resource& that) const
 Resources Resources::filter(
     const lambda::function<bool(const Resource&)>& predicate) const
 {
+  // NOTE: Whether two Resource objects are addable does not depend
+  // on their values, so none of the Resource objects that we include
+  // can be combined with another one and we can add them directly,
+  // without looking for one to combine them with.
   Resources result;
   foreach (const Resource& resource, resources) {
     if (predicate(resource)) {
-      result += resource;
+      result.resources.Add()->CopyFrom(resource);
     }
   }
   return result;
@@ -622,8 +637,10 @@ hashmap<string, Resources> Resources::reserved() const
   hashmap<string, Resources> result;
 
   foreach (const Resource& resource, resources) {
+    // NOTE: See the note in 'filter' on why we can add the Resource
+    // objects directly.
     if (isReserved(resource)) {
-      result[resource.role()] += resource;
+      result[resource.role()].resources.Add()->CopyFrom(resource);
     }
   }
 
@@ -1046,6 +1063,41 @@ bool Resources::_contains(const Resource& that) const
 }
 
 
+void Resources::_add(const Resource& that)
+{
+  foreach (Resource& resource, resources) {
+    if (addable(resource, that)) {
+      resource += that;
+      return;
+    }
+  }
+
+  // Cannot be combined with any existing Resource object.
+  resources.Add()->CopyFrom(that);
+}
+
+
+void Resources::_subtract(const Resource& that)
+{
+  for (int i = 0; i < resources.size(); i++) {
+    Resource* resource = resources.Mutable(i);
+
+    if (subtractable(*resource, that)) {
+      *resource -= that;
+
+      // Remove the resource if it becomes invalid or zero. We need
+      // to do the validation because we want to strip negative
+      // scalar Resource object.
+      if (validate(*resource).isSome() || isEmpty(*resource)) {
+        resources.DeleteSubrange(i, 1);
+      }
+
+      return;
+    }
+  }
+}
+
+
 /////////////////////////////////////////////////
 // Overloaded operators.
 /////////////////////////////////////////////////
@@ -1088,19 +1140,7 @@ Resources Resources::operator + (const Resources& that) const
 Resources& Resources::operator += (const Resource& that)
 {
   if (validate(that).isNone() && !isEmpty(that)) {
-    bool found = false;
-    foreach (Resource& resource, resources) {
-      if (addable(resource, that)) {
-        resource += that;
-        found = true;
-        break;
-      }
-    }
-
-    // Cannot be combined with any existing Resource object.
-    if (!found) {
-      resources.Add()->CopyFrom(that);
-    }
+    _add(that);
   }
 
   return *this;
@@ -1109,8 +1149,11 @@ Resources& Resources::operator += (const Resource& that)
 
 Resources& Resources::operator += (const Resources& that)
 {
+  // NOTE: We use _add because Resources only contain valid and
+  // non-empty Resource objects, and we don't want the performance
+  // hit of the validity check.
   foreach (const Resource& resource, that.resources) {
-    *this += resource;
+    _add(resource);
   }
 
   return *this;
@@ -1136,22 +1179,7 @@ Resources Resources::operator - (const Resources& that) const
 Resources& Resources::operator -= (const Resource& that)
 {
   if (validate(that).isNone() && !isEmpty(that)) {
-    for (int i = 0; i < resources.size(); i++) {
-      Resource* resource = resources.Mutable(i);
-
-      if (subtractable(*resource, that)) {
-        *resource -= that;
-
-        // Remove the resource if it becomes invalid or zero. We need
-        // to do the validation because we want to strip negative
-        // scalar Resource object.
-        if (validate(*resource).isSome() || isEmpty(*resource)) {
-          resources.DeleteSubrange(i, 1);
-        }
-
-        break;
-      }
-    }
+    _subtract(that);
   }
 
   return *this;
@@ -1160,8 +1188,10 @@ Resources& Resources::operator -= (const Resource& that)
 
 Resources& Resources::operator -= (const Resources& that)
 {
+  // NOTE: We use _subtract for the same reason that 'operator +='
+  // uses _add.
   foreach (const Resource& resource, that.resources) {
-    *this -= resource;
+    _subtract(resource);
   }
 
   return *this;
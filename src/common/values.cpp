@@ -30,10 +30,9 @@
 
 #include <stout/error.hpp>
 #include <stout/foreach.hpp>
+#include <stout/interval.hpp>
 #include <stout/strings.hpp>
 
-using std::max;
-using std::min;
 using std::ostream;
 using std::string;
 using std::vector;
@@ -179,115 +178,38 @@ Value::Scalar& operator -= (Value::Scalar& left, const Value::Scalar& right)
   return left;
 }
 
-namespace ranges {
-
-static void add(Value::Ranges* result, int64_t begin, int64_t end)
+// Converts the (possibly un-coalesced) 'ranges' into an interval set.
+// Each insertion is logarithmic in the number of intervals, so this
+// coalesces in O(n log n) rather than the quadratic cost of merging
+// one range at a time into a repeated field.
+static IntervalSet<uint64_t> convert(const Value::Ranges& ranges)
 {
-  if (begin > end) {
-    return;
-  }
-  Value::Range* range = result->add_range();
-  range->set_begin(begin);
-  range->set_end(end);
-}
-
-} // namespace ranges {
+  IntervalSet<uint64_t> set;
 
+  for (int i = 0; i < ranges.range_size(); i++) {
+    const Value::Range& range = ranges.range(i);
 
-// Coalesce the given 'range' into already coalesced 'ranges'.
-static void coalesce(Value::Ranges* ranges, const Value::Range& range)
-{
-  // Note that we assume that ranges has already been coalesced.
-
-  Value::Ranges result;
-  Value::Range temp = range;
-
-  for (int i = 0; i < ranges->range_size(); i++) {
-    const Value::Range& current = ranges->range(i);
-
-    // Check if current and range overlap. Note, we only need to
-    // compare with range and not with temp to check for overlap
-    // because we expect ranges to be coalesced to begin with!
-    if (current.begin() <= range.end() + 1 &&
-        current.end() >= range.begin() - 1) {
-      // current:   |   |
-      // range:       |   |
-      // range:   |   |
-      // Update temp with new boundaries.
-      temp.set_begin(min(temp.begin(), min(range.begin(), current.begin())));
-      temp.set_end(max(temp.end(), max(range.end(), current.end())));
-    } else { // No overlap.
-      result.add_range()->MergeFrom(current);
-    }
+    set += (Bound<uint64_t>::closed(range.begin()),
+            Bound<uint64_t>::closed(range.end()));
   }
 
-  result.add_range()->MergeFrom(temp);
-  *ranges = result;
+  return set;
 }
 
 
-// Coalesce the given un-coalesced 'uranges' into already coalesced 'ranges'.
-static void coalesce(Value::Ranges* ranges, const Value::Ranges& uranges)
+// Materializes the interval set back into coalesced, sorted ranges.
+static Value::Ranges convert(const IntervalSet<uint64_t>& set)
 {
-  // Note that we assume that ranges has already been coalesced.
+  Value::Ranges ranges;
+  ranges.mutable_range()->Reserve(set.intervalCount());
 
-  for (int i = 0; i < uranges.range_size(); i++) {
-    coalesce(ranges, uranges.range(i));
-  }
-}
-
-
-static void remove(Value::Ranges* ranges, const Value::Range& range)
-{
-  // Note that we assume that ranges has already been coalesced.
-
-  Value::Ranges result;
-
-  for (int i = 0; i < ranges->range_size(); i++) {
-    const Value::Range& current = ranges->range(i);
-
-    // Note that these if/else if conditionals are in a particular
-    // order. In particular, the last two assume that the "subsumes"
-    // checks have already occurred.
-    if (range.begin() <= current.begin() && range.end() >= current.end()) {
-      // Range subsumes current.
-      // current:  |     |
-      // range:  |         |
-      // range:  |       |
-      // range:    |       |
-      // range:    |     |
-    } else if (range.begin() >= current.begin() &&
-               range.end() <= current.end()) {
-      // Range is subsumed by current.
-      // current:  |     |
-      // range:      | |
-      // range:    |   |
-      // range:      |   |
-      ranges::add(&result, current.begin(), range.begin() - 1);
-      ranges::add(&result, range.end() + 1, current.end());
-    } else if (range.begin() <= current.begin() &&
-               range.end() >= current.begin()) {
-      // Range overlaps to the left.
-      // current:  |     |
-      // range:  |     |
-      // range:  | |
-      ranges::add(&result, range.end() + 1, current.end());
-    } else if (range.begin() <= current.end() && range.end() >= current.end()) {
-      // Range overlaps to the right.
-      // current:  |     |
-      // range:      |      |
-      // range:          |  |
-      ranges::add(&result, current.begin(), range.begin() - 1);
-    } else {
-      // Range doesn't overlap current.
-      // current:        |   |
-      // range:   |   |
-      // range:                |   |
-      ranges::add(&result, current.begin(), current.end());
-    }
+  foreach (const Interval<uint64_t>& interval, set) {
+    Value::Range* range = ranges.add_range();
+    range->set_begin(interval.lower());
+    range->set_end(interval.upper() - 1);
   }
 
-  *ranges = result;
+  return ranges;
 }
 
 
@@ -305,118 +227,48 @@ ostream& operator << (ostream& stream, const Value::Ranges& ranges)
 }
 
 
-bool operator == (const Value::Ranges& _left, const Value::Ranges& _right)
+bool operator == (const Value::Ranges& left, const Value::Ranges& right)
 {
-  Value::Ranges left;
-  coalesce(&left, _left);
-
-  Value::Ranges right;
-  coalesce(&right, _right);
-
-  if (left.range_size() == right.range_size()) {
-    for (int i = 0; i < left.range_size(); i++) {
-      // Make sure this range is equal to a range in the right.
-      bool found = false;
-      for (int j = 0; j < right.range_size(); j++) {
-        if (left.range(i).begin() == right.range(j).begin() &&
-            left.range(i).end() == right.range(j).end()) {
-          found = true;
-          break;
-        }
-      }
-
-      if (!found) {
-        return false;
-      }
-    }
-
-    return true;
-  }
-
-  return false;
+  return convert(left) == convert(right);
 }
 
 
-bool operator <= (const Value::Ranges& _left, const Value::Ranges& _right)
+bool operator <= (const Value::Ranges& left, const Value::Ranges& right)
 {
-  Value::Ranges left;
-  coalesce(&left, _left);
-
-  Value::Ranges right;
-  coalesce(&right, _right);
-
-  for (int i = 0; i < left.range_size(); i++) {
-    // Make sure this range is a subset of a range in right.
-    bool matched = false;
-    for (int j = 0; j < right.range_size(); j++) {
-      if (left.range(i).begin() >= right.range(j).begin() &&
-          left.range(i).end() <= right.range(j).end()) {
-        matched = true;
-        break;
-      }
-    }
-    if (!matched) {
-      return false;
-    }
-  }
-
-  return true;
+  return convert(right).contains(convert(left));
 }
 
 
 Value::Ranges operator + (const Value::Ranges& left, const Value::Ranges& right)
 {
-  Value::Ranges result;
-
-  coalesce(&result, left);
-  coalesce(&result, right);
-
-  return result;
+  IntervalSet<uint64_t> result = convert(left);
+  result += convert(right);
+  return convert(result);
 }
 
 
 Value::Ranges operator - (const Value::Ranges& left, const Value::Ranges& right)
 {
-  Value::Ranges result;
-
-  coalesce(&result, left);
-  coalesce(&result, right);
-
-  for (int i = 0; i < right.range_size(); i++) {
-    remove(&result, right.range(i));
-  }
-
-  return result;
+  IntervalSet<uint64_t> result = convert(left);
+  result -= convert(right);
+  return convert(result);
 }
 
 
 Value::Ranges& operator += (Value::Ranges& left, const Value::Ranges& right)
 {
-  Value::Ranges temp;
-
-  coalesce(&temp, left);
-
-  left = temp;
-
-  coalesce(&left, right);
-
+  IntervalSet<uint64_t> result = convert(left);
+  result += convert(right);
+  left = convert(result);
   return left;
 }
 
 
 Value::Ranges& operator -= (Value::Ranges& left, const Value::Ranges& right)
 {
-  Value::Ranges temp;
-
-  coalesce(&temp, left);
-  coalesce(&temp, right);
-
-  left = temp;
-
-  for (int i = 0; i < right.range_size(); i++) {
-    remove(&left, right.range(i));
-  }
-
+  IntervalSet<uint64_t> result = convert(left);
+  result -= convert(right);
+  left = convert(result);
   return left;
 }
 
@@ -18,15 +18,22 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <list>
+#include <memory>
+#include <set>
 
 #include <process/collect.hpp>
 #include <process/id.hpp>
 #include <process/process.hpp>
+#include <process/protobuf.hpp>
 #include <process/timer.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
+#include <stout/none.hpp>
 #include <stout/stringify.hpp>
+#include <stout/try.hpp>
 
 #include "log/catchup.hpp"
 #include "log/consensus.hpp"
@@ -167,11 +174,17 @@ static Future<uint64_t> catchup(
 }
 
 
-// TODO(jieyu): Our current implementation catches-up each position in
-// the set sequentially. In the future, we may want to parallelize it
-// to improve the performance. Also, we may want to implement rate
-// control here so that we don't saturate the network or disk.
-class BulkCatchUpProcess : public Process<BulkCatchUpProcess>
+// Catches-up the positions in an interval. Since a replica that has
+// been down for a while might be missing lots of positions, running a
+// full Paxos round for each of them is too slow. Instead, we read the
+// learned actions from the other replicas in large chunks and only
+// fall back to filling (i.e., 'log::catchup' above) the positions
+// that no replica we read from has learned, or all the positions of
+// a chunk that no replica returned in time. The next chunk is read
+// while the current one is being caught up (i.e., read-ahead).
+// TODO(jieyu): We may want to implement rate control here so that we
+// don't saturate the network or disk.
+class BulkCatchUpProcess : public ProtobufProcess<BulkCatchUpProcess>
 {
 public:
   BulkCatchUpProcess(
@@ -187,7 +200,8 @@ public:
       network(_network),
       positions(_positions),
       timeout(_timeout),
-      proposal(_proposal) {}
+      proposal(_proposal),
+      latest(0) {}
 
   virtual ~BulkCatchUpProcess() {}
 
@@ -200,28 +214,138 @@ protected:
     promise.future().onDiscard(lambda::bind(
         static_cast<void(*)(const UPID&, bool)>(terminate), self(), true));
 
-    // Catch-up sequentially.
     current = positions.lower();
+    end = current;
 
-    catchup();
+    if (current < positions.upper()) {
+      reading = read(current);
+    }
+
+    next();
   }
 
   virtual void finalize()
   {
+    discard(responses);
+    reading.discard();
+    checking.discard();
     catching.discard();
 
-    // TODO(benh): Discard our promise only after 'catching' has
-    // completed (ready, failed, or discarded).
+    // TODO(benh): Discard our promise only after 'reading',
+    // 'checking' and 'catching' have completed (ready, failed, or
+    // discarded).
     promise.discard();
   }
 
 private:
+  // The maximum number of positions to read with a single request.
+  static const uint64_t CHUNK_SIZE = 4096;
+
   static void timedout(Future<uint64_t> catching)
   {
     catching.discard();
   }
 
-  void catchup()
+  static Future<Option<ReadResponse> > _timedout(
+      Future<Option<ReadResponse> > future,
+      const Duration& timeout)
+  {
+    LOG(INFO) << "Unable to read from any replica in " << timeout;
+
+    future.discard();
+
+    return None();
+  }
+
+  // Returns the end of the chunk that starts at the given position.
+  uint64_t limit(uint64_t from) const
+  {
+    return std::min(positions.upper(), from + CHUNK_SIZE);
+  }
+
+  // Reads the learned actions of the chunk starting from the given
+  // position from the first replica (other than the local one) that
+  // responds with some of them. Returns none if no replica did.
+  // NOTE: This doesn't time out by itself, the timeout only starts
+  // once we actually wait for the chunk (see 'next').
+  Future<Option<ReadResponse> > read(uint64_t from)
+  {
+    ReadRequest request;
+    request.set_from(from);
+    request.set_to(limit(from) - 1);
+
+    latest = from;
+
+    std::set<UPID> filter;
+    filter.insert(replica->pid());
+
+    return network->broadcast(protocol::read, request, filter)
+      .then(defer(self(), &Self::broadcasted, request, lambda::_1));
+  }
+
+  Future<Option<ReadResponse> > broadcasted(
+      const ReadRequest& request,
+      const std::set<Future<ReadResponse> >& _responses)
+  {
+    // Only the latest read is outstanding (see '_next'), a previous
+    // one might have timed out just after the broadcast completed.
+    if (request.from() != latest) {
+      discard(_responses);
+      return None();
+    }
+
+    CHECK(responses.empty());
+
+    if (_responses.empty()) {
+      return None();
+    }
+
+    responses = _responses;
+    responded.reset(new process::Promise<Option<ReadResponse> >());
+
+    foreach (const Future<ReadResponse>& response, responses) {
+      response.onAny(defer(self(), &Self::received, request, lambda::_1));
+    }
+
+    return responded->future();
+  }
+
+  void received(
+      const ReadRequest& request,
+      const Future<ReadResponse>& response)
+  {
+    // Ignore the responses to a previous read.
+    if (responses.erase(response) == 0) {
+      return;
+    }
+
+    // Skip responses that are invalid or that don't get us any
+    // further (e.g., a replica whose log ends before the chunk), in
+    // the hope that another replica does better.
+    Try<Nothing> verified = response.isReady()
+      ? verify(request, response.get())
+      : Error(response.isFailed() ? response.failure() : "Discarded");
+
+    if (verified.isSome()) {
+      responded->set(Option<ReadResponse>(response.get()));
+
+      // We no longer care about the responses from other replicas.
+      discard(responses);
+      responses.clear();
+      return;
+    }
+
+    VLOG(2) << "Ignoring read response for positions from "
+            << request.from() << ": " << verified.error();
+
+    if (responses.empty()) {
+      // None of the replicas were able to respond.
+      responded->set(Option<ReadResponse>::none());
+    }
+  }
+
+  // Catches-up the next chunk once it has been read.
+  void next()
   {
     if (current >= positions.upper()) {
       // Stop the process if there is nothing left to catch-up. This
@@ -231,9 +355,135 @@ private:
       return;
     }
 
+    reading
+      .after(timeout, lambda::bind(&Self::_timedout, lambda::_1, timeout))
+      .onAny(defer(self(), &Self::_next, lambda::_1));
+  }
+
+  void _next(const Future<Option<ReadResponse> >& chunk)
+  {
+    // Stop waiting for the responses to this read (e.g., if it timed
+    // out) before reading the next chunk.
+    discard(responses);
+    responses.clear();
+
+    if (chunk.isReady() && chunk.get().isSome()) {
+      const ReadResponse& response = chunk.get().get();
+
+      end = response.end();
+
+      // Install the learned actions in the local replica. These are
+      // handled by the replica before the 'missing' check below.
+      foreach (const Action& action, response.actions()) {
+        LearnedMessage message;
+        message.mutable_action()->CopyFrom(action);
+        send(replica->pid(), message);
+      }
+    } else {
+      // Only this chunk gets filled, we still try reading the next
+      // one since it might have just been a slow replica.
+      end = limit(current);
+
+      LOG(INFO) << "Unable to read positions [" << current << ", " << end
+                << ") from any replica, falling back to filling them";
+    }
+
+    // Read-ahead the next chunk.
+    if (end < positions.upper()) {
+      reading = read(end);
+    }
+
+    check();
+  }
+
+  // Verifies that a read response makes progress and only contains
+  // learned actions for the positions that were asked for.
+  static Try<Nothing> verify(
+      const ReadRequest& request,
+      const ReadResponse& response)
+  {
+    if (response.end() <= request.from() ||
+        response.end() > request.to() + 1) {
+      return Error("Unexpected end " + stringify(response.end()));
+    }
+
+    Option<uint64_t> previous;
+
+    foreach (const Action& action, response.actions()) {
+      if (action.position() < request.from() ||
+          action.position() >= response.end() ||
+          (previous.isSome() && action.position() <= previous.get())) {
+        return Error("Unexpected position " + stringify(action.position()));
+      }
+
+      previous = action.position();
+
+      if (!action.has_learned() || !action.learned()) {
+        return Error(
+            "Unlearned action at position " + stringify(action.position()));
+      }
+
+      bool valid = false;
+      if (action.has_type()) {
+        switch (action.type()) {
+          case Action::NOP:
+            valid = action.has_nop();
+            break;
+          case Action::APPEND:
+            valid = action.has_append();
+            break;
+          case Action::TRUNCATE:
+            valid = action.has_truncate();
+            break;
+        }
+      }
+
+      if (!valid) {
+        return Error(
+            "Malformed action at position " + stringify(action.position()));
+      }
+    }
+
+    return Nothing();
+  }
+
+  // Gets the positions of the current chunk that are still missing.
+  void check()
+  {
+    checking = replica->missing(current, end - 1);
+    checking.onAny(defer(self(), &Self::checked));
+  }
+
+  void checked()
+  {
+    // The future 'checking' can only be discarded in 'finalize'.
+    CHECK(!checking.isDiscarded());
+
+    if (checking.isFailed()) {
+      promise.fail("Failed to get missing positions: " + checking.failure());
+      terminate(self());
+      return;
+    }
+
+    missing = checking.get();
+
+    catchup();
+  }
+
+  void catchup()
+  {
+    if (missing.empty()) {
+      // The current chunk has been caught-up.
+      current = end;
+      next();
+      return;
+    }
+
+    position = missing.begin()->lower();
+
     // Store the future so that we can discard it if the user wants to
     // cancel the catch-up operation.
-    catching = log::catchup(quorum, replica, network, proposal, current)
+    catching = log::catchup(quorum, replica, network, proposal, position)
       .onDiscarded(defer(self(), &Self::discarded))
       .onFailed(defer(self(), &Self::failed))
       .onReady(defer(self(), &Self::succeeded));
@@ -241,10 +491,9 @@ private:
     Clock::timer(timeout, lambda::bind(&Self::timedout, catching));
   }
 
-
   void discarded()
   {
-    LOG(INFO) << "Unable to catch-up position " << current
+    LOG(INFO) << "Unable to catch-up position " << position
               << " in " << timeout << ", retrying";
 
     catchup();
@@ -253,7 +502,7 @@ private:
   void failed()
   {
     promise.fail(
-        "Failed to catch-up position " + stringify(current) +
+        "Failed to catch-up position " + stringify(position) +
         ": " + catching.failure());
 
     terminate(self());
@@ -261,7 +510,7 @@ private:
 
   void succeeded()
   {
-    ++current;
+    missing -= position;
 
     // The single position catch-up function: 'log::catchup' will
     // return the highest proposal number seen so far. We use this
@@ -280,9 +529,24 @@ private:
   const Duration timeout;
 
   uint64_t proposal;
+
+  // The positions before 'current' have been caught-up. The current
+  // chunk is [current, end).
   uint64_t current;
+  uint64_t end;
+
+  // The positions of the current chunk that are left to fill.
+  IntervalSet<uint64_t> missing;
+  uint64_t position;
 
   process::Promise<Nothing> promise;
+
+  // The latest read (starting from 'latest') and the responses to it.
+  uint64_t latest;
+  Future<Option<ReadResponse> > reading;
+  std::set<Future<ReadResponse> > responses;
+  std::shared_ptr<process::Promise<Option<ReadResponse> > > responded;
+  Future<IntervalSet<uint64_t> > checking;
   Future<uint64_t> catching;
 };
 
@@ -19,14 +19,17 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <deque>
 
 #include <mesos/type_utils.hpp>
 
 #include <process/defer.hpp>
 #include <process/dispatch.hpp>
 #include <process/id.hpp>
+#include <process/owned.hpp>
 #include <process/process.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/none.hpp>
 
 #include "log/catchup.hpp"
@@ -37,6 +40,7 @@
 
 using namespace process;
 
+using std::deque;
 using std::string;
 
 namespace mesos {
@@ -49,11 +53,13 @@ public:
   CoordinatorProcess(
       size_t _quorum,
       const Shared<Replica>& _replica,
-      const Shared<Network>& _network)
+      const Shared<Network>& _network,
+      size_t _depth)
     : ProcessBase(ID::generate("log-coordinator")),
       quorum(_quorum),
       replica(_replica),
       network(_network),
+      depth(_depth),
       state(INITIAL),
       proposal(0),
       index(0) {}
@@ -70,7 +76,14 @@ protected:
   virtual void finalize()
   {
     electing.discard();
-    writing.discard();
+
+    foreach (const Owned<Write>& write, writes) {
+      if (write->writing.isSome()) {
+        write->writing.get().discard();
+      }
+
+      write->promise.discard();
+    }
   }
 
 private:
@@ -95,21 +108,25 @@ private:
   /////////////////////////////////
 
   Future<Option<uint64_t> > write(const Action& action);
+  void pipeline();
   Future<WriteResponse> runWritePhase(const Action& action);
   Future<Option<uint64_t> > checkWritePhase(
       const Action& action,
       const WriteResponse& response);
   Future<Nothing> runLearnPhase(const Action& action);
   Future<bool> checkLearnPhase(const Action& action);
-  Future<Option<uint64_t> > updateIndexAfterWritten(bool missing);
+  Future<Option<uint64_t> > checkLearned(const Action& action, bool missing);
   void writingFinished();
-  void writingFailed();
   void writingAborted();
+  void discarded(uint64_t position);
 
   const size_t quorum;
   const Shared<Replica> replica;
   const Shared<Network> network;
 
+  // The maximum number of writes in flight.
+  const size_t depth;
+
   // The current state of the coordinator. A coordinator needs to be
   // elected first to perform append and truncate operations. If one
   // tries to do an append or a truncate while the coordinator is not
@@ -128,11 +145,28 @@ private:
   // The current proposal number used by this coordinator.
   uint64_t proposal;
 
-  // The position to which the next entry will be written.
+  // The position to which the next entry will be written. While
+  // writing, this is past the positions of all of the pending writes.
   uint64_t index;
 
   Future<Option<uint64_t> > electing;
-  Future<Option<uint64_t> > writing;
+
+  struct Write
+  {
+    explicit Write(const Action& _action) : action(_action) {}
+
+    const Action action;
+
+    // The write and learn phases for the action, once started.
+    Option<Future<Option<uint64_t> > > writing;
+
+    // Set once the writes at all preceding positions have finished.
+    process::Promise<Option<uint64_t> > promise;
+  };
+
+  // The pending writes, in the order of their positions. The first
+  // (up to 'depth') writes are in flight, the rest are queued.
+  deque<Owned<Write> > writes;
 };
 
 
@@ -299,12 +333,10 @@ Future<Option<uint64_t> > CoordinatorProcess::append(const string& bytes)
 {
   if (state == INITIAL || state == ELECTING) {
     return None();
-  } else if (state == WRITING) {
-    return Failure("Coordinator is currently writing");
   }
 
   Action action;
-  action.set_position(index);
+  action.set_position(index++);
   action.set_promised(proposal);
   action.set_performed(proposal);
   action.set_type(Action::APPEND);
@@ -319,12 +351,10 @@ Future<Option<uint64_t> > CoordinatorProcess::truncate(uint64_t to)
 {
   if (state == INITIAL || state == ELECTING) {
     return None();
-  } else if (state == WRITING) {
-    return Failure("Coordinator is currently writing");
   }
 
   Action action;
-  action.set_position(index);
+  action.set_position(index++);
   action.set_promised(proposal);
   action.set_performed(proposal);
   action.set_type(Action::TRUNCATE);
@@ -340,18 +370,41 @@ Future<Option<uint64_t> > CoordinatorProcess::write(const Action& action)
   LOG(INFO) << "Coordinator attempting to write " << action.type()
             << " action at position " << action.position();
 
-  CHECK_EQ(state, ELECTED);
+  CHECK(state == ELECTED || state == WRITING);
   CHECK(action.has_performed() && action.has_type());
 
   state = WRITING;
 
-  writing = runWritePhase(action)
-    .then(defer(self(), &Self::checkWritePhase, action, lambda::_1))
-    .onReady(defer(self(), &Self::writingFinished))
-    .onFailed(defer(self(), &Self::writingFailed))
-    .onDiscarded(defer(self(), &Self::writingAborted));
+  Owned<Write> write(new Write(action));
+  writes.push_back(write);
+
+  write->promise.future()
+    .onDiscard(defer(self(), &Self::discarded, action.position()));
+
+  pipeline();
 
-  return writing;
+  return write->promise.future();
+}
+
+
+void CoordinatorProcess::pipeline()
+{
+  // Start the queued writes until there are 'depth' in flight. Each
+  // write is at its own position, so the writes are independent of
+  // each other and the replicas can persist them concurrently.
+  for (size_t i = 0; i < writes.size() && i < depth; i++) {
+    Owned<Write> write = writes[i];
+
+    if (write->writing.isSome()) {
+      continue;
+    }
+
+    write->writing = runWritePhase(write->action)
+      .then(defer(self(), &Self::checkWritePhase, write->action, lambda::_1));
+
+    write->writing.get()
+      .onAny(defer(self(), &Self::writingFinished));
+  }
 }
 
 
@@ -375,7 +428,7 @@ Future<Option<uint64_t> > CoordinatorProcess::checkWritePhase(
 
   return runLearnPhase(action)
     .then(defer(self(), &Self::checkLearnPhase, action))
-    .then(defer(self(), &Self::updateIndexAfterWritten, lambda::_1));
+    .then(defer(self(), &Self::checkLearned, action, lambda::_1));
 }
 
 
@@ -394,39 +447,110 @@ Future<bool> CoordinatorProcess::checkLearnPhase(const Action& action)
 }
 
 
-Future<Option<uint64_t> > CoordinatorProcess::updateIndexAfterWritten(
+Future<Option<uint64_t> > CoordinatorProcess::checkLearned(
+    const Action& action,
     bool missing)
 {
   CHECK(!missing) << "Not expecting local replica to be missing position "
-                  << index << " after the writing is done";
+                  << action.position() << " after the writing is done";
 
-  return index++;
+  return action.position();
 }
 
 
 void CoordinatorProcess::writingFinished()
 {
-  CHECK_EQ(state, WRITING);
-  state = ELECTED;
+  // Complete the writes in the order of their positions, so that a
+  // write is only reported once all of the positions preceding it
+  // have been written (and learned) too.
+  while (!writes.empty()) {
+    Owned<Write> write = writes.front();
+
+    if (write->writing.isNone() || write->writing.get().isPending()) {
+      break;
+    }
+
+    writes.pop_front();
+
+    const Future<Option<uint64_t> >& writing = write->writing.get();
+
+    if (writing.isReady() && writing.get().isSome()) {
+      write->promise.set(writing.get());
+      continue;
+    }
+
+    if (writing.isFailed()) {
+      write->promise.fail(writing.failure());
+    } else if (writing.isDiscarded()) {
+      write->promise.discard();
+    } else {
+      write->promise.set(writing.get());
+    }
+
+    writingAborted();
+    return;
+  }
+
+  if (writes.empty()) {
+    if (state == WRITING) {
+      state = ELECTED;
+    }
+  } else {
+    pipeline();
+  }
 }
 
 
-void CoordinatorProcess::writingFailed()
+void CoordinatorProcess::writingAborted()
 {
+  // Demote the coordinator if a write operation fails, is rejected
+  // by a replica or is discarded since we don't actually know whether
+  // the following writes were successful or not and we really need
+  // to "catch-up" those positions before we try and do another write
+  // (see MESOS-1038 for more details).
   CHECK_EQ(state, WRITING);
   state = INITIAL;
+
+  while (!writes.empty()) {
+    Owned<Write> write = writes.front();
+    writes.pop_front();
+
+    if (write->writing.isSome()) {
+      write->writing.get().discard();
+    }
+
+    if (write->promise.future().hasDiscard()) {
+      write->promise.discard();
+    } else {
+      write->promise.set(Option<uint64_t>::none());
+    }
+  }
 }
 
 
-void CoordinatorProcess::writingAborted()
+void CoordinatorProcess::discarded(uint64_t position)
 {
-  CHECK_EQ(state, WRITING);
-
-  // Demote the coordinator if a write operation is discarded since we
-  // don't actually know the write was successful or not and we really
-  // need to "catch-up" that position before we try and do another
-  // write (see MESOS-1038 for more details).
-  state = INITIAL;
+  foreach (const Owned<Write>& write, writes) {
+    if (write->action.position() != position ||
+        !write->promise.future().hasDiscard()) {
+      continue;
+    }
+
+    if (write->writing.isSome()) {
+      // This aborts the writes once all of the writes preceding this
+      // one have finished (see 'writingFinished').
+      write->writing.get().discard();
+    } else {
+      // A queued write is never started.
+      process::Promise<Option<uint64_t> > promise;
+      promise.discard();
+      write->writing = promise.future();
+
+      writingFinished();
+    }
+
+    return;
+  }
 }
 
 
@@ -438,9 +562,12 @@ void CoordinatorProcess::writingAborted()
 Coordinator::Coordinator(
     size_t quorum,
     const Shared<Replica>& replica,
-    const Shared<Network>& network)
+    const Shared<Network>& network,
+    size_t depth)
 {
-  process = new CoordinatorProcess(quorum, replica, network);
+  CHECK_GT(depth, 0u);
+
+  process = new CoordinatorProcess(quorum, replica, network, depth);
   spawn(process);
 }
 
@@ -42,10 +42,14 @@ class CoordinatorProcess;
 class Coordinator
 {
 public:
+  // The coordinator pipelines writes: up to 'depth' appends and
+  // truncates can be in flight at a time (each at its own position),
+  // and any further writes are queued until one of them finishes.
   Coordinator(
       size_t _quorum,
       const process::Shared<Replica>& _replica,
-      const process::Shared<Network>& _network);
+      const process::Shared<Network>& _network,
+      size_t _depth = 16);
 
   ~Coordinator();
 
@@ -62,7 +66,10 @@ public:
 
   // Appends the specified bytes to the end of the log. Returns the
   // position of the appended entry if the operation succeeds or none
-  // if the coordinator was demoted.
+  // if the coordinator was demoted. The writes complete in the order
+  // in which they were issued: if a write fails (or is discarded)
+  // the coordinator is demoted, and the writes issued after it
+  // return none.
   process::Future<Option<uint64_t> > append(const std::string& bytes);
 
   // Removes all log entries preceding the log entry at the given
@@ -19,13 +19,25 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
 
 #include <mesos/type_utils.hpp>
 
+#include <process/defer.hpp>
+#include <process/delay.hpp>
 #include <process/dispatch.hpp>
 #include <process/id.hpp>
+#include <process/owned.hpp>
 
+#include <process/metrics/gauge.hpp>
+#include <process/metrics/metrics.hpp>
+#include <process/metrics/timer.hpp>
+
+#include <stout/bytes.hpp>
 #include <stout/check.hpp>
+#include <stout/duration.hpp>
 #include <stout/error.hpp>
 #include <stout/foreach.hpp>
 #include <stout/none.hpp>
@@ -53,6 +65,7 @@ namespace protocol {
 Protocol<PromiseRequest, PromiseResponse> promise;
 Protocol<WriteRequest, WriteResponse> write;
 Protocol<RecoverRequest, RecoverResponse> recover;
+Protocol<ReadRequest, ReadResponse> read;
 
 } // namespace protocol {
 
@@ -102,28 +115,58 @@ public:
   // the disk. Returns true on success and false otherwise.
   bool update(const Metadata::Status& status);
 
+protected:
+  virtual void finalize()
+  {
+    // Write out whatever is left in the batch, e.g., learned notices
+    // that arrived right before we were terminated.
+    commit();
+  }
+
 private:
   // Handles a request from a proposer to promise not to accept writes
   // from any other proposer with lower proposal number.
-  void promise(const PromiseRequest& request);
+  void promise(const UPID& from, const PromiseRequest& request);
 
   // Handles a request from a proposer to write an action.
-  void write(const WriteRequest& request);
+  void write(const UPID& from, const WriteRequest& request);
 
   // Handles a request from a recover process.
   void recover(const RecoverRequest& request);
 
+  // Handles a request from a catch-up process to read the learned
+  // actions in a range of positions.
+  void read(const ReadRequest& request);
+
   // Handles a message notifying of a learned action.
   void learned(const Action& action);
 
   // Helper routines that write a record corresponding to the
-  // specified argument. Returns true on success and false otherwise.
-  bool persist(const Action& action);
+  // specified argument. The record is written to storage along with
+  // the other records of the current batch (see 'commit').
+  void persist(const Action& action);
 
   // Helper routines that update metadata corresponding to the
-  // specified argument. The update will be persisted on the disk.
-  // Returns true on success and false otherwise.
-  bool update(uint64_t promised);
+  // specified argument. The update will be persisted on the disk
+  // along with the other records of the current batch.
+  void update(uint64_t promised);
+
+  // Sends the reply once the records persisted so far are on disk.
+  void acknowledge(const UPID& to, const google::protobuf::Message& message);
+
+  // Writes the records of the current batch to storage with a single
+  // synchronous write and then sends the replies that were waiting
+  // for them. Returns false if the write failed, in which case the
+  // records stay in the batch.
+  bool commit();
+
+  // Commits the current batch, retrying later if that fails.
+  void _commit();
+
+  double _batch_size()
+  {
+    return static_cast<double>(batchSize);
+  }
 
   // Helper routine to restore log (e.g., on restart).
   void restore(const string& path);
@@ -146,13 +189,57 @@ private:
 
   // Unlearned positions in the log.
   IntervalSet<uint64_t> unlearned;
+
+  // Group commit. The records persisted while handling a message are
+  // not written to storage right away. Instead a commit is queued
+  // behind the messages that are already waiting for this process, so
+  // that concurrent writes, promises and learned notices (e.g., from a
+  // pipelining coordinator or during catch-up) share a single fsync.
+  // The in-memory state above reflects the batch, and replies that
+  // depend on it being durable are held back until it is committed.
+  Option<Metadata> uncommittedMetadata;
+  std::map<uint64_t, Action> uncommitted;
+  std::vector<std::pair<UPID, Owned<google::protobuf::Message> > > replies;
+
+  // Whether a commit has been queued.
+  bool committing;
+
+  // The number of records written by the last commit.
+  size_t batchSize;
+
+  // NOTE: The metrics are named after the replica's process since
+  // several replicas may live in the same process (e.g., in tests).
+  struct Metrics
+  {
+    explicit Metrics(const ReplicaProcess& process)
+      : batch_size(
+            process.ProcessBase::self().id + "/batch_size",
+            defer(process, &ReplicaProcess::_batch_size)),
+        fsync(process.ProcessBase::self().id + "/fsync", Days(1))
+    {
+      process::metrics::add(batch_size);
+      process::metrics::add(fsync);
+    }
+
+    ~Metrics()
+    {
+      process::metrics::remove(batch_size);
+      process::metrics::remove(fsync);
+    }
+
+    process::metrics::Gauge batch_size;
+    process::metrics::Timer<Milliseconds> fsync;
+  } metrics;
 };
 
 
 ReplicaProcess::ReplicaProcess(const string& path)
   : ProcessBase(ID::generate("log-replica")),
     begin(0),
-    end(0)
+    end(0),
+    committing(false),
+    batchSize(0),
+    metrics(*this)
 {
   // TODO(benh): Factor out and expose storage.
   storage = new LevelDBStorage();
@@ -169,6 +256,9 @@ ReplicaProcess::ReplicaProcess(const string& path)
   install<RecoverRequest>(
       &ReplicaProcess::recover);
 
+  install<ReadRequest>(
+      &ReplicaProcess::read);
+
   install<LearnedMessage>(
       &ReplicaProcess::learned,
       &LearnedMessage::action);
@@ -191,6 +281,14 @@ Result<Action> ReplicaProcess::read(uint64_t position)
     return None();
   }
 
+  // The latest record for the position might not have been committed.
+  std::map<uint64_t, Action>::const_iterator iterator =
+    uncommitted.find(position);
+
+  if (iterator != uncommitted.end()) {
+    return iterator->second;
+  }
+
   // Must exist in storage ...
   Try<Action> action = storage->read(position);
 
@@ -309,45 +407,38 @@ uint64_t ReplicaProcess::promised()
 
 bool ReplicaProcess::update(const Metadata::Status& status)
 {
-  Metadata metadata_;
-  metadata_.set_status(status);
-  metadata_.set_promised(promised());
+  const Metadata::Status previous = metadata.status();
 
-  Try<Nothing> persisted = storage->persist(metadata_);
+  // Update the cached metadata.
+  metadata.set_status(status);
+  uncommittedMetadata = metadata;
 
-  if (persisted.isError()) {
-    LOG(ERROR) << "Error writing to log: " << persisted.error();
+  // The status is persisted right away (along with the current batch)
+  // since the caller waits for it.
+  if (!commit()) {
+    metadata.set_status(previous);
+    uncommittedMetadata = metadata;
     return false;
   }
 
   LOG(INFO) << "Persisted replica status to " << status;
 
-  // Update the cached metadata.
-  metadata.set_status(status);
-
   return true;
 }
 
 
-bool ReplicaProcess::update(uint64_t promised)
+void ReplicaProcess::update(uint64_t promised)
 {
-  Metadata metadata_;
-  metadata_.set_status(status());
-  metadata_.set_promised(promised);
-
-  Try<Nothing> persisted = storage->persist(metadata_);
-
-  if (persisted.isError()) {
-    LOG(ERROR) << "Error writing to log: " << persisted.error();
-    return false;
-  }
-
-  LOG(INFO) << "Persisted promised to " << promised;
+  LOG(INFO) << "Persisting promised to " << promised;
 
   // Update the cached metadata.
   metadata.set_promised(promised);
+  uncommittedMetadata = metadata;
 
-  return true;
+  if (!committing) {
+    committing = true;
+    dispatch(self(), &ReplicaProcess::_commit);
+  }
 }
 
 
@@ -365,7 +456,7 @@ bool ReplicaProcess::update(uint64_t promised)
 // procedure.
 
 
-void ReplicaProcess::promise(const PromiseRequest& request)
+void ReplicaProcess::promise(const UPID& from, const PromiseRequest& request)
 {
   // Ignore promise requests if this replica is not in VOTING status.
   if (status() != Metadata::VOTING) {
@@ -442,13 +533,13 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         action.set_position(request.position());
         action.set_promised(request.proposal());
 
-        if (persist(action)) {
-          PromiseResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.set_position(request.position());
-          reply(response);
-        }
+        persist(action);
+
+        PromiseResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.set_position(request.position());
+        acknowledge(from, response);
       }
     } else {
       CHECK_SOME(result);
@@ -464,13 +555,13 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         Action original = action;
         action.set_promised(request.proposal());
 
-        if (persist(action)) {
-          PromiseResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.mutable_action()->MergeFrom(original);
-          reply(response);
-        }
+        persist(action);
+
+        PromiseResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.mutable_action()->MergeFrom(original);
+        acknowledge(from, response);
       }
     }
   } else {
@@ -486,20 +577,20 @@ void ReplicaProcess::promise(const PromiseRequest& request)
       response.set_proposal(promised());
       reply(response);
     } else {
-      if (update(request.proposal())) {
-        // Return the last position written.
-        PromiseResponse response;
-        response.set_okay(true);
-        response.set_proposal(request.proposal());
-        response.set_position(end);
-        reply(response);
-      }
+      update(request.proposal());
+
+      // Return the last position written.
+      PromiseResponse response;
+      response.set_okay(true);
+      response.set_proposal(request.proposal());
+      response.set_position(end);
+      acknowledge(from, response);
     }
   }
 }
 
 
-void ReplicaProcess::write(const WriteRequest& request)
+void ReplicaProcess::write(const UPID& from, const WriteRequest& request)
 {
   // Ignore write requests if this replica is not in VOTING status.
   if (status() != Metadata::VOTING) {
@@ -548,13 +639,13 @@ void ReplicaProcess::write(const WriteRequest& request)
           LOG(FATAL) << "Unknown Action::Type!";
       }
 
-      if (persist(action)) {
-        WriteResponse response;
-        response.set_okay(true);
-        response.set_proposal(request.proposal());
-        response.set_position(request.position());
-        reply(response);
-      }
+      persist(action);
+
+      WriteResponse response;
+      response.set_okay(true);
+      response.set_proposal(request.proposal());
+      response.set_position(request.position());
+      acknowledge(from, response);
     }
   } else if (result.isSome()) {
     Action action = result.get();
@@ -623,13 +714,13 @@ void ReplicaProcess::write(const WriteRequest& request)
             LOG(FATAL) << "Unknown Action::Type!";
         }
 
-        if (persist(action)) {
-          WriteResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.set_position(request.position());
-          reply(response);
-        }
+        persist(action);
+
+        WriteResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.set_position(request.position());
+        acknowledge(from, response);
       }
     }
   }
@@ -653,6 +744,74 @@ void ReplicaProcess::recover(const RecoverRequest& request)
 }
 
 
+void ReplicaProcess::read(const ReadRequest& request)
+{
+  // Ignore read requests if this replica is not in VOTING status.
+  if (status() != Metadata::VOTING) {
+    LOG(INFO) << "Replica ignoring read request as it is in "
+              << status() << " status";
+    return;
+  }
+
+  if (request.to() < request.from()) {
+    LOG(WARNING) << "Replica ignoring read request with bad range ["
+                 << request.from() << ", " << request.to() << "]";
+    return;
+  }
+
+  VLOG(2) << "Replica received read request from " << request.from()
+          << " to " << request.to();
+
+  // Stop once the response gets this large. The reader asks for the
+  // rest with another request.
+  static const Bytes MAX_READ_SIZE = Megabytes(4);
+
+  ReadResponse response;
+  Bytes size = 0;
+
+  uint64_t position = request.from();
+
+  for (; position <= request.to() && size < MAX_READ_SIZE; position++) {
+    // Like a promise request for a truncated position, a truncated
+    // position is read as a learned no-op (see 'promise' above).
+    if (position < begin) {
+      Action* action = response.add_actions();
+      action->set_position(position);
+      action->set_promised(promised());
+      action->set_performed(promised());
+      action->set_learned(true);
+      action->set_type(Action::NOP);
+      action->mutable_nop();
+      size += action->ByteSize();
+      continue;
+    } else if (position > end) {
+      // Nothing to read past the end of the log, which we report so
+      // that the reader asks a more up-to-date replica for the rest.
+      break;
+    }
+
+    Result<Action> result = read(position);
+
+    if (result.isError()) {
+      LOG(ERROR) << "Error getting log record at " << position
+                 << ": " << result.error();
+      break;
+    } else if (result.isSome() &&
+               result.get().has_learned() &&
+               result.get().learned()) {
+      response.add_actions()->CopyFrom(result.get());
+      size += result.get().ByteSize();
+    }
+  }
+
+  // NOTE: We reply even if nothing could be read (i.e., 'end' is
+  // 'from') so that the reader doesn't wait for us.
+  response.set_end(position);
+
+  reply(response);
+}
+
+
 void ReplicaProcess::learned(const Action& action)
 {
   LOG(INFO) << "Replica received learned notice for position "
@@ -660,23 +819,24 @@ void ReplicaProcess::learned(const Action& action)
 
   CHECK(action.learned());
 
-  if (persist(action)) {
-    LOG(INFO) << "Replica learned " << action.type()
-              << " action at position " << action.position();
-  }
+  persist(action);
+
+  LOG(INFO) << "Replica learned " << action.type()
+            << " action at position " << action.position();
 }
 
 
-bool ReplicaProcess::persist(const Action& action)
+void ReplicaProcess::persist(const Action& action)
 {
-  Try<Nothing> persisted = storage->persist(action);
+  LOG(INFO) << "Persisting action at " << action.position();
 
-  if (persisted.isError()) {
-    LOG(ERROR) << "Error writing to log: " << persisted.error();
-    return false;
-  }
+  // Only the latest record for each position needs to be written.
+  uncommitted[action.position()] = action;
 
-  LOG(INFO) << "Persisted action at " << action.position();
+  if (!committing) {
+    committing = true;
+    dispatch(self(), &ReplicaProcess::_commit);
+  }
 
   // No longer a hole here (if there even was one).
   holes -= action.position();
@@ -712,11 +872,78 @@ bool ReplicaProcess::persist(const Action& action)
 
   // And update the end position.
   end = std::max(end, action.position());
+}
+
+
+void ReplicaProcess::acknowledge(
+    const UPID& to,
+    const google::protobuf::Message& message)
+{
+  Owned<google::protobuf::Message> copy(message.New());
+  copy->CopyFrom(message);
+
+  replies.push_back(std::make_pair(to, copy));
+}
+
+
+bool ReplicaProcess::commit()
+{
+  if (uncommittedMetadata.isNone() && uncommitted.empty()) {
+    CHECK(replies.empty());
+    return true;
+  }
+
+  list<Action> actions;
+  foreachvalue (const Action& action, uncommitted) {
+    actions.push_back(action);
+  }
+
+  metrics.fsync.start();
+
+  Try<Nothing> persisted = storage->persist(uncommittedMetadata, actions);
+
+  metrics.fsync.stop();
+
+  if (persisted.isError()) {
+    LOG(ERROR) << "Error writing to log: " << persisted.error();
+    return false;
+  }
+
+  batchSize = actions.size() + (uncommittedMetadata.isSome() ? 1 : 0);
+
+  LOG(INFO) << "Committed " << batchSize << " records";
+
+  uncommittedMetadata = None();
+  uncommitted.clear();
+
+  // Now that the records are on disk, the replies can be sent.
+  typedef std::pair<UPID, Owned<google::protobuf::Message> > Reply;
+  foreach (const Reply& pending, replies) {
+    send(pending.first, *pending.second);
+  }
+
+  replies.clear();
 
   return true;
 }
 
 
+void ReplicaProcess::_commit()
+{
+  CHECK(committing);
+
+  // NOTE: Nothing that has not been committed gets acknowledged, so
+  // until the storage recovers this is no different from the requests
+  // never making it here (see the comment above 'promise').
+  if (!commit()) {
+    delay(Seconds(1), self(), &ReplicaProcess::_commit);
+    return;
+  }
+
+  committing = false;
+}
+
+
 void ReplicaProcess::restore(const string& path)
 {
   Try<Storage::State> state = storage->restore(path);
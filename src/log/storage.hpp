@@ -21,10 +21,12 @@
 
 #include <stdint.h>
 
+#include <list>
 #include <string>
 
 #include <stout/interval.hpp>
 #include <stout/nothing.hpp>
+#include <stout/option.hpp>
 #include <stout/try.hpp>
 
 #include "messages/log.hpp"
@@ -55,6 +57,13 @@ public:
   virtual Try<State> restore(const std::string& path) = 0;
   virtual Try<Nothing> persist(const Metadata& metadata) = 0;
   virtual Try<Nothing> persist(const Action& action) = 0;
+
+  // Persists the metadata (if any) and the actions with a single
+  // synchronous write, i.e., either all or none of them are.
+  virtual Try<Nothing> persist(
+      const Option<Metadata>& metadata,
+      const std::list<Action>& actions) = 0;
+
   virtual Try<Action> read(uint64_t position) = 0;
 };
 
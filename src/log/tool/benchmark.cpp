@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -31,6 +32,7 @@
 #include <stout/bytes.hpp>
 #include <stout/error.hpp>
 #include <stout/foreach.hpp>
+#include <stout/numify.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/strings.hpp>
 #include <stout/os/read.hpp>
@@ -90,6 +92,13 @@ Benchmark::Flags::Flags()
       "  random: all bits are randomly chosen\n",
       "random");
 
+  add(&Flags::depths,
+      "depths",
+      "Comma-separated list of pipeline depths, i.e., the numbers of\n"
+      "appends to keep in flight at a time. The trace is replayed\n"
+      "once for each depth and the throughput of each is reported",
+      "1");
+
   add(&Flags::initialize,
       "initialize",
       "Whether to initialize the log",
@@ -148,6 +157,20 @@ Try<Nothing> Benchmark::execute(int argc, char** argv)
     return Error(flags.usage("Missing required option --output"));
   }
 
+  vector<size_t> depths;
+  foreach (const string& token, strings::tokenize(flags.depths, ",")) {
+    Try<size_t> depth = numify<size_t>(token);
+    if (depth.isError() || depth.get() == 0) {
+      return Error(flags.usage("Invalid pipeline depth '" + token + "'"));
+    }
+
+    depths.push_back(depth.get());
+  }
+
+  if (depths.empty()) {
+    return Error(flags.usage("Missing pipeline depths in --depths"));
+  }
+
   // Initialize the log.
   if (flags.initialize) {
     Initialize initialize;
@@ -217,43 +240,65 @@ Try<Nothing> Benchmark::execute(int argc, char** argv)
     }
   }
 
-  Stopwatch stopwatch;
-  stopwatch.start();
+  // Ouput statistics.
+  ofstream output(flags.output.get().c_str());
+  if (!output.is_open()) {
+    return Error("Failed to open the output file " + flags.output.get());
+  }
+
+  foreach (size_t depth, depths) {
+    vector<Future<Option<Log::Position> > > appending(sizes.size());
+    vector<Time> starts(sizes.size());
 
-  for (size_t i = 0; i < sizes.size(); i++) {
     Stopwatch stopwatch;
     stopwatch.start();
 
-    position = writer.append(data[i]);
-
-    if (!position.await(Seconds(10))) {
-      return Error("Failed to append: timed out");
-    } else if (!position.isReady()) {
-      return Error("Failed to append: " +
-                   (position.isFailed()
-                    ? position.failure()
-                    : "Discarded future"));
-    } else if (position.get().isNone()) {
-      return Error("Failed to append: exclusive write promise lost");
+    // The next append to issue. We keep up to 'depth' appends in
+    // flight, issuing the next one as soon as the oldest finishes.
+    size_t next = 0;
+
+    for (size_t i = 0; i < sizes.size(); i++) {
+      while (next < sizes.size() && next < i + depth) {
+        starts[next] = Clock::now();
+        appending[next] = writer.append(data[next]);
+        next++;
+      }
+
+      position = appending[i];
+
+      if (!position.await(Seconds(10))) {
+        return Error("Failed to append: timed out");
+      } else if (!position.isReady()) {
+        return Error("Failed to append: " +
+                     (position.isFailed()
+                      ? position.failure()
+                      : "Discarded future"));
+      } else if (position.get().isNone()) {
+        return Error("Failed to append: exclusive write promise lost");
+      }
+
+      durations.push_back(Clock::now() - starts[i]);
+      timestamps.push_back(Clock::now());
     }
 
-    durations.push_back(stopwatch.elapsed());
-    timestamps.push_back(Clock::now());
-  }
+    const Duration elapsed = stopwatch.elapsed();
 
-  cout << "Total number of appends: " << sizes.size() << endl;
-  cout << "Total time used: " << stopwatch.elapsed() << endl;
+    cout << "Pipeline depth: " << depth << endl;
+    cout << "Total number of appends: " << sizes.size() << endl;
+    cout << "Total time used: " << elapsed << endl;
+    cout << "Throughput: "
+         << sizes.size() / std::max(elapsed.secs(), 1e-9)
+         << " appends/s" << endl;
 
-  // Ouput statistics.
-  ofstream output(flags.output.get().c_str());
-  if (!output.is_open()) {
-    return Error("Failed to open the output file " + flags.output.get());
-  }
+    for (size_t i = 0; i < sizes.size(); i++) {
+      output << timestamps[i]
+             << " Appended " << sizes[i].bytes() << " bytes"
+             << " in " << durations[i].ms() << " ms"
+             << " at pipeline depth " << depth << endl;
+    }
 
-  for (size_t i = 0; i < sizes.size(); i++) {
-    output << timestamps[i]
-           << " Appended " << sizes[i].bytes() << " bytes"
-           << " in " << durations[i].ms() << " ms" << endl;
+    durations.clear();
+    timestamps.clear();
   }
 
   output.close();
@@ -44,6 +44,11 @@ public:
   // Factory to allow for typed tests.
   static Try<mesos::master::allocator::Allocator*> create();
 
+  // Factory for allocator processes that take options.
+  template <typename Options>
+  static Try<mesos::master::allocator::Allocator*> create(
+      const Options& options);
+
   ~MesosAllocator();
 
   void initialize(
@@ -113,6 +118,10 @@ public:
 
 private:
   MesosAllocator();
+
+  template <typename Options>
+  explicit MesosAllocator(const Options& options);
+
   MesosAllocator(const MesosAllocator&); // Not copyable.
   MesosAllocator& operator=(const MesosAllocator&); // Not assignable.
 
@@ -208,6 +217,17 @@ MesosAllocator<AllocatorProcess>::create()
   return CHECK_NOTNULL(allocator);
 }
 
+template <typename AllocatorProcess>
+template <typename Options>
+Try<mesos::master::allocator::Allocator*>
+MesosAllocator<AllocatorProcess>::create(const Options& options)
+{
+  mesos::master::allocator::Allocator* allocator =
+    new MesosAllocator<AllocatorProcess>(options);
+  return CHECK_NOTNULL(allocator);
+}
+
+
 template <typename AllocatorProcess>
 MesosAllocator<AllocatorProcess>::MesosAllocator()
 {
@@ -216,6 +236,15 @@ MesosAllocator<AllocatorProcess>::MesosAllocator()
 }
 
 
+template <typename AllocatorProcess>
+template <typename Options>
+MesosAllocator<AllocatorProcess>::MesosAllocator(const Options& options)
+{
+  process = new AllocatorProcess(options);
+  process::spawn(process);
+}
+
+
 template <typename AllocatorProcess>
 MesosAllocator<AllocatorProcess>::~MesosAllocator()
 {
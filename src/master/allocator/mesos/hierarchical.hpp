@@ -20,21 +20,34 @@
 #define __MASTER_ALLOCATOR_MESOS_HIERARCHICAL_HPP__
 
 #include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <mesos/resources.hpp>
 #include <mesos/type_utils.hpp>
 
+#include <process/clock.hpp>
 #include <process/event.hpp>
 #include <process/delay.hpp>
 #include <process/id.hpp>
 #include <process/metrics/gauge.hpp>
 #include <process/metrics/metrics.hpp>
+#include <process/owned.hpp>
+#include <process/time.hpp>
 #include <process/timeout.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/check.hpp>
 #include <stout/duration.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/lambda.hpp>
+#include <stout/option.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 
@@ -50,6 +63,7 @@ namespace allocator {
 
 // Forward declarations.
 class Filter;
+class RolePartition;
 
 
 // We forward declare the hierarchical allocator process so that we
@@ -64,16 +78,142 @@ typedef MesosAllocator<HierarchicalDRFAllocatorProcess>
 HierarchicalDRFAllocator;
 
 
+// A pool of threads that the shards of a batch allocation are run on
+// (see 'HierarchicalAllocatorProcess::allocate'), so that threads are
+// not created for every allocation.
+class ShardPool
+{
+public:
+  explicit ShardPool(size_t size)
+    : function(NULL), shards(0), next(0), remaining(0), stopping(false)
+  {
+    for (size_t i = 0; i < size; i++) {
+      threads.push_back(std::thread(&ShardPool::work, this));
+    }
+  }
+
+  ~ShardPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+
+    available.notify_all();
+
+    foreach (std::thread& thread, threads) {
+      thread.join();
+    }
+  }
+
+  // Invokes 'f' for each shard in [0, _shards) on the threads of the
+  // pool and the calling thread, returning once all have finished.
+  void run(size_t _shards, const lambda::function<void(size_t)>& f)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    function = &f;
+    shards = _shards;
+    next = 0;
+    remaining = _shards;
+
+    available.notify_all();
+
+    while (next < shards) {
+      const size_t shard = next++;
+
+      lock.unlock();
+      f(shard);
+      lock.lock();
+
+      remaining--;
+    }
+
+    while (remaining > 0) {
+      finished.wait(lock);
+    }
+
+    function = NULL;
+  }
+
+private:
+  void work()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+      while (!stopping && (function == NULL || next >= shards)) {
+        available.wait(lock);
+      }
+
+      if (stopping) {
+        return;
+      }
+
+      const lambda::function<void(size_t)>* f = function;
+      const size_t shard = next++;
+
+      lock.unlock();
+      (*f)(shard);
+      lock.lock();
+
+      if (--remaining == 0) {
+        finished.notify_all();
+      }
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable available;
+  std::condition_variable finished;
+
+  // The shards of the batch being run (if any), the next of which
+  // is picked up by any thread and the number left to finish.
+  const lambda::function<void(size_t)>* function;
+  size_t shards;
+  size_t next;
+  size_t remaining;
+
+  bool stopping;
+
+  std::vector<std::thread> threads;
+};
+
+
 // Implements the basic allocator algorithm - first pick a role by
 // some criteria, then pick one of their frameworks to allocate to.
 template <typename RoleSorter, typename FrameworkSorter>
 class HierarchicalAllocatorProcess : public MesosAllocatorProcess
 {
 public:
-  HierarchicalAllocatorProcess()
+  struct Options
+  {
+    Options() : shards(1), fairnessTolerance(0.05) {}
+
+    // Number of shards that the slaves are split into (and evaluated
+    // in parallel) for batch allocations, see 'allocate' below.
+    size_t shards;
+
+    // How far above the lowest share the share of a role (or of a
+    // framework within its role) may be for a candidate offer picked
+    // by a shard to be accepted.
+    double fairnessTolerance;
+
+    // If set, the resources of a slave are split across frameworks
+    // ("fine-grained" allocation) rather than all allocated to a
+    // single framework: each framework, in the order determined by
+    // the sorters, is allocated this much at a time, see 'split'.
+    Option<Resources> quantum;
+  };
+
+  explicit HierarchicalAllocatorProcess(const Options& _options = Options())
     : ProcessBase(process::ID::generate("hierarchical-allocator")),
+      options(_options),
+      pool(options.shards > 1 ? new ShardPool(options.shards - 1) : NULL),
       initialized(false),
       metrics(*this),
+      evaluatedPairs(0),
+      skippedPairs(0),
       roleSorter(NULL) {}
 
   virtual ~HierarchicalAllocatorProcess() {}
@@ -165,8 +305,55 @@ protected:
   // Allocate resources from the specified slaves.
   void allocate(const hashset<SlaveID>& slaveIds);
 
-  // Remove a filter for the specified framework.
-  void expire(const FrameworkID& frameworkId, Filter* filter);
+  // Allocate resources from the specified slaves by splitting them
+  // into shards: each shard picks a candidate framework for each of
+  // its slaves on a thread of 'pool', based on a snapshot of the
+  // sorters taken up front. The candidates are then merged on the
+  // allocator in a deterministic order, falling back to '_allocate'
+  // for any slave whose candidate is filtered or would violate the
+  // fairness tolerance given the allocations made so far.
+  void allocate(
+      const std::vector<SlaveID>& slaveIds,
+      hashmap<FrameworkID, hashmap<SlaveID, Resources>>* offerable);
+
+  // Allocate resources from the specified slave, considering each
+  // framework in the order determined by the sorters.
+  void _allocate(
+      const SlaveID& slaveId,
+      hashmap<FrameworkID, hashmap<SlaveID, Resources>>* offerable);
+
+  // Returns the roles whose frameworks may be allocated some of the
+  // partitioned resources, in the order determined by the role
+  // sorter. Unless some unreserved resources are allocatable, these
+  // are just the roles that resources are reserved for, which saves
+  // sorting (and considering) every role for slaves whose resources
+  // are all statically reserved.
+  std::list<std::string> candidates(const RolePartition& partition);
+
+  // Returns the part of the resources that should be allocated to a
+  // framework in the specified role at a time: all of them, unless
+  // allocating a quantum at a time (see 'Options::quantum').
+  Resources split(const Resources& resources, const std::string& role);
+
+  // Allocates the resources on the specified slave to the framework.
+  void __allocate(
+      const FrameworkID& frameworkId,
+      const std::string& role,
+      const SlaveID& slaveId,
+      const Resources& resources,
+      hashmap<FrameworkID, hashmap<SlaveID, Resources>>* offerable);
+
+  // Returns whether the shares of the role, and of the framework
+  // within the role, are within the fairness tolerance of the lowest
+  // shares, considering only the specified roles.
+  bool fair(
+      const std::string& role,
+      const FrameworkID& frameworkId,
+      const hashset<std::string>& roles);
+
+  // Remove (and delete) the filters that expire by the specified
+  // time, see 'expirations' below.
+  void expire(const process::Time& time);
 
   // Checks whether the slave is whitelisted.
   bool isWhitelisted(const SlaveID& slaveId);
@@ -180,6 +367,11 @@ protected:
 
   bool allocatable(const Resources& resources);
 
+  const Options options;
+
+  // Runs the shards of batch allocations, if there is more than one.
+  process::Owned<ShardPool> pool;
+
   bool initialized;
 
   Duration allocationInterval;
@@ -193,17 +385,49 @@ protected:
     explicit Metrics(const Self& process)
       : event_queue_dispatches(
             "allocator/event_queue_dispatches",
-            process::defer(process.self(), &Self::_event_queue_dispatches))
+            process::defer(process.self(), &Self::_event_queue_dispatches)),
+        active_filters(
+            "allocator/active_filters",
+            process::defer(process.self(), &Self::_active_filters)),
+        filter_check_time_ms(
+            "allocator/filter_check_time_ms",
+            process::defer(process.self(), &Self::_filter_check_time_ms)),
+        evaluated_pairs(
+            "allocator/evaluated_pairs",
+            process::defer(process.self(), &Self::_evaluated_pairs)),
+        skipped_pairs(
+            "allocator/skipped_pairs",
+            process::defer(process.self(), &Self::_skipped_pairs))
     {
       process::metrics::add(event_queue_dispatches);
+      process::metrics::add(active_filters);
+      process::metrics::add(filter_check_time_ms);
+      process::metrics::add(evaluated_pairs);
+      process::metrics::add(skipped_pairs);
     }
 
     ~Metrics()
     {
       process::metrics::remove(event_queue_dispatches);
+      process::metrics::remove(active_filters);
+      process::metrics::remove(filter_check_time_ms);
+      process::metrics::remove(evaluated_pairs);
+      process::metrics::remove(skipped_pairs);
     }
 
     process::metrics::Gauge event_queue_dispatches;
+
+    // Number of filters that are currently applied by frameworks.
+    process::metrics::Gauge active_filters;
+
+    // Time spent checking filters during the last allocation.
+    process::metrics::Gauge filter_check_time_ms;
+
+    // Number of (slave, framework) pairs that were evaluated, and
+    // that were skipped because nothing changed on the slave, during
+    // the last allocation.
+    process::metrics::Gauge evaluated_pairs;
+    process::metrics::Gauge skipped_pairs;
   } metrics;
 
   struct Framework
@@ -214,7 +438,9 @@ protected:
     // Whether the framework desires revocable resources.
     bool revocable;
 
-    hashset<Filter*> filters; // Active filters for the framework.
+    // Active filters for the framework, indexed by the slave that
+    // they apply to.
+    hashmap<SlaveID, hashset<Filter*>> filters;
   };
 
   double _event_queue_dispatches()
@@ -222,6 +448,40 @@ protected:
     return static_cast<double>(eventCount<process::DispatchEvent>());
   }
 
+  double _active_filters()
+  {
+    size_t count = 0;
+    foreachvalue (const Framework& framework, frameworks) {
+      foreachvalue (const hashset<Filter*>& filters, framework.filters) {
+        count += filters.size();
+      }
+    }
+    return static_cast<double>(count);
+  }
+
+  double _filter_check_time_ms()
+  {
+    return filterCheckTime.ms();
+  }
+
+  double _evaluated_pairs()
+  {
+    return static_cast<double>(evaluatedPairs);
+  }
+
+  double _skipped_pairs()
+  {
+    return static_cast<double>(skippedPairs);
+  }
+
+  // Time spent in 'isFiltered' during the last (or current)
+  // allocation.
+  Duration filterCheckTime;
+
+  // See 'evaluated_pairs' and 'skipped_pairs' above.
+  size_t evaluatedPairs;
+  size_t skippedPairs;
+
   hashmap<FrameworkID, Framework> frameworks;
 
   struct Slave
@@ -240,6 +500,28 @@ protected:
 
   hashmap<SlaveID, Slave> slaves;
 
+  // Slaves whose available resources could not be allocated to any
+  // framework, for reasons other than filters, when they were last
+  // considered for allocation. These are skipped until something
+  // changes that could make their resources allocatable: their
+  // available resources change, or a framework is added, activated
+  // or revived. A slave is removed from here when its resources are
+  // filtered, because filters expire without any such change.
+  hashset<SlaveID> unchanged;
+
+  struct Expiration
+  {
+    FrameworkID frameworkId;
+    SlaveID slaveId;
+    Filter* filter;
+  };
+
+  // Filters that have yet to be deleted, bucketed by the time at
+  // which 'expire' is invoked for them. The filters in a bucket
+  // expire within a second of each other, which lets them share a
+  // single timer.
+  std::map<process::Time, std::vector<Expiration>> expirations;
+
   hashmap<std::string, mesos::master::RoleInfo> roles;
 
   // Slaves to send offers for.
@@ -295,6 +577,106 @@ public:
 };
 
 
+// The cpus and mem in some resources (e.g., those available on a
+// slave), partitioned by the role that they are reserved for ('*' if
+// unreserved) and by whether they are revocable. This lets us check
+// whether anything is allocatable to a framework in a role without
+// copying any of the resources.
+class RolePartition
+{
+public:
+  explicit RolePartition(const Resources& resources)
+  {
+    foreach (const Resource& resource, resources) {
+      if (resource.type() != Value::SCALAR) {
+        continue;
+      }
+
+      Quantities& quantities = Resources::isRevocable(resource)
+        ? revocable[resource.role()]
+        : regular[resource.role()];
+
+      if (resource.name() == "cpus") {
+        quantities.cpus += resource.scalar().value();
+      } else if (resource.name() == "mem") {
+        quantities.mem += resource.scalar().value();
+      }
+    }
+  }
+
+  // Returns the roles that some of the resources are reserved for.
+  hashset<std::string> reservations() const
+  {
+    hashset<std::string> result;
+
+    foreachkey (const std::string& role, regular) {
+      if (role != "*") {
+        result.insert(role);
+      }
+    }
+
+    foreachkey (const std::string& role, revocable) {
+      if (role != "*") {
+        result.insert(role);
+      }
+    }
+
+    return result;
+  }
+
+  // Returns whether the resources that are unreserved or reserved for
+  // the role, including the revocable ones only if 'includeRevocable'
+  // is true, are allocatable. This is equivalent to
+  // HierarchicalAllocatorProcess::allocatable on those resources.
+  bool allocatable(const std::string& role, bool includeRevocable) const
+  {
+    Quantities total;
+
+    add(regular, "*", &total);
+
+    if (role != "*") {
+      add(regular, role, &total);
+    }
+
+    if (includeRevocable) {
+      add(revocable, "*", &total);
+
+      if (role != "*") {
+        add(revocable, role, &total);
+      }
+    }
+
+    // NOTE: Like Resources::mem we truncate the mem to megabytes.
+    return total.cpus >= MIN_CPUS ||
+           Megabytes(static_cast<uint64_t>(total.mem)) >= MIN_MEM;
+  }
+
+private:
+  struct Quantities
+  {
+    Quantities() : cpus(0.0), mem(0.0) {}
+
+    double cpus;
+    double mem;
+  };
+
+  static void add(
+      const hashmap<std::string, Quantities>& quantities,
+      const std::string& role,
+      Quantities* total)
+  {
+    if (quantities.contains(role)) {
+      const Quantities& role_ = quantities.at(role);
+      total->cpus += role_.cpus;
+      total->mem += role_.mem;
+    }
+  }
+
+  hashmap<std::string, Quantities> regular;
+  hashmap<std::string, Quantities> revocable;
+};
+
+
 template <class RoleSorter, class FrameworkSorter>
 void
 HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::initialize(
@@ -367,6 +749,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::addFramework(
 
   LOG(INFO) << "Added framework " << frameworkId;
 
+  unchanged.clear();
+
   allocate();
 }
 
@@ -420,6 +804,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::activateFramework(
 
   LOG(INFO) << "Activated framework " << frameworkId;
 
+  unchanged.clear();
+
   allocate();
 }
 
@@ -532,6 +918,7 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::removeSlave(
   roleSorter->remove(slaveId, slaves[slaveId].total.unreserved());
 
   slaves.erase(slaveId);
+  unchanged.erase(slaveId);
 
   // Note that we DO NOT actually delete any filters associated with
   // this slave, that will occur when the delayed
@@ -581,6 +968,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::updateSlave(
   // Now add the new estimate of available oversubscribed resources.
   slaves[slaveId].available += oversubscribed - allocation;
 
+  unchanged.erase(slaveId);
+
   LOG(INFO) << "Slave " << slaveId << " (" << slaves[slaveId].hostname
             << ") updated with oversubscribed resources " << oversubscribed
             << " (total: " << slaves[slaveId].total
@@ -600,6 +989,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::activateSlave(
 
   slaves[slaveId].activated = true;
 
+  unchanged.erase(slaveId);
+
   LOG(INFO)<< "Slave " << slaveId << " reactivated";
 }
 
@@ -627,6 +1018,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::updateWhitelist(
 
   whitelist = _whitelist;
 
+  unchanged.clear();
+
   if (whitelist.isSome()) {
     LOG(INFO) << "Updated slave whitelist: " << stringify(whitelist.get());
 
@@ -748,6 +1141,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::recoverResources(
   if (slaves.contains(slaveId)) {
     slaves[slaveId].available += resources;
 
+    unchanged.erase(slaveId);
+
     LOG(INFO) << "Recovered " << resources
               << " (total allocatable: " << slaves[slaveId].available
               << ") on slave " << slaveId
@@ -789,14 +1184,40 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::recoverResources(
             << " for " << seconds.get();
 
     // Create a new filter and delay its expiration.
-    Filter* filter = new RefusedFilter(
-        slaveId,
-        resources,
-        process::Timeout::in(seconds.get()));
+    const process::Timeout timeout = process::Timeout::in(seconds.get());
+
+    Filter* filter = new RefusedFilter(slaveId, resources, timeout);
+
+    frameworks[frameworkId].filters[slaveId].insert(filter);
+
+    // The filter stops filtering at its timeout, so rounding the
+    // expiration up to the next second only delays its removal.
+    // NOTE: We round the time directly rather than using
+    // 'Time::create', which would add the time that a paused clock
+    // has been advanced by a second time.
+    process::Time time = timeout.time();
+
+    const Duration remainder =
+      Nanoseconds(time.duration().ns() % Seconds(1).ns());
+
+    if (remainder > Duration::zero() &&
+        time.duration() < Duration::max() - Seconds(1)) {
+      time += Seconds(1) - remainder;
+    }
 
-    frameworks[frameworkId].filters.insert(filter);
+    if (!expirations.count(time)) {
+      delay(time - process::Clock::now(),
+            self(),
+            &Self::expire,
+            time);
+    }
+
+    Expiration expiration;
+    expiration.frameworkId = frameworkId;
+    expiration.slaveId = slaveId;
+    expiration.filter = filter;
 
-    delay(seconds.get(), self(), &Self::expire, frameworkId, filter);
+    expirations[time].push_back(expiration);
   }
 }
 
@@ -819,6 +1240,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::reviveOffers(
 
   LOG(INFO) << "Removed filters for framework " << frameworkId;
 
+  unchanged.clear();
+
   allocate();
 }
 
@@ -869,6 +1292,10 @@ void
 HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
     const hashset<SlaveID>& slaveIds_)
 {
+  filterCheckTime = Duration::zero();
+  evaluatedPairs = 0;
+  skippedPairs = 0;
+
   if (roleSorter->count() == 0) {
     LOG(ERROR) << "No roles specified, cannot allocate resources!";
     return;
@@ -881,92 +1308,449 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
   //       to a framework of any role.
   hashmap<FrameworkID, hashmap<SlaveID, Resources> > offerable;
 
+  // Don't send offers for non-whitelisted and deactivated slaves,
+  // and skip the slaves for which nothing has changed since they
+  // were last considered.
+  std::vector<SlaveID> slaveIds;
+  slaveIds.reserve(slaveIds_.size());
+
+  size_t skipped = 0;
+
+  foreach (const SlaveID& slaveId, slaveIds_) {
+    if (isWhitelisted(slaveId) && slaves[slaveId].activated) {
+      if (unchanged.contains(slaveId)) {
+        skipped++;
+      } else {
+        slaveIds.push_back(slaveId);
+      }
+    }
+  }
+
+  if (skipped > 0) {
+    // Each of the skipped slaves would have been considered for
+    // every active framework.
+    size_t active = 0;
+    foreachvalue (FrameworkSorter* frameworkSorter, frameworkSorters) {
+      active += frameworkSorter->sort().size();
+    }
+
+    skippedPairs = skipped * active;
+  }
+
+  // Unless their resources get filtered (see '_allocate'), the slaves
+  // that we consider now need not be considered again until something
+  // changes.
+  foreach (const SlaveID& slaveId, slaveIds) {
+    unchanged.insert(slaveId);
+  }
+
   // Randomize the order in which slaves' resources are allocated.
   // TODO(vinod): Implement a smarter sorting algorithm.
-  std::vector<SlaveID> slaveIds(slaveIds_.begin(), slaveIds_.end());
   std::random_shuffle(slaveIds.begin(), slaveIds.end());
 
+  if (options.shards > 1 && slaveIds.size() > 1) {
+    allocate(slaveIds, &offerable);
+  } else {
+    foreach (const SlaveID& slaveId, slaveIds) {
+      _allocate(slaveId, &offerable);
+    }
+  }
+
+  if (offerable.empty()) {
+    VLOG(1) << "No resources available to allocate!";
+  } else {
+    // Now offer the resources to each framework.
+    foreachkey (const FrameworkID& frameworkId, offerable) {
+      offerCallback(frameworkId, offerable[frameworkId]);
+    }
+  }
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
+    const std::vector<SlaveID>& slaveIds,
+    hashmap<FrameworkID, hashmap<SlaveID, Resources>>* offerable)
+{
+  // Snapshot the order in which the frameworks are considered.
+  struct Candidate
+  {
+    std::string role;
+    FrameworkID frameworkId;
+    bool revocable;
+  };
+
+  std::vector<Candidate> order;
+  hashset<std::string> roles;
+
+  foreach (const std::string& role, roleSorter->sort()) {
+    foreach (const std::string& frameworkId_,
+             frameworkSorters[role]->sort()) {
+      Candidate candidate;
+      candidate.role = role;
+      candidate.frameworkId.set_value(frameworkId_);
+      candidate.revocable = frameworks[candidate.frameworkId].revocable;
+
+      order.push_back(candidate);
+      roles.insert(role);
+    }
+  }
+
+  if (order.empty()) {
+    return;
+  }
+
+  // NOTE: The shards only read the slaves, and we wait for all of
+  // them to finish before changing anything.
+  std::vector<const Slave*> snapshot;
+  snapshot.reserve(slaveIds.size());
+
   foreach (const SlaveID& slaveId, slaveIds) {
-    // Don't send offers for non-whitelisted and deactivated slaves.
-    if (!isWhitelisted(slaveId) || !slaves[slaveId].activated) {
+    snapshot.push_back(&slaves[slaveId]);
+  }
+
+  // The index of the candidate picked for each slave (if any) and
+  // the resources that it would be offered.
+  std::vector<Option<std::pair<size_t, Resources>>> picks(slaveIds.size());
+
+  const size_t shards = std::min(options.shards, slaveIds.size());
+
+  CHECK_NOTNULL(pool.get())->run(shards, [&](size_t shard) {
+    // The slaves are dealt out to the shards and each shard picks
+    // the candidates for its slaves round-robin (from the snapshot
+    // order), which approximates how the offers would be spread
+    // across the frameworks if the slaves were allocated one at a
+    // time, in the merge order below.
+    size_t next = shard;
+
+    for (size_t i = shard; i < slaveIds.size(); i += shards) {
+      const Resources& available = snapshot[i]->available;
+      const Resources unreserved = available.unreserved();
+      const RolePartition partition(available);
+
+      for (size_t j = 0; j < order.size(); j++) {
+        const size_t index = (next + j) % order.size();
+        const Candidate& candidate = order[index];
+
+        // Skip candidates without anything allocatable (e.g., in
+        // roles that the slave has no reservations for) before
+        // computing the resources available to them.
+        if (!partition.allocatable(candidate.role, candidate.revocable)) {
+          continue;
+        }
+
+        Resources resources = unreserved + available.reserved(candidate.role);
+
+        if (!candidate.revocable) {
+          resources -= resources.revocable();
+        }
+
+        if (allocatable(resources)) {
+          picks[i] = std::make_pair(index, resources);
+          next = index + shards;
+          break;
+        }
+      }
+    }
+  });
+
+  size_t accepted = 0;
+
+  for (size_t i = 0; i < slaveIds.size(); i++) {
+    const SlaveID& slaveId = slaveIds[i];
+
+    // If no candidate was picked there is nothing allocatable on the
+    // slave for any framework.
+    if (picks[i].isNone()) {
       continue;
     }
 
-    foreach (const std::string& role, roleSorter->sort()) {
+    const Candidate& candidate = order[picks[i].get().first];
+    const Resources& resources = picks[i].get().second;
+
+    evaluatedPairs++;
+
+    const Resources allocation = split(resources, candidate.role);
+
+    // NOTE: If the candidate's resources are filtered, '_allocate'
+    // below considers the slave again (and keeps it from being
+    // skipped if the resources are still left for the candidate).
+    if (fair(candidate.role, candidate.frameworkId, roles) &&
+        !isFiltered(candidate.frameworkId, slaveId, allocation)) {
+      __allocate(
+          candidate.frameworkId,
+          candidate.role,
+          slaveId,
+          allocation,
+          offerable);
+
+      accepted++;
+
+      // Anything that remains on the slave (e.g., resources reserved
+      // for other roles) is allocated as usual.
+      if (!allocatable(slaves[slaveId].available)) {
+        continue;
+      }
+    }
+
+    _allocate(slaveId, offerable);
+  }
+
+  VLOG(1) << "Accepted " << accepted << " of the candidates picked for "
+          << slaveIds.size() << " slaves across " << shards << " shards";
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::_allocate(
+    const SlaveID& slaveId,
+    hashmap<FrameworkID, hashmap<SlaveID, Resources>>* offerable)
+{
+  // Whether anything on the slave is allocatable to the frameworks in
+  // a role. This only changes when we allocate, so we compute it once
+  // up front (and after each allocation) rather than computing the
+  // resources available to every framework that we consider.
+  RolePartition partition(slaves[slaveId].available);
+
+  // When allocating a quantum at a time, the shares change after
+  // each allocation, so we sort the roles and frameworks again to
+  // pick the next framework, until no framework can be allocated
+  // anything more.
+  bool sort = true;
+
+  while (sort) {
+    sort = false;
+
+    foreach (const std::string& role, candidates(partition)) {
+      // If none of the frameworks in the role can be allocated any
+      // resources, there is no need to sort them.
+      if (!partition.allocatable(role, true)) {
+        continue;
+      }
+
+      // The resources available to the frameworks in the role, and
+      // to those that have not opted for revocable resources. These
+      // are only computed once a framework can be allocated them.
+      Option<Resources> available;
+      Option<Resources> nonRevocable;
+
       foreach (const std::string& frameworkId_,
                frameworkSorters[role]->sort()) {
         FrameworkID frameworkId;
         frameworkId.set_value(frameworkId_);
 
-        // NOTE: Currently, frameworks are allowed to have '*' role.
-        // Calling reserved('*') returns an empty Resources object.
-        Resources resources =
-          slaves[slaveId].available.unreserved() +
-          slaves[slaveId].available.reserved(role);
+        evaluatedPairs++;
 
-        // Remove revocable resources if the framework has not opted
-        // for them.
-        if (!frameworks[frameworkId].revocable) {
-          resources -= resources.revocable();
-        }
+        const bool revocable = frameworks[frameworkId].revocable;
 
         // If the resources are not allocatable, ignore.
-        if (!allocatable(resources)) {
+        if (!partition.allocatable(role, revocable)) {
           continue;
         }
 
-        // If the framework filters these resources, ignore.
-        if (isFiltered(frameworkId, slaveId, resources)) {
+        if (available.isNone()) {
+          // NOTE: Currently, frameworks are allowed to have '*' role.
+          // Resources are never reserved for '*', so for '*' these
+          // are just the unreserved resources.
+          available = slaves[slaveId].available.filter(
+              [&role](const Resource& resource) {
+                return Resources::isUnreserved(resource) ||
+                       resource.role() == role;
+              });
+
+          nonRevocable = available.get().filter(
+              [](const Resource& resource) {
+                return !Resources::isRevocable(resource);
+              });
+        }
+
+        // Remove revocable resources if the framework has not opted
+        // for them.
+        const Resources& resources =
+          revocable ? available.get() : nonRevocable.get();
+
+        const Resources allocation = split(resources, role);
+
+        // If the framework filters these resources, ignore. The
+        // filter may expire without anything else changing, so the
+        // slave has to be considered again in the next allocation.
+        if (isFiltered(frameworkId, slaveId, allocation)) {
+          unchanged.erase(slaveId);
           continue;
         }
 
-        VLOG(2) << "Allocating " << resources << " on slave " << slaveId
-                << " to framework " << frameworkId;
-
-        // Note that we perform "coarse-grained" allocation,
-        // meaning that we always allocate the entire remaining
-        // slave resources to a single framework.
-        offerable[frameworkId][slaveId] = resources;
-        slaves[slaveId].available -= resources;
-
-        // Reserved resources are only accounted for in the framework
-        // sorter, since the reserved resources are not shared across
-        // roles.
-        frameworkSorters[role]->add(slaveId, resources);
-        frameworkSorters[role]->allocated(frameworkId_, slaveId, resources);
-        roleSorter->allocated(role, slaveId, resources.unreserved());
+        __allocate(frameworkId, role, slaveId, allocation, offerable);
+
+        partition = RolePartition(slaves[slaveId].available);
+
+        if (options.quantum.isSome()) {
+          sort = true;
+          break;
+        }
+
+        if (!partition.allocatable(role, true)) {
+          break;
+        }
+
+        available = None();
+        nonRevocable = None();
+      }
+
+      if (sort) {
+        break;
       }
     }
   }
+}
 
-  if (offerable.empty()) {
-    VLOG(1) << "No resources available to allocate!";
-  } else {
-    // Now offer the resources to each framework.
-    foreachkey (const FrameworkID& frameworkId, offerable) {
-      offerCallback(frameworkId, offerable[frameworkId]);
+
+template <class RoleSorter, class FrameworkSorter>
+std::list<std::string>
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::candidates(
+    const RolePartition& partition)
+{
+  // NOTE: Anything allocatable to '*' is allocatable to every role.
+  if (partition.allocatable("*", true)) {
+    return roleSorter->sort();
+  }
+
+  const hashset<std::string> reservations = partition.reservations();
+
+  std::list<std::string> result;
+
+  if (reservations.size() == 1) {
+    // NOTE: Resources may be reserved for roles that are unknown to
+    // the allocator (e.g., via the slave's '--resources' flag).
+    const std::string& role = *reservations.begin();
+
+    if (roles.contains(role)) {
+      result.push_back(role);
+    }
+  } else if (!reservations.empty()) {
+    foreach (const std::string& role, roleSorter->sort()) {
+      if (reservations.contains(role)) {
+        result.push_back(role);
+      }
+    }
+  }
+
+  return result;
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+Resources
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::split(
+    const Resources& resources,
+    const std::string& role)
+{
+  if (options.quantum.isNone()) {
+    return resources;
+  }
+
+  // Prefer the resources reserved for the role over the unreserved
+  // resources.
+  Option<Resources> quantum =
+    resources.find(options.quantum.get().flatten(role));
+
+  // If there is less than a quantum left, or what would be left is
+  // not allocatable, allocate all of the resources. This is also how
+  // resources not named in the quantum (e.g., ports) get allocated.
+  if (quantum.isNone() || !allocatable(resources - quantum.get())) {
+    return resources;
+  }
+
+  return quantum.get();
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::__allocate(
+    const FrameworkID& frameworkId,
+    const std::string& role,
+    const SlaveID& slaveId,
+    const Resources& resources,
+    hashmap<FrameworkID, hashmap<SlaveID, Resources>>* offerable)
+{
+  VLOG(2) << "Allocating " << resources << " on slave " << slaveId
+          << " to framework " << frameworkId;
+
+  // Note that unless we allocate a quantum at a time, we perform
+  // "coarse-grained" allocation, meaning that we always allocate the
+  // entire remaining slave resources to a single framework.
+  (*offerable)[frameworkId][slaveId] += resources;
+  slaves[slaveId].available -= resources;
+
+  // Reserved resources are only accounted for in the framework
+  // sorter, since the reserved resources are not shared across
+  // roles.
+  frameworkSorters[role]->add(slaveId, resources);
+  frameworkSorters[role]->allocated(frameworkId.value(), slaveId, resources);
+  roleSorter->allocated(role, slaveId, resources.unreserved());
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+bool
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::fair(
+    const std::string& role,
+    const FrameworkID& frameworkId,
+    const hashset<std::string>& roles)
+{
+  // Roles without any (active) frameworks are not allocated to, so
+  // they are not taken into account.
+  foreach (const std::string& lowest, roleSorter->sort()) {
+    if (roles.contains(lowest)) {
+      if (roleSorter->share(role) >
+          roleSorter->share(lowest) + options.fairnessTolerance) {
+        return false;
+      }
+      break;
     }
   }
+
+  FrameworkSorter* frameworkSorter = frameworkSorters[role];
+
+  return frameworkSorter->share(frameworkId.value()) <=
+    frameworkSorter->share(frameworkSorter->sort().front()) +
+    options.fairnessTolerance;
 }
 
 
 template <class RoleSorter, class FrameworkSorter>
 void
 HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::expire(
-    const FrameworkID& frameworkId,
-    Filter* filter)
+    const process::Time& time)
 {
-  // The filter might have already been removed (e.g., if the
-  // framework no longer exists or in
-  // HierarchicalAllocatorProcess::reviveOffers) but not yet deleted (to
-  // keep the address from getting reused possibly causing premature
-  // expiration).
-  if (frameworks.contains(frameworkId) &&
-      frameworks[frameworkId].filters.contains(filter)) {
-    frameworks[frameworkId].filters.erase(filter);
+  CHECK(expirations.count(time));
+
+  foreach (const Expiration& expiration, expirations[time]) {
+    const FrameworkID& frameworkId = expiration.frameworkId;
+    const SlaveID& slaveId = expiration.slaveId;
+
+    // The filter might have already been removed (e.g., if the
+    // framework no longer exists or in
+    // HierarchicalAllocatorProcess::reviveOffers) but not yet deleted
+    // (to keep the address from getting reused possibly causing
+    // premature expiration).
+    if (frameworks.contains(frameworkId) &&
+        frameworks[frameworkId].filters.contains(slaveId)) {
+      hashset<Filter*>& filters = frameworks[frameworkId].filters[slaveId];
+
+      filters.erase(expiration.filter);
+
+      if (filters.empty()) {
+        frameworks[frameworkId].filters.erase(slaveId);
+      }
+    }
+
+    delete expiration.filter;
   }
 
-  delete filter;
+  expirations.erase(time);
 }
 
 
@@ -1002,15 +1786,29 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::isFiltered(
     return true;
   }
 
-  foreach (Filter* filter, frameworks[frameworkId].filters) {
+  // Only the filters for this slave need to be checked.
+  if (!frameworks[frameworkId].filters.contains(slaveId)) {
+    return false;
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  bool filtered = false;
+
+  foreach (Filter* filter, frameworks[frameworkId].filters[slaveId]) {
     if (filter->filter(slaveId, resources)) {
       VLOG(1) << "Filtered " << resources
               << " on slave " << slaveId
               << " for framework " << frameworkId;
-      return true;
+      filtered = true;
+      break;
     }
   }
-  return false;
+
+  filterCheckTime += stopwatch.elapsed();
+
+  return filtered;
 }
 
 
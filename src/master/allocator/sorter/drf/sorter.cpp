@@ -44,7 +44,7 @@ bool DRFComparator::operator () (const Client& client1, const Client& client2)
 void DRFSorter::add(const string& name, double weight)
 {
   Client client(name, 0, 0);
-  clients.insert(client);
+  index[name] = clients.insert(client).first;
 
   allocations[name] = Allocation();
   weights[name] = weight;
@@ -57,6 +57,7 @@ void DRFSorter::remove(const string& name)
 
   if (it != clients.end()) {
     clients.erase(it);
+    index.erase(name);
   }
 
   allocations.erase(name);
@@ -68,8 +69,10 @@ void DRFSorter::activate(const string& name)
 {
   CHECK(allocations.contains(name));
 
-  Client client(name, calculateShare(name), 0);
-  clients.insert(client);
+  if (!index.contains(name)) {
+    Client client(name, calculateShare(name), 0);
+    index[name] = clients.insert(client).first;
+  }
 }
 
 
@@ -83,6 +86,7 @@ void DRFSorter::deactivate(const string& name)
     // for this client which means the fairness can be gamed by a
     // framework disconnecting and reconnecting.
     clients.erase(it);
+    index.erase(name);
   }
 }
 
@@ -92,28 +96,30 @@ void DRFSorter::allocated(
     const SlaveID& slaveId,
     const Resources& resources)
 {
+  Allocation& allocation = allocations[name];
+
+  allocation.resources[slaveId] += resources;
+  allocation.scalars += resources.scalars();
+
+  updateQuantities(allocation.scalars, resources, &allocation.quantities);
+
   set<Client, DRFComparator>::iterator it = find(name);
 
   if (it != clients.end()) { // TODO(benh): This should really be a CHECK.
-    // TODO(benh): Refactor 'update' to be able to reuse it here.
     Client client(*it);
 
     // Update the 'allocations' to reflect the allocator decision.
     client.allocations++;
 
-    // Remove and reinsert it to update the ordering appropriately.
-    clients.erase(it);
-    clients.insert(client);
-  }
-
-  allocations[name].resources[slaveId] += resources;
-  allocations[name].scalars += resources.scalars();
+    // If the total resources have changed, we're going to
+    // recalculate all the shares, so don't bother just
+    // updating this client.
+    if (!dirty) {
+      client.share = calculateShare(name);
+    }
 
-  // If the total resources have changed, we're going to
-  // recalculate all the shares, so don't bother just
-  // updating this client.
-  if (!dirty) {
-    update(name);
+    // Reposition the client to update the ordering appropriately.
+    replace(it, client);
   }
 }
 
@@ -126,11 +132,6 @@ void DRFSorter::update(
 {
   CHECK(contains(name));
 
-  // TODO(bmahler): Check invariants between old and new allocations.
-  // Namely, the roles and quantities of resources should be the same!
-  // Otherwise, we need to ensure we re-calculate the shares, as
-  // is being currently done, for safety.
-
   CHECK(total.resources[slaveId].contains(oldAllocation));
   CHECK(total.scalars.contains(oldAllocation.scalars()));
 
@@ -140,17 +141,30 @@ void DRFSorter::update(
   total.scalars -= oldAllocation.scalars();
   total.scalars += newAllocation.scalars();
 
-  CHECK(allocations[name].resources[slaveId].contains(oldAllocation));
-  CHECK(allocations[name].scalars.contains(oldAllocation.scalars()));
+  Allocation& allocation = allocations[name];
+
+  CHECK(allocation.resources[slaveId].contains(oldAllocation));
+  CHECK(allocation.scalars.contains(oldAllocation.scalars()));
 
-  allocations[name].resources[slaveId] -= oldAllocation;
-  allocations[name].resources[slaveId] += newAllocation;
+  allocation.resources[slaveId] -= oldAllocation;
+  allocation.resources[slaveId] += newAllocation;
 
-  allocations[name].scalars -= oldAllocation.scalars();
-  allocations[name].scalars += newAllocation.scalars();
+  allocation.scalars -= oldAllocation.scalars();
+  allocation.scalars += newAllocation.scalars();
 
-  // Just assume the total has changed, per the TODO above.
-  dirty = true;
+  // NOTE: Offer operations usually preserve the quantities of the
+  // resources (e.g., reserving or creating a volume), in which case
+  // none of the shares change.
+  const Resources changed = oldAllocation + newAllocation;
+
+  if (updateQuantities(total.scalars, changed, &total.quantities)) {
+    dirty = true;
+  }
+
+  if (updateQuantities(allocation.scalars, changed, &allocation.quantities) &&
+      !dirty) {
+    update(name);
+  }
 }
 
 
@@ -179,13 +193,17 @@ void DRFSorter::unallocated(
     const SlaveID& slaveId,
     const Resources& resources)
 {
-  allocations[name].resources[slaveId] -= resources;
-  allocations[name].scalars -= resources.scalars();
+  Allocation& allocation = allocations[name];
+
+  allocation.resources[slaveId] -= resources;
+  allocation.scalars -= resources.scalars();
 
-  if (allocations[name].resources[slaveId].empty()) {
-    allocations[name].resources.erase(slaveId);
+  if (allocation.resources[slaveId].empty()) {
+    allocation.resources.erase(slaveId);
   }
 
+  updateQuantities(allocation.scalars, resources, &allocation.quantities);
+
   if (!dirty) {
     update(name);
   }
@@ -202,7 +220,9 @@ void DRFSorter::add(const SlaveID& slaveId, const Resources& resources)
     // change, but we put it off until sort is called so that if
     // something else changes before the next allocation we don't
     // recalculate everything twice.
-    dirty = true;
+    if (updateQuantities(total.scalars, resources, &total.quantities)) {
+      dirty = true;
+    }
   }
 }
 
@@ -219,7 +239,9 @@ void DRFSorter::remove(const SlaveID& slaveId, const Resources& resources)
       total.resources.erase(slaveId);
     }
 
-    dirty = true;
+    if (updateQuantities(total.scalars, resources, &total.quantities)) {
+      dirty = true;
+    }
   }
 }
 
@@ -228,6 +250,8 @@ void DRFSorter::update(const SlaveID& slaveId, const Resources& resources)
 {
   CHECK(total.scalars.contains(total.resources[slaveId].scalars()));
 
+  const Resources changed = total.resources[slaveId] + resources;
+
   total.scalars -= total.resources[slaveId].scalars();
   total.scalars += resources.scalars();
 
@@ -237,7 +261,9 @@ void DRFSorter::update(const SlaveID& slaveId, const Resources& resources)
     total.resources.erase(slaveId);
   }
 
-  dirty = true;
+  if (updateQuantities(total.scalars, changed, &total.quantities)) {
+    dirty = true;
+  }
 }
 
 
@@ -246,30 +272,38 @@ list<string> DRFSorter::sort()
   if (dirty) {
     set<Client, DRFComparator> temp;
 
-    set<Client, DRFComparator>::iterator it;
-    for (it = clients.begin(); it != clients.end(); it++) {
-      Client client(*it);
-
+    foreach (Client client, clients) {
       // Update the 'share' to get proper sorting.
       client.share = calculateShare(client.name);
 
-      temp.insert(client);
+      index[client.name] = temp.insert(client).first;
     }
 
-    clients = temp;
+    // NOTE: Swapping (unlike assigning) the sets keeps the iterators
+    // in 'index' valid.
+    clients.swap(temp);
+
+    dirty = false;
   }
 
   list<string> result;
 
-  set<Client, DRFComparator>::iterator it;
-  for (it = clients.begin(); it != clients.end(); it++) {
-    result.push_back((*it).name);
+  foreach (const Client& client, clients) {
+    result.push_back(client.name);
   }
 
   return result;
 }
 
 
+double DRFSorter::share(const string& name)
+{
+  CHECK(contains(name));
+
+  return calculateShare(name);
+}
+
+
 bool DRFSorter::contains(const string& name)
 {
   return allocations.contains(name);
@@ -292,9 +326,8 @@ void DRFSorter::update(const string& name)
     // Update the 'share' to get proper sorting.
     client.share = calculateShare(client.name);
 
-    // Remove and reinsert it to update the ordering appropriately.
-    clients.erase(it);
-    clients.insert(client);
+    // Reposition the client to update the ordering appropriately.
+    replace(it, client);
   }
 }
 
@@ -307,28 +340,15 @@ double DRFSorter::calculateShare(const string& name)
   // currently does not take into account resources that are not
   // scalars.
 
-  foreach (const string& scalar, total.scalars.names()) {
-    double _total = 0.0;
-
-    // NOTE: Scalar resources may be spread across multiple
-    // 'Resource' objects. E.g. persistent volumes.
-    foreach (const Resource& resource, total.scalars.get(scalar)) {
-      CHECK_EQ(resource.type(), Value::SCALAR);
-      _total += resource.scalar().value();
-    }
+  const hashmap<string, double>& allocation = allocations[name].quantities;
 
+  foreachpair (const string& scalar, double _total, total.quantities) {
     if (_total > 0.0) {
-      double allocation = 0.0;
-
-      // NOTE: Scalar resources may be spread across multiple
-      // 'Resource' objects. E.g. persistent volumes.
-      foreach (const Resource& resource,
-               allocations[name].scalars.get(scalar)) {
-        CHECK_EQ(resource.type(), Value::SCALAR);
-        allocation += resource.scalar().value();
-      }
+      hashmap<string, double>::const_iterator it = allocation.find(scalar);
 
-      share = std::max(share, allocation / _total);
+      if (it != allocation.end()) {
+        share = std::max(share, it->second / _total);
+      }
     }
   }
 
@@ -338,14 +358,48 @@ double DRFSorter::calculateShare(const string& name)
 
 set<Client, DRFComparator>::iterator DRFSorter::find(const string& name)
 {
-  set<Client, DRFComparator>::iterator it;
-  for (it = clients.begin(); it != clients.end(); it++) {
-    if (name == (*it).name) {
-      break;
+  if (!index.contains(name)) {
+    return clients.end();
+  }
+
+  return index[name];
+}
+
+
+void DRFSorter::replace(
+    set<Client, DRFComparator>::iterator it,
+    const Client& client)
+{
+  clients.erase(it);
+  index[client.name] = clients.insert(client).first;
+}
+
+
+bool DRFSorter::updateQuantities(
+    const Resources& scalars,
+    const Resources& changed,
+    hashmap<string, double>* quantities)
+{
+  bool updated = false;
+
+  foreach (const string& name, changed.names()) {
+    // NOTE: Scalar resources may be spread across multiple
+    // 'Resource' objects. E.g. persistent volumes.
+    Option<Value::Scalar> quantity = scalars.get<Value::Scalar>(name);
+
+    if (quantity.isNone()) {
+      if (quantities->contains(name)) {
+        quantities->erase(name);
+        updated = true;
+      }
+    } else if (!quantities->contains(name) ||
+               (*quantities)[name] != quantity.get().value()) {
+      (*quantities)[name] = quantity.get().value();
+      updated = true;
     }
   }
 
-  return it;
+  return updated;
 }
 
 } // namespace allocator {
@@ -63,6 +63,8 @@ struct DRFComparator
 class DRFSorter : public Sorter
 {
 public:
+  DRFSorter() : dirty(false) {}
+
   virtual ~DRFSorter() {}
 
   virtual void add(const std::string& name, double weight = 1);
@@ -101,6 +103,8 @@ public:
 
   virtual std::list<std::string> sort();
 
+  virtual double share(const std::string& name);
+
   virtual bool contains(const std::string& name);
 
   virtual int count();
@@ -117,12 +121,32 @@ private:
   // it exists in this Sorter.
   std::set<Client, DRFComparator>::iterator find(const std::string& name);
 
-  // If true, start() will recalculate all shares.
+  // Removes the client at the given position in 'clients' and
+  // inserts 'client' instead, keeping 'index' up to date.
+  void replace(
+      std::set<Client, DRFComparator>::iterator it,
+      const Client& client);
+
+  // Updates the cached 'quantities' of any of the resources named in
+  // 'changed' from 'scalars' and returns true if any of them changed.
+  static bool updateQuantities(
+      const Resources& scalars,
+      const Resources& changed,
+      hashmap<std::string, double>* quantities);
+
+  // If true, sort() will recalculate all shares. This is only the
+  // case if the total quantity of some scalar resource has changed,
+  // otherwise only the shares of clients whose allocation changed
+  // get recalculated, as they change.
   bool dirty;
 
   // A set of Clients (names and shares) sorted by share.
   std::set<Client, DRFComparator> clients;
 
+  // Maps client names to their positions in 'clients' so that a
+  // client can be repositioned without a linear search.
+  hashmap<std::string, std::set<Client, DRFComparator>::iterator> index;
+
   // Maps client names to the weights that should be applied to their shares.
   hashmap<std::string, double> weights;
 
@@ -134,6 +158,10 @@ private:
     // that to speed up the calculation of shares. See MESOS-2891 for
     // the reasons why we want to do that.
     Resources scalars;
+
+    // The total quantity of each kind of scalar resource (across all
+    // roles), which is all that is needed to calculate the shares.
+    hashmap<std::string, double> quantities;
   } total;
 
   // Allocation for a client.
@@ -142,6 +170,9 @@ private:
 
     // Similarly, we aggregated scalars across slaves. See note above.
     Resources scalars;
+
+    // Similarly, the quantity of each kind of scalar resource.
+    hashmap<std::string, double> quantities;
   };
 
   // Maps client names to the resources they have been allocated.
@@ -100,6 +100,10 @@ public:
   // should be allocated to, according to this Sorter's policy.
   virtual std::list<std::string> sort() = 0;
 
+  // Returns the current share of the client, i.e., the value that
+  // the clients are sorted by (in increasing order).
+  virtual double share(const std::string& client) = 0;
+
   // Returns true if this Sorter contains the specified client,
   // either active or deactivated.
   virtual bool contains(const std::string& client) = 0;
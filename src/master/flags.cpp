@@ -93,6 +93,17 @@ mesos::internal::master::Flags::Flags()
       "after which the operation is considered a failure.",
       Seconds(5));
 
+  add(&Flags::registry_deltas,
+      "registry_deltas",
+      "Whether to store only the changes made to the registry on most\n"
+      "updates, rather than the entire registry. This makes updates of\n"
+      "large registries cheaper, but masters without support for it\n"
+      "ignore those changes. Only enable this once all masters have been\n"
+      "upgraded, and disable it (and fail over) before downgrading.\n"
+      "A master with this disabled stores the entire registry on its\n"
+      "first update, including any changes stored before.",
+      false);
+
   add(&Flags::log_auto_initialize,
       "log_auto_initialize",
       "Whether to automatically initialize the replicated log used for the\n"
@@ -168,6 +179,36 @@ mesos::internal::master::Flags::Flags()
       " (batch) allocations (e.g., 500ms, 1sec, etc).",
       Seconds(1));
 
+  add(&Flags::allocation_shards,
+      "allocation_shards",
+      "Number of shards (each evaluated on its own thread) to split the\n"
+      "slaves into when performing batch allocations. With more than one\n"
+      "shard, candidate offers are picked in parallel against a snapshot\n"
+      "of the sorters and then merged in a deterministic order, see\n"
+      "'--allocation_fairness_tolerance'.\n"
+      "NOTE: This flag is *experimental*.",
+      1);
+
+  add(&Flags::allocation_fairness_tolerance,
+      "allocation_fairness_tolerance",
+      "When using more than one allocation shard, the amount by which the\n"
+      "(weighted) dominant share of a role, or of a framework within its\n"
+      "role, may exceed the lowest such share when a candidate offer\n"
+      "picked by a shard is merged. Candidates outside of this tolerance\n"
+      "are reallocated as they would be without sharding.",
+      0.05);
+
+  add(&Flags::allocation_quantum,
+      "allocation_quantum",
+      "If set, the resources of each slave are split across frameworks\n"
+      "instead of all being offered to a single framework: frameworks are\n"
+      "allocated this much at a time (e.g., 'cpus:1;mem:512'), in the\n"
+      "order of their (weighted) dominant shares. The remaining resources\n"
+      "are allocated as a whole once less than a quantum (or nothing\n"
+      "allocatable) would be left, which includes any resources that are\n"
+      "not named in the quantum (e.g., ports).\n"
+      "NOTE: This flag is *experimental*.");
+
   add(&Flags::cluster,
       "cluster",
       "Human readable name for the cluster,\n"
@@ -311,6 +352,18 @@ mesos::internal::master::Flags::Flags()
       "This helps fairness when running frameworks that hold on to offers,\n"
       "or frameworks that accidentally drop offers.");
 
+  add(&Flags::state_staleness,
+      "state_staleness",
+      "Maximum age of the state served by the '/state.json',\n"
+      "'/state-summary' and '/tasks.json' endpoints. Within this window\n"
+      "requests are answered from a previously rendered snapshot rather\n"
+      "than rendering the state on the master again, which reduces the\n"
+      "load that frequently polling clients put on large masters, at the\n"
+      "expense of clients possibly not observing their latest changes.\n"
+      "With 0secs the state is always rendered on the master, and\n"
+      "'/state.json' is streamed as it gets rendered.",
+      Seconds(0));
+
   // This help message for --modules flag is the same for
   // {master,slave,tests}/flags.hpp and should always be kept in
   // sync.
@@ -50,6 +50,7 @@ public:
   bool registry_strict;
   Duration registry_fetch_timeout;
   Duration registry_store_timeout;
+  bool registry_deltas;
   bool log_auto_initialize;
   Duration slave_reregister_timeout;
   std::string recovery_slave_removal_limit;
@@ -59,6 +60,9 @@ public:
   std::string user_sorter;
   std::string framework_sorter;
   Duration allocation_interval;
+  size_t allocation_shards;
+  double allocation_fairness_tolerance;
+  Option<std::string> allocation_quantum;
   Option<std::string> cluster;
   Option<std::string> roles;
   Option<std::string> weights;
@@ -69,6 +73,7 @@ public:
   Option<Firewall> firewall_rules;
   Option<RateLimits> rate_limits;
   Option<Duration> offer_timeout;
+  Duration state_staleness;
   Option<Modules> modules;
   std::string authenticators;
   std::string allocator;
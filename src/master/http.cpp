@@ -28,6 +28,8 @@
 
 #include <mesos/type_utils.hpp>
 
+#include <process/defer.hpp>
+#include <process/dispatch.hpp>
 #include <process/help.hpp>
 
 #include <process/metrics/metrics.hpp>
@@ -52,12 +54,14 @@
 #include "logging/logging.hpp"
 
 #include "master/master.hpp"
+#include "master/snapshot.hpp"
 
 #include "mesos/mesos.hpp"
 #include "mesos/resources.hpp"
 
 using process::Clock;
 using process::DESCRIPTION;
+using process::defer;
 using process::Future;
 using process::HELP;
 using process::TLDR;
@@ -125,96 +129,90 @@ JSON::Object summarize(const Framework& framework)
 }
 
 
-// Returns a JSON object modeled on a Framework.
-JSON::Object model(const Framework& framework)
+// Writes a JSON object modeled on a Framework. The tasks are written
+// one at a time since there can be a very large number of them.
+void json(JSON::Writer* writer, const Framework& framework)
 {
-  JSON::Object object = summarize(framework);
+  writer->beginObject();
+
+  foreachpair (const string& key,
+               const JSON::Value& value,
+               summarize(framework).values) {
+    writer->field(key, value);
+  }
 
   // Add additional fields to those generated by 'summarize'.
-  object.values["user"] = framework.info.user();
-  object.values["failover_timeout"] = framework.info.failover_timeout();
-  object.values["checkpoint"] = framework.info.checkpoint();
-  object.values["role"] = framework.info.role();
-  object.values["registered_time"] = framework.registeredTime.secs();
-  object.values["unregistered_time"] = framework.unregisteredTime.secs();
-  object.values["active"] = framework.active;
+  writer->field("user", framework.info.user());
+  writer->field("failover_timeout", framework.info.failover_timeout());
+  writer->field("checkpoint", framework.info.checkpoint());
+  writer->field("role", framework.info.role());
+  writer->field("registered_time", framework.registeredTime.secs());
+  writer->field("unregistered_time", framework.unregisteredTime.secs());
+  writer->field("active", framework.active);
 
   // TODO(bmahler): Consider deprecating this in favor of the split
   // used and offered resources added in 'summarize'.
-  object.values["resources"] =
-    model(framework.totalUsedResources + framework.totalOfferedResources);
+  writer->field(
+      "resources",
+      model(framework.totalUsedResources + framework.totalOfferedResources));
 
   // TODO(benh): Consider making reregisteredTime an Option.
   if (framework.registeredTime != framework.reregisteredTime) {
-    object.values["reregistered_time"] = framework.reregisteredTime.secs();
+    writer->field("reregistered_time", framework.reregisteredTime.secs());
   }
 
   // Model all of the tasks associated with a framework.
-  {
-    JSON::Array array;
-    array.values.reserve(
-        framework.pendingTasks.size() + framework.tasks.size()); // MESOS-2353.
-
-    foreachvalue (const TaskInfo& task, framework.pendingTasks) {
-      vector<TaskStatus> statuses;
-      array.values.push_back(
-          model(task, framework.id(), TASK_STAGING, statuses));
-    }
+  writer->key("tasks");
+  writer->beginArray();
 
-    foreachvalue (Task* task, framework.tasks) {
-      array.values.push_back(model(*task));
-    }
+  foreachvalue (const TaskInfo& task, framework.pendingTasks) {
+    vector<TaskStatus> statuses;
+    writer->value(model(task, framework.id(), TASK_STAGING, statuses));
+  }
 
-    object.values["tasks"] = std::move(array);
+  foreachvalue (Task* task, framework.tasks) {
+    writer->value(model(*task));
   }
 
-  // Model all of the completed tasks of a framework.
-  {
-    JSON::Array array;
-    array.values.reserve(framework.completedTasks.size()); // MESOS-2353.
+  writer->endArray();
 
-    foreach (const std::shared_ptr<Task>& task, framework.completedTasks) {
-      array.values.push_back(model(*task));
-    }
+  // Model all of the completed tasks of a framework.
+  writer->key("completed_tasks");
+  writer->beginArray();
 
-    object.values["completed_tasks"] = std::move(array);
+  foreach (const std::shared_ptr<Task>& task, framework.completedTasks) {
+    writer->value(model(*task));
   }
 
-  // Model all of the offers associated with a framework.
-  {
-    JSON::Array array;
-    array.values.reserve(framework.offers.size()); // MESOS-2353.
+  writer->endArray();
 
-    foreach (Offer* offer, framework.offers) {
-      array.values.push_back(model(*offer));
-    }
+  // Model all of the offers associated with a framework.
+  writer->key("offers");
+  writer->beginArray();
 
-    object.values["offers"] = std::move(array);
+  foreach (Offer* offer, framework.offers) {
+    writer->value(model(*offer));
   }
 
+  writer->endArray();
+
   // Model all of the executors of a framework.
-  {
-    JSON::Array executors;
-    int executorSize = 0;
-    foreachvalue (const auto& executorsMap,
-                  framework.executors) {
-      executorSize += executorsMap.size();
+  writer->key("executors");
+  writer->beginArray();
+
+  foreachpair (const SlaveID& slaveId,
+               const auto& executorsMap,
+               framework.executors) {
+    foreachvalue (const ExecutorInfo& executor, executorsMap) {
+      JSON::Object executorJson = model(executor);
+      executorJson.values["slave_id"] = slaveId.value();
+      writer->value(executorJson);
     }
-    executors.values.reserve(executorSize); // MESOS-2353
-    foreachpair (const SlaveID& slaveId,
-                 const auto& executorsMap,
-                 framework.executors) {
-      foreachvalue (const ExecutorInfo& executor, executorsMap) {
-        JSON::Object executorJson = model(executor);
-        executorJson.values["slave_id"] = slaveId.value();
-        executors.values.push_back(executorJson);
-      }
-    }
-
-    object.values["executors"] = std::move(executors);
   }
 
-  return object;
+  writer->endArray();
+
+  writer->endObject();
 }
 
 
@@ -480,50 +478,86 @@ const string Master::Http::STATE_HELP = HELP(
 
 Future<Response> Master::Http::state(const Request& request) const
 {
-  JSON::Object object;
-  object.values["version"] = MESOS_VERSION;
+  // NOTE: The state is written directly into the response as it gets
+  // modeled rather than building up a JSON::Object of the entire
+  // cluster first, which is expensive for large clusters.
+  if (master->flags.state_staleness == Duration::zero()) {
+    // No rendering can be reused, so stream the state right away
+    // rather than rendering it for the snapshot process.
+    return streamJSON(
+        lambda::bind(&Master::Http::_state, this, lambda::_1),
+        request.query.get("jsonp"));
+  }
+
+  // The snapshot process needs the whole rendering (e.g., for its
+  // ETag) but it serves (and reuses, see '--state_staleness') it
+  // without involving the master.
+  Http http = *this;
+
+  return dispatch(
+      master->snapshots,
+      &SnapshotProcess::get,
+      "state.json",
+      request,
+      defer(master->self(), [http]() -> string {
+        string body;
+
+        JSON::Writer writer([&body](const string& chunk) { body += chunk; });
+        http._state(&writer);
+        writer.flush();
+
+        return body;
+      }));
+}
+
+
+void Master::Http::_state(JSON::Writer* writer) const
+{
+  writer->beginObject();
+
+  writer->field("version", MESOS_VERSION);
 
   if (build::GIT_SHA.isSome()) {
-    object.values["git_sha"] = build::GIT_SHA.get();
+    writer->field("git_sha", build::GIT_SHA.get());
   }
 
   if (build::GIT_BRANCH.isSome()) {
-    object.values["git_branch"] = build::GIT_BRANCH.get();
+    writer->field("git_branch", build::GIT_BRANCH.get());
   }
 
   if (build::GIT_TAG.isSome()) {
-    object.values["git_tag"] = build::GIT_TAG.get();
+    writer->field("git_tag", build::GIT_TAG.get());
   }
 
-  object.values["build_date"] = build::DATE;
-  object.values["build_time"] = build::TIME;
-  object.values["build_user"] = build::USER;
-  object.values["start_time"] = master->startTime.secs();
+  writer->field("build_date", build::DATE);
+  writer->field("build_time", build::TIME);
+  writer->field("build_user", build::USER);
+  writer->field("start_time", master->startTime.secs());
 
   if (master->electedTime.isSome()) {
-    object.values["elected_time"] = master->electedTime.get().secs();
+    writer->field("elected_time", master->electedTime.get().secs());
   }
 
-  object.values["id"] = master->info().id();
-  object.values["pid"] = string(master->self());
-  object.values["hostname"] = master->info().hostname();
-  object.values["activated_slaves"] = master->_slaves_active();
-  object.values["deactivated_slaves"] = master->_slaves_inactive();
+  writer->field("id", master->info().id());
+  writer->field("pid", string(master->self()));
+  writer->field("hostname", master->info().hostname());
+  writer->field("activated_slaves", master->_slaves_active());
+  writer->field("deactivated_slaves", master->_slaves_inactive());
 
   if (master->flags.cluster.isSome()) {
-    object.values["cluster"] = master->flags.cluster.get();
+    writer->field("cluster", master->flags.cluster.get());
   }
 
   if (master->leader.isSome()) {
-    object.values["leader"] = master->leader.get().pid();
+    writer->field("leader", master->leader.get().pid());
   }
 
   if (master->flags.log_dir.isSome()) {
-    object.values["log_dir"] = master->flags.log_dir.get();
+    writer->field("log_dir", master->flags.log_dir.get());
   }
 
   if (master->flags.external_log_file.isSome()) {
-    object.values["external_log_file"] = master->flags.external_log_file.get();
+    writer->field("external_log_file", master->flags.external_log_file.get());
   }
 
   {
@@ -534,85 +568,77 @@ Future<Response> Master::Http::state(const Request& request) const
         flags.values[name] = value.get();
       }
     }
-    object.values["flags"] = std::move(flags);
+    writer->field("flags", flags);
   }
 
   // Model all of the slaves.
-  {
-    JSON::Array array;
-    array.values.reserve(master->slaves.registered.size()); // MESOS-2353.
+  writer->key("slaves");
+  writer->beginArray();
 
-    foreachvalue (Slave* slave, master->slaves.registered) {
-      array.values.push_back(model(*slave));
-    }
-
-    object.values["slaves"] = std::move(array);
+  foreachvalue (Slave* slave, master->slaves.registered) {
+    writer->value(model(*slave));
   }
 
-  // Model all of the frameworks.
-  {
-    JSON::Array array;
-    array.values.reserve(master->frameworks.registered.size()); // MESOS-2353.
+  writer->endArray();
 
-    foreachvalue (Framework* framework, master->frameworks.registered) {
-      array.values.push_back(model(*framework));
-    }
+  // Model all of the frameworks.
+  writer->key("frameworks");
+  writer->beginArray();
 
-    object.values["frameworks"] = std::move(array);
+  foreachvalue (Framework* framework, master->frameworks.registered) {
+    json(writer, *framework);
   }
 
-  // Model all of the completed frameworks.
-  {
-    JSON::Array array;
-    array.values.reserve(master->frameworks.completed.size()); // MESOS-2353.
+  writer->endArray();
 
-    foreach (const std::shared_ptr<Framework>& framework,
-             master->frameworks.completed) {
-      array.values.push_back(model(*framework));
-    }
+  // Model all of the completed frameworks.
+  writer->key("completed_frameworks");
+  writer->beginArray();
 
-    object.values["completed_frameworks"] = std::move(array);
+  foreach (const std::shared_ptr<Framework>& framework,
+           master->frameworks.completed) {
+    json(writer, *framework);
   }
 
-  // Model all of the orphan tasks.
-  {
-    JSON::Array array;
+  writer->endArray();
 
-    // Find those orphan tasks.
-    foreachvalue (const Slave* slave, master->slaves.registered) {
-      typedef hashmap<TaskID, Task*> TaskMap;
-      foreachvalue (const TaskMap& tasks, slave->tasks) {
-        foreachvalue (const Task* task, tasks) {
-          CHECK_NOTNULL(task);
-          if (!master->frameworks.registered.contains(task->framework_id())) {
-            array.values.push_back(model(*task));
-          }
+  // Model all of the orphan tasks.
+  writer->key("orphan_tasks");
+  writer->beginArray();
+
+  // Find those orphan tasks.
+  foreachvalue (const Slave* slave, master->slaves.registered) {
+    typedef hashmap<TaskID, Task*> TaskMap;
+    foreachvalue (const TaskMap& tasks, slave->tasks) {
+      foreachvalue (const Task* task, tasks) {
+        CHECK_NOTNULL(task);
+        if (!master->frameworks.registered.contains(task->framework_id())) {
+          writer->value(model(*task));
         }
       }
     }
-
-    object.values["orphan_tasks"] = std::move(array);
   }
 
+  writer->endArray();
+
   // Model all currently unregistered frameworks.
   // This could happen when the framework has yet to re-register
   // after master failover.
-  {
-    JSON::Array array;
-
-    // Find unregistered frameworks.
-    foreachvalue (const Slave* slave, master->slaves.registered) {
-      foreachkey (const FrameworkID& frameworkId, slave->tasks) {
-        if (!master->frameworks.registered.contains(frameworkId)) {
-          array.values.push_back(frameworkId.value());
-        }
+  writer->key("unregistered_frameworks");
+  writer->beginArray();
+
+  // Find unregistered frameworks.
+  foreachvalue (const Slave* slave, master->slaves.registered) {
+    foreachkey (const FrameworkID& frameworkId, slave->tasks) {
+      if (!master->frameworks.registered.contains(frameworkId)) {
+        writer->value(frameworkId.value());
       }
     }
-
-    object.values["unregistered_frameworks"] = std::move(array);
   }
 
-  return OK(object, request.query.get("jsonp"));
+  writer->endArray();
+
+  writer->endObject();
 }
 
 
@@ -773,6 +799,21 @@ const string Master::Http::STATESUMMARY_HELP = HELP(
 
 
 Future<Response> Master::Http::stateSummary(const Request& request) const
+{
+  Http http = *this;
+
+  return dispatch(
+      master->snapshots,
+      &SnapshotProcess::get,
+      "state-summary",
+      request,
+      defer(master->self(), [http]() -> string {
+        return stringify(http._stateSummary());
+      }));
+}
+
+
+JSON::Object Master::Http::_stateSummary() const
 {
   JSON::Object object;
 
@@ -876,7 +917,7 @@ Future<Response> Master::Http::stateSummary(const Request& request) const
     object.values["frameworks"] = std::move(array);
   }
 
-  return OK(object, request.query.get("jsonp"));
+  return object;
 }
 
 
@@ -1092,6 +1133,32 @@ Future<Response> Master::Http::tasks(const Request& request) const
   // TODO(nnielsen): Currently, formatting errors in offset and/or limit
   // will silently be ignored. This could be reported to the user instead.
 
+  Option<string> order = request.query.get("order");
+
+  // Renderings are reused only for identical list options.
+  const string key = "tasks.json?limit=" + stringify(limit) +
+    "&offset=" + stringify(offset) +
+    "&order=" + order.get("desc");
+
+  Http http = *this;
+
+  return dispatch(
+      master->snapshots,
+      &SnapshotProcess::get,
+      key,
+      request,
+      defer(master->self(), [=]() -> string {
+        return stringify(http._tasks(limit, offset, order));
+      }));
+}
+
+
+JSON::Object Master::Http::_tasks(
+    size_t limit,
+    size_t offset,
+    const Option<string>& order) const
+{
+
   // Construct framework list with both active and completed framwworks.
   vector<const Framework*> frameworks;
   foreachvalue (Framework* framework, master->frameworks.registered) {
@@ -1116,7 +1183,6 @@ Future<Response> Master::Http::tasks(const Request& request) const
 
   // Sort tasks by task status timestamp. Default order is descending.
   // The earliest timestamp is chosen for comparison when multiple are present.
-  Option<string> order = request.query.get("order");
   if (order.isSome() && (order.get() == "asc")) {
     sort(tasks.begin(), tasks.end(), TaskComparator::ascending);
   } else {
@@ -1136,7 +1202,7 @@ Future<Response> Master::Http::tasks(const Request& request) const
     object.values["tasks"] = std::move(array);
   }
 
-  return OK(object, request.query.get("jsonp"));
+  return object;
 }
 
 
@@ -25,6 +25,7 @@
 #include <vector>
 
 #include <mesos/mesos.hpp>
+#include <mesos/resources.hpp>
 
 #include <mesos/master/allocator.hpp>
 
@@ -34,6 +35,7 @@
 #include <process/owned.hpp>
 #include <process/pid.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/check.hpp>
 #include <stout/duration.hpp>
 #include <stout/exit.hpp>
@@ -80,9 +82,13 @@ using namespace mesos::internal::master;
 using namespace zookeeper;
 
 using mesos::MasterInfo;
+using mesos::Resources;
 
 using mesos::master::allocator::Allocator;
 
+using mesos::internal::master::allocator::HierarchicalDRFAllocator;
+using mesos::internal::master::allocator::HierarchicalDRFAllocatorProcess;
+
 using mesos::modules::Anonymous;
 using mesos::modules::ModuleManager;
 
@@ -190,9 +196,59 @@ int main(int argc, char** argv)
     LOG(INFO) << "Git SHA: " << build::GIT_SHA.get();
   }
 
-  // Create an instance of allocator.
+  if (flags.allocation_shards == 0) {
+    EXIT(EXIT_FAILURE) << "Expecting at least one '--allocation_shards'";
+  }
+
+  if (flags.allocation_fairness_tolerance < 0.0) {
+    EXIT(EXIT_FAILURE)
+      << "Expecting a non-negative '--allocation_fairness_tolerance'";
+  }
+
+  HierarchicalDRFAllocatorProcess::Options options;
+  options.shards = flags.allocation_shards;
+  options.fairnessTolerance = flags.allocation_fairness_tolerance;
+
+  if (flags.allocation_quantum.isSome()) {
+    Try<Resources> quantum = Resources::parse(flags.allocation_quantum.get());
+
+    if (quantum.isError()) {
+      EXIT(EXIT_FAILURE)
+        << "Failed to parse '--allocation_quantum': " << quantum.error();
+    }
+
+    Option<double> cpus = quantum.get().cpus();
+    Option<Bytes> mem = quantum.get().mem();
+
+    if ((cpus.isNone() || cpus.get() < MIN_CPUS) &&
+        (mem.isNone() || mem.get() < MIN_MEM)) {
+      EXIT(EXIT_FAILURE)
+        << "Expecting '--allocation_quantum' to include at least "
+        << MIN_CPUS << " cpus or " << MIN_MEM << " mem";
+    }
+
+    options.quantum = quantum.get();
+  }
+
+  // Create an instance of allocator. The default allocator is
+  // created directly so that it can be passed its options.
   const std::string allocatorName = flags.allocator;
-  Try<Allocator*> allocator = Allocator::create(allocatorName);
+
+  // Allocator modules are not passed these options, let the user
+  // know rather than silently ignoring them.
+  if (allocatorName != DEFAULT_ALLOCATOR &&
+      (options.shards != HierarchicalDRFAllocatorProcess::Options().shards ||
+       options.fairnessTolerance !=
+         HierarchicalDRFAllocatorProcess::Options().fairnessTolerance ||
+       options.quantum.isSome())) {
+    LOG(WARNING)
+      << "Ignoring '--allocation_shards', '--allocation_fairness_tolerance'"
+      << " and '--allocation_quantum' for the '" << allocatorName
+      << "' allocator";
+  }
+  Try<Allocator*> allocator = allocatorName == DEFAULT_ALLOCATOR
+    ? HierarchicalDRFAllocator::create(options)
+    : Allocator::create(allocatorName);
 
   if (allocator.isError()) {
     EXIT(EXIT_FAILURE)
@@ -79,6 +79,7 @@
 
 #include "master/flags.hpp"
 #include "master/master.hpp"
+#include "master/snapshot.hpp"
 
 #include "module/manager.hpp"
 
@@ -617,6 +618,9 @@ void Master::initialize()
       });
   spawn(whitelistWatcher);
 
+  snapshots = new SnapshotProcess(flags.state_staleness);
+  spawn(snapshots);
+
   nextFrameworkId = 0;
   nextSlaveId = 0;
   nextOfferId = 0;
@@ -932,6 +936,10 @@ void Master::finalize()
   wait(whitelistWatcher);
   delete whitelistWatcher;
 
+  terminate(snapshots);
+  wait(snapshots);
+  delete snapshots;
+
   if (authenticator.isSome()) {
     delete authenticator.get();
   }
@@ -50,6 +50,7 @@
 #include <stout/foreach.hpp>
 #include <stout/hashmap.hpp>
 #include <stout/hashset.hpp>
+#include <stout/json.hpp>
 #include <stout/multihashmap.hpp>
 #include <stout/option.hpp>
 
@@ -86,6 +87,7 @@ class WhitelistWatcher;
 namespace master {
 
 class Repairer;
+class SnapshotProcess;
 class SlaveObserver;
 
 struct BoundedRateLimiter;
@@ -1102,6 +1104,16 @@ private:
         const FrameworkID& id,
         bool authorized = true) const;
 
+    // Writes the body of /master/state.json.
+    void _state(JSON::Writer* writer) const;
+
+    JSON::Object _stateSummary() const;
+
+    JSON::Object _tasks(
+        size_t limit,
+        size_t offset,
+        const Option<std::string>& order) const;
+
     Master* master;
   };
 
@@ -1124,6 +1136,7 @@ private:
 
   mesos::master::allocator::Allocator* allocator;
   WhitelistWatcher* whitelistWatcher;
+  SnapshotProcess* snapshots;
   Registrar* registrar;
   Repairer* repairer;
   Files* files;
@@ -1394,24 +1407,23 @@ public:
   }
 
 protected:
-  virtual Try<bool> perform(
-      Registry* registry,
-      hashset<SlaveID>* slaveIDs,
+  virtual Result<Registry::Delta> perform(
+      const Registry& registry,
+      const hashset<SlaveID>& slaveIDs,
       bool strict)
   {
     // Check and see if this slave already exists.
-    if (slaveIDs->contains(info.id())) {
+    if (slaveIDs.contains(info.id())) {
       if (strict) {
         return Error("Slave already admitted");
       } else {
-        return false; // No mutation.
+        return None(); // No mutation.
       }
     }
 
-    Registry::Slave* slave = registry->mutable_slaves()->add_slaves();
-    slave->mutable_info()->CopyFrom(info);
-    slaveIDs->insert(info.id());
-    return true; // Mutation.
+    Registry::Delta delta;
+    delta.mutable_admitted()->CopyFrom(info);
+    return delta; // Mutation.
   }
 
 private:
@@ -1429,22 +1441,21 @@ public:
   }
 
 protected:
-  virtual Try<bool> perform(
-      Registry* registry,
-      hashset<SlaveID>* slaveIDs,
+  virtual Result<Registry::Delta> perform(
+      const Registry& registry,
+      const hashset<SlaveID>& slaveIDs,
       bool strict)
   {
-    if (slaveIDs->contains(info.id())) {
-      return false; // No mutation.
+    if (slaveIDs.contains(info.id())) {
+      return None(); // No mutation.
     }
 
     if (strict) {
       return Error("Slave not yet admitted");
     } else {
-      Registry::Slave* slave = registry->mutable_slaves()->add_slaves();
-      slave->mutable_info()->CopyFrom(info);
-      slaveIDs->insert(info.id());
-      return true; // Mutation.
+      Registry::Delta delta;
+      delta.mutable_admitted()->CopyFrom(info);
+      return delta; // Mutation.
     }
   }
 
@@ -1463,24 +1474,21 @@ public:
   }
 
 protected:
-  virtual Try<bool> perform(
-      Registry* registry,
-      hashset<SlaveID>* slaveIDs,
+  virtual Result<Registry::Delta> perform(
+      const Registry& registry,
+      const hashset<SlaveID>& slaveIDs,
       bool strict)
   {
-    for (int i = 0; i < registry->slaves().slaves().size(); i++) {
-      const Registry::Slave& slave = registry->slaves().slaves(i);
-      if (slave.info().id() == info.id()) {
-        registry->mutable_slaves()->mutable_slaves()->DeleteSubrange(i, 1);
-        slaveIDs->erase(info.id());
-        return true; // Mutation.
-      }
+    if (slaveIDs.contains(info.id())) {
+      Registry::Delta delta;
+      delta.mutable_removed()->CopyFrom(info.id());
+      return delta; // Mutation.
     }
 
     if (strict) {
       return Error("Slave not yet admitted");
     } else {
-      return false; // No mutation.
+      return None(); // No mutation.
     }
   }
 
@@ -16,6 +16,9 @@
  * limitations under the License.
  */
 
+#include <math.h>
+
+#include <algorithm>
 #include <deque>
 #include <string>
 
@@ -39,6 +42,7 @@
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
 #include <stout/protobuf.hpp>
+#include <stout/result.hpp>
 #include <stout/stopwatch.hpp>
 
 #include "master/registrar.hpp"
@@ -70,6 +74,7 @@ using process::metrics::Gauge;
 using process::metrics::Timer;
 
 using std::deque;
+using std::max;
 using std::string;
 
 namespace mesos {
@@ -114,13 +119,14 @@ private:
     explicit Recover(const MasterInfo& _info) : info(_info) {}
 
   protected:
-    virtual Try<bool> perform(
-        Registry* registry,
-        hashset<SlaveID>* slaveIDs,
+    virtual Result<Registry::Delta> perform(
+        const Registry& registry,
+        const hashset<SlaveID>& slaveIDs,
         bool strict)
     {
-      registry->mutable_master()->mutable_info()->CopyFrom(info);
-      return true; // Mutation.
+      Registry::Delta delta;
+      delta.mutable_master()->CopyFrom(info);
+      return delta; // Mutation.
     }
 
   private:
@@ -172,7 +178,7 @@ private:
   Future<double> _registry_size_bytes()
   {
     if (variable.isSome()) {
-      return variable.get().get().ByteSize();
+      return current.ByteSize();
     }
 
     return Failure("Not recovered yet");
@@ -182,22 +188,44 @@ private:
   void _recover(
       const MasterInfo& info,
       const Future<Variable<Registry> >& recovery);
-  void __recover(const Future<bool>& recover);
+  void __recover(
+      const MasterInfo& info,
+      const Future<Variable<Registry::Deltas> >& recovery);
+  void ___recover(const Future<bool>& recover);
   Future<bool> _apply(Owned<Operation> operation);
 
   // Helper for updating state (performing store).
   void update();
   void _update(
-      const Future<Option<Variable<Registry> > >& store,
+      const Future<bool>& store,
       deque<Owned<Operation> > operations);
 
+  // Helpers for storing either a snapshot of the entire registry or
+  // only the deltas since the last snapshot. Both return false on a
+  // version mismatch.
+  Future<bool> snapshot();
+  bool _snapshot(const Option<Variable<Registry> >& variable);
+  Future<bool> append(const Registry::Deltas& deltas);
+  bool _append(const Option<Variable<Registry::Deltas> >& variable);
+
   // Fails all pending operations and transitions the Registrar
   // into an error state in which all subsequent operations will fail.
   // This ensures we don't attempt to re-acquire log leadership by
   // performing more State storage operations.
   void abort(const string& message);
 
+  // The latest snapshot of the registry and the deltas recorded on
+  // top of it, as last stored (or, for the deltas, to be stored).
   Option<Variable<Registry> > variable;
+  Option<Variable<Registry::Deltas> > deltas;
+
+  // The current registry, i.e., the snapshot with all of the deltas
+  // applied, along with the IDs of its slaves. These are mutated in
+  // place by update() so that a batch of operations does not need to
+  // copy the entire registry.
+  Registry current;
+  hashset<SlaveID> slaveIDs;
+
   deque<Owned<Operation> > operations;
   bool updating; // Used to signify fetching (recovering) or storing.
 
@@ -239,12 +267,106 @@ void fail(deque<Owned<Operation> >* operations, const string& message)
 }
 
 
+// Helper for applying a delta on the registry and the 'slaveIDs'
+// accumulator, used both when performing operations and when
+// replaying the stored deltas during recovery.
+static Try<Nothing> mutate(
+    const Registry::Delta& delta,
+    Registry* registry,
+    hashset<SlaveID>* slaveIDs)
+{
+  if (delta.has_master()) {
+    registry->mutable_master()->mutable_info()->CopyFrom(delta.master());
+  } else if (delta.has_admitted()) {
+    const SlaveID& id = delta.admitted().id();
+
+    if (slaveIDs->contains(id)) {
+      return Error("Slave " + stringify(id) + " is already admitted");
+    }
+
+    Registry::Slave* slave = registry->mutable_slaves()->add_slaves();
+    slave->mutable_info()->CopyFrom(delta.admitted());
+    slaveIDs->insert(id);
+  } else if (delta.has_removed()) {
+    const SlaveID& id = delta.removed();
+
+    if (!slaveIDs->contains(id)) {
+      return Error("Slave " + stringify(id) + " is not admitted");
+    }
+
+    for (int i = 0; i < registry->slaves().slaves().size(); i++) {
+      if (registry->slaves().slaves(i).info().id() == id) {
+        registry->mutable_slaves()->mutable_slaves()->DeleteSubrange(i, 1);
+        break;
+      }
+    }
+
+    slaveIDs->erase(id);
+  } else {
+    return Error("Empty delta");
+  }
+
+  return Nothing();
+}
+
+
+// Returns whether the deltas should be compacted into a snapshot of
+// the registry rather than stored on their own. Every update stores
+// all of the deltas since the last snapshot, so snapshotting every
+// 'k' deltas costs about k/2 deltas plus n/k slaves per update for
+// a registry of 'n' slaves, which is minimized at k = sqrt(2n).
+// Without --registry_deltas every update is a snapshot, so that
+// masters which don't know about the deltas can read the registry.
+static bool compact(
+    const Flags& flags,
+    const Registry& registry,
+    const Registry::Deltas& deltas)
+{
+  if (!flags.registry_deltas) {
+    return true;
+  }
+
+  const double threshold =
+    max(16.0, sqrt(2.0 * registry.slaves().slaves().size()));
+
+  return deltas.deltas().size() >= threshold;
+}
+
+
+Try<bool> Operation::operator () (
+    Registry* registry,
+    hashset<SlaveID>* slaveIDs,
+    bool strict,
+    Registry::Deltas* deltas)
+{
+  const Result<Registry::Delta>& result =
+    perform(*registry, *slaveIDs, strict);
+
+  success = !result.isError();
+
+  if (result.isError()) {
+    return Error(result.error());
+  } else if (result.isNone()) {
+    return false; // No mutation.
+  }
+
+  Try<Nothing> mutation = mutate(result.get(), registry, slaveIDs);
+  if (mutation.isError()) {
+    success = false;
+    return Error(mutation.error());
+  }
+
+  deltas->add_deltas()->CopyFrom(result.get());
+  return true; // Mutation.
+}
+
+
 Future<Response> RegistrarProcess::registry(const Request& request)
 {
   JSON::Object result;
 
   if (variable.isSome()) {
-    result = JSON::Protobuf(variable.get().get());
+    result = JSON::Protobuf(current);
   }
 
   return OK(result, request.query.get("jsonp"));
@@ -332,6 +454,32 @@ Future<Registry> RegistrarProcess::recover(const MasterInfo& info)
 void RegistrarProcess::_recover(
     const MasterInfo& info,
     const Future<Variable<Registry> >& recovery)
+{
+  CHECK(!recovery.isPending());
+
+  if (!recovery.isReady()) {
+    updating = false;
+    recovered.get()->fail("Failed to recover registrar: " +
+        (recovery.isFailed() ? recovery.failure() : "discarded"));
+  } else {
+    // Save the snapshot and fetch the deltas stored on top of it.
+    variable = recovery.get();
+
+    state->fetch<Registry::Deltas>("registry_deltas")
+      .after(flags.registry_fetch_timeout,
+             lambda::bind(
+                 &timeout<Variable<Registry::Deltas> >,
+                 "fetch",
+                 flags.registry_fetch_timeout,
+                 lambda::_1))
+      .onAny(defer(self(), &Self::__recover, info, lambda::_1));
+  }
+}
+
+
+void RegistrarProcess::__recover(
+    const MasterInfo& info,
+    const Future<Variable<Registry::Deltas> >& recovery)
 {
   updating = false;
 
@@ -340,28 +488,67 @@ void RegistrarProcess::_recover(
   if (!recovery.isReady()) {
     recovered.get()->fail("Failed to recover registrar: " +
         (recovery.isFailed() ? recovery.failure() : "discarded"));
-  } else {
-    Duration elapsed = metrics.state_fetch.stop();
+    return;
+  }
 
-    LOG(INFO) << "Successfully fetched the registry"
-              << " (" << Bytes(recovery.get().get().ByteSize()) << ")"
-              << " in " << elapsed;
+  Duration elapsed = metrics.state_fetch.stop();
 
-    // Save the registry.
-    variable = recovery.get();
+  CHECK_SOME(variable);
+  current = variable.get().get();
 
-    // Perform the Recover operation to add the new MasterInfo.
-    Owned<Operation> operation(new Recover(info));
-    operations.push_back(operation);
-    operation->future()
-      .onAny(defer(self(), &Self::__recover, lambda::_1));
+  foreach (const Registry::Slave& slave, current.slaves().slaves()) {
+    slaveIDs.insert(slave.info().id());
+  }
 
-    update();
+  const Registry::Deltas stored = recovery.get().get();
+  const uint64_t sequence = current.sequence();
+
+  if (stored.base() > sequence) {
+    recovered.get()->fail("Failed to recover registrar: "
+        "Deltas with base " + stringify(stored.base()) +
+        " do not follow the snapshot with sequence " +
+        stringify(sequence));
+    return;
   }
+
+  // Replay the deltas that were not yet compacted into the snapshot
+  // (a snapshot is stored without clearing the deltas it contains).
+  Registry::Deltas live;
+  live.set_base(sequence);
+
+  for (int i = sequence - stored.base(); i < stored.deltas().size(); i++) {
+    Try<Nothing> mutation = mutate(stored.deltas(i), &current, &slaveIDs);
+    if (mutation.isError()) {
+      recovered.get()->fail("Failed to recover registrar: "
+          "Failed to replay delta " + stringify(stored.base() + i + 1) +
+          ": " + mutation.error());
+      return;
+    }
+
+    live.add_deltas()->CopyFrom(stored.deltas(i));
+  }
+
+  current.set_sequence(live.base() + live.deltas().size());
+
+  deltas = recovery.get().mutate(live);
+
+  LOG(INFO) << "Successfully fetched the registry"
+            << " (" << Bytes(variable.get().get().ByteSize()) << ")"
+            << " and " << live.deltas().size() << " deltas"
+            << " (" << Bytes(live.ByteSize()) << ")"
+            << " in " << elapsed;
+
+  // Perform the Recover operation to add the new MasterInfo.
+  Owned<Operation> operation(new Recover(info));
+  operations.push_back(operation);
+  operation->future()
+    .onAny(defer(self(), &Self::___recover, lambda::_1));
+
+  update();
 }
 
 
-void RegistrarProcess::__recover(const Future<bool>& recover)
+void RegistrarProcess::___recover(const Future<bool>& recover)
 {
   CHECK(!recover.isPending());
 
@@ -375,11 +562,11 @@ void RegistrarProcess::__recover(const Future<bool>& recover)
   } else {
     LOG(INFO) << "Successfully recovered registrar";
 
-    // At this point _update() has updated 'variable' to contain
-    // the Registry with the latest MasterInfo.
+    // At this point _update() has updated 'current' to contain
+    // the latest MasterInfo.
     // Set the promise and un-gate any pending operations.
     CHECK_SOME(variable);
-    recovered.get()->set(variable.get().get());
+    recovered.get()->set(current);
   }
 }
 
@@ -421,6 +608,7 @@ void RegistrarProcess::update()
   CHECK(!updating);
   CHECK_NONE(error);
   CHECK_SOME(variable);
+  CHECK_SOME(deltas);
 
   // Time how long it takes to apply the operations.
   Stopwatch stopwatch;
@@ -428,29 +616,33 @@ void RegistrarProcess::update()
 
   updating = true;
 
-  // Create a snapshot of the current registry.
-  Registry registry = variable.get().get();
-
-  // Create the 'slaveIDs' accumulator.
-  hashset<SlaveID> slaveIDs;
-  foreach (const Registry::Slave& slave, registry.slaves().slaves()) {
-    slaveIDs.insert(slave.info().id());
-  }
+  // Apply the operations, recording their mutations as deltas on
+  // top of those stored since the last snapshot. Note that if the
+  // store fails the registrar aborts, so there is no need to keep a
+  // copy of the registry to roll back to.
+  Registry::Deltas pending = deltas.get().get();
 
   foreach (Owned<Operation> operation, operations) {
     // No need to process the result of the operation.
-    (*operation)(&registry, &slaveIDs, flags.registry_strict);
+    (*operation)(&current, &slaveIDs, flags.registry_strict, &pending);
   }
 
+  current.set_sequence(pending.base() + pending.deltas().size());
+
+  const bool snapshotting = compact(flags, current, pending);
+
   LOG(INFO) << "Applied " << operations.size() << " operations in "
-            << stopwatch.elapsed() << "; attempting to update the 'registry'";
+            << stopwatch.elapsed() << "; attempting to update the 'registry'"
+            << (snapshotting
+                ? " (snapshot)"
+                : " (" + stringify(pending.deltas().size()) + " deltas)");
 
   // Perform the store, and time the operation.
   metrics.state_store.start();
-  state->store(variable.get().mutate(registry))
+  (snapshotting ? snapshot() : append(pending))
     .after(flags.registry_store_timeout,
            lambda::bind(
-               &timeout<Option<Variable<Registry> > >,
+               &timeout<bool>,
                "store",
                flags.registry_store_timeout,
                lambda::_1))
@@ -462,13 +654,13 @@ void RegistrarProcess::update()
 
 
 void RegistrarProcess::_update(
-    const Future<Option<Variable<Registry> > >& store,
+    const Future<bool>& store,
     deque<Owned<Operation> > applied)
 {
   updating = false;
 
   // Abort if the storage operation did not succeed.
-  if (!store.isReady() || store.get().isNone()) {
+  if (!store.isReady() || !store.get()) {
     string message = "Failed to update 'registry': ";
 
     if (store.isFailed()) {
@@ -489,8 +681,6 @@ void RegistrarProcess::_update(
 
   LOG(INFO) << "Successfully updated the 'registry' in " << elapsed;
 
-  variable = store.get().get();
-
   // Remove the operations.
   while (!applied.empty()) {
     Owned<Operation> operation = applied.front();
@@ -505,6 +695,52 @@ void RegistrarProcess::_update(
 }
 
 
+Future<bool> RegistrarProcess::snapshot()
+{
+  return state->store(variable.get().mutate(current))
+    .then(defer(self(), &Self::_snapshot, lambda::_1));
+}
+
+
+bool RegistrarProcess::_snapshot(const Option<Variable<Registry> >& stored)
+{
+  if (stored.isNone()) {
+    return false; // Version mismatch.
+  }
+
+  variable = stored.get();
+
+  // The deltas are now part of the snapshot. We don't bother storing
+  // the (now empty) deltas here: the stale ones get skipped during
+  // recovery and are overwritten by the next update.
+  Registry::Deltas empty;
+  empty.set_base(current.sequence());
+  deltas = deltas.get().mutate(empty);
+
+  return true;
+}
+
+
+Future<bool> RegistrarProcess::append(const Registry::Deltas& pending)
+{
+  return state->store(deltas.get().mutate(pending))
+    .then(defer(self(), &Self::_append, lambda::_1));
+}
+
+
+bool RegistrarProcess::_append(
+    const Option<Variable<Registry::Deltas> >& stored)
+{
+  if (stored.isNone()) {
+    return false; // Version mismatch.
+  }
+
+  deltas = stored.get();
+
+  return true;
+}
+
+
 void RegistrarProcess::abort(const string& message)
 {
   error = Error(message);
@@ -22,6 +22,8 @@
 #include <mesos/mesos.hpp>
 
 #include <stout/hashset.hpp>
+#include <stout/result.hpp>
+#include <stout/try.hpp>
 
 #include <process/future.hpp>
 #include <process/owned.hpp>
@@ -50,28 +52,27 @@ public:
   virtual ~Operation() {}
 
   // Attempts to invoke the operation on 'registry' (and the
-  // accumulators, in this case 'slaveIDs').
+  // accumulators, in this case 'slaveIDs'). The mutation, if any, is
+  // also appended to 'deltas' so that it can be persisted without
+  // storing the entire 'registry'.
   // Returns whether the operation mutates 'registry', or an error if
   // the operation cannot be applied successfully.
   Try<bool> operator () (
       Registry* registry,
       hashset<SlaveID>* slaveIDs,
-      bool strict)
-  {
-    const Try<bool>& result = perform(registry, slaveIDs, strict);
-
-    success = !result.isError();
-
-    return result;
-  }
+      bool strict,
+      Registry::Deltas* deltas);
 
   // Sets the promise based on whether the operation was successful.
   bool set() { return process::Promise<bool>::set(success); }
 
 protected:
-  virtual Try<bool> perform(
-      Registry* registry,
-      hashset<SlaveID>* slaveIDs,
+  // Returns the mutation to apply on 'registry', None if the
+  // operation does not mutate it, or an error if the operation
+  // cannot be applied successfully.
+  virtual Result<Registry::Delta> perform(
+      const Registry& registry,
+      const hashset<SlaveID>& slaveIDs,
       bool strict) = 0;
 
 private:
@@ -0,0 +1,162 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <vector>
+
+#include <process/clock.hpp>
+#include <process/defer.hpp>
+
+#include <stout/foreach.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+#include <stout/uuid.hpp>
+
+#include "master/snapshot.hpp"
+
+using process::Clock;
+using process::Future;
+using process::Time;
+
+using process::http::NotModified;
+using process::http::OK;
+using process::http::Request;
+using process::http::Response;
+
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+SnapshotProcess::SnapshotProcess(const Duration& _staleness)
+  : ProcessBase(process::ID::generate("snapshot")),
+    staleness(_staleness),
+    epoch(UUID::random().toString()),
+    renderings(0) {}
+
+
+Future<Response> SnapshotProcess::get(
+    const string& key,
+    const Request& request,
+    const lambda::function<Future<string>()>& generate)
+{
+  const Time now = Clock::now();
+
+  if (snapshots.contains(key) && now - snapshots[key].time < staleness) {
+    return respond(snapshots[key], request);
+  }
+
+  Future<Snapshot> snapshot;
+
+  // A request must never observe state from before it was received
+  // unless some staleness is tolerated, so we only share renderings
+  // that are already in progress if there is a staleness bound.
+  if (staleness > Duration::zero() && pending.contains(key)) {
+    snapshot = pending[key];
+  } else {
+    snapshot = generate()
+      .then(defer(self(), &Self::_get, key, now, lambda::_1));
+
+    if (staleness > Duration::zero()) {
+      pending[key] = snapshot;
+
+      snapshot.onAny(defer(self(), [this, key](const Future<Snapshot>&) {
+        pending.erase(key);
+      }));
+    }
+  }
+
+  return snapshot.then(lambda::bind(&Self::respond, lambda::_1, request));
+}
+
+
+SnapshotProcess::Snapshot SnapshotProcess::_get(
+    const string& key,
+    const Time& time,
+    const string& body)
+{
+  Snapshot snapshot;
+  snapshot.time = time;
+  snapshot.etag = "\"" + epoch + "-" + stringify(++renderings) + "\"";
+  snapshot.body = std::make_shared<const string>(body);
+
+  // Drop any snapshots that can no longer be served, otherwise
+  // requests with distinct query parameters (e.g., '/tasks.json' with
+  // different offsets) would accumulate indefinitely.
+  const Time now = Clock::now();
+
+  vector<string> expired;
+  foreachpair (const string& stored, const Snapshot& candidate, snapshots) {
+    if (now - candidate.time >= staleness) {
+      expired.push_back(stored);
+    }
+  }
+
+  foreach (const string& stored, expired) {
+    snapshots.erase(stored);
+  }
+
+  if (now - time < staleness) {
+    snapshots[key] = snapshot;
+  }
+
+  return snapshot;
+}
+
+
+Response SnapshotProcess::respond(
+    const Snapshot& snapshot,
+    const Request& request)
+{
+  // JSONP responses are not cached by browsers based on validators
+  // so we don't bother with ETags for them.
+  Option<string> jsonp = request.query.get("jsonp");
+  if (jsonp.isSome()) {
+    OK response(jsonp.get() + "(" + *snapshot.body + ");");
+    response.headers["Content-Type"] = "text/javascript";
+    return response;
+  }
+
+  Option<string> match = request.headers.get("If-None-Match");
+  if (match.isSome()) {
+    foreach (string tag, strings::tokenize(match.get(), ", ")) {
+      // 'If-None-Match' uses the weak comparison function, i.e., the
+      // "W/" prefix of a weak validator is ignored.
+      if (strings::startsWith(tag, "W/")) {
+        tag = tag.substr(2);
+      }
+
+      if (tag == "*" || tag == snapshot.etag) {
+        NotModified response;
+        response.headers["ETag"] = snapshot.etag;
+        return response;
+      }
+    }
+  }
+
+  OK response(*snapshot.body);
+  response.headers["Content-Type"] = "application/json";
+  response.headers["ETag"] = snapshot.etag;
+  return response;
+}
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,107 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MASTER_SNAPSHOT_HPP__
+#define __MASTER_SNAPSHOT_HPP__
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include <process/future.hpp>
+#include <process/http.hpp>
+#include <process/process.hpp>
+#include <process/time.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/lambda.hpp>
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+// Serves rendered snapshots of the master's state endpoints (e.g.,
+// '/state.json') from outside of the master actor. A snapshot is
+// rendered by invoking the 'generate' function provided with each
+// request (which is expected to defer to the master) and may then be
+// reused for subsequent requests for up to 'staleness', so that a
+// burst of polling clients costs the master at most one rendering
+// per staleness window. Concurrent requests that miss the cache
+// share a single rendering.
+//
+// NOTE: Only serving the snapshots happens outside of the master,
+// the rendering itself still runs on (and stalls) the master actor,
+// so a request that misses the cache delays the master as before.
+//
+// Every rendering gets a distinct ETag, and requests whose
+// 'If-None-Match' header matches the snapshot they are served get
+// back a '304 Not Modified' without a body.
+class SnapshotProcess : public process::Process<SnapshotProcess>
+{
+public:
+  explicit SnapshotProcess(const Duration& staleness);
+
+  // Responds to 'request' with the snapshot stored under 'key'
+  // (which should include any query parameters that affect the
+  // rendering), using 'generate' to render a new one if the stored
+  // snapshot is older than the staleness bound.
+  process::Future<process::http::Response> get(
+      const std::string& key,
+      const process::http::Request& request,
+      const lambda::function<process::Future<std::string>()>& generate);
+
+private:
+  // The body is shared between the stored snapshot and the
+  // responses in progress so that it only gets copied into responses.
+  struct Snapshot
+  {
+    process::Time time;
+    std::shared_ptr<const std::string> body;
+    std::string etag;
+  };
+
+  Snapshot _get(
+      const std::string& key,
+      const process::Time& time,
+      const std::string& body);
+
+  static process::http::Response respond(
+      const Snapshot& snapshot,
+      const process::http::Request& request);
+
+  const Duration staleness;
+
+  // ETags are made up of this (random) prefix and the number of
+  // renderings so far, so that they also differ from those handed
+  // out by previous instances, e.g., before a master failover.
+  const std::string epoch;
+  uint64_t renderings;
+
+  hashmap<std::string, Snapshot> snapshots;
+
+  // Renderings in progress, keyed like 'snapshots'.
+  hashmap<std::string, process::Future<Snapshot>> pending;
+};
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __MASTER_SNAPSHOT_HPP__
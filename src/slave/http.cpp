@@ -210,57 +210,72 @@ const string Slave::Http::STATE_HELP = HELP(
 
 Future<Response> Slave::Http::state(const Request& request) const
 {
-  JSON::Object object;
-  object.values["version"] = MESOS_VERSION;
+  return streamJSON(
+      lambda::bind(&Slave::Http::_state, this, lambda::_1),
+      request.query.get("jsonp"));
+}
+
+
+void Slave::Http::_state(JSON::Writer* writer) const
+{
+  writer->beginObject();
+
+  writer->field("version", MESOS_VERSION);
 
   if (build::GIT_SHA.isSome()) {
-    object.values["git_sha"] = build::GIT_SHA.get();
+    writer->field("git_sha", build::GIT_SHA.get());
   }
 
   if (build::GIT_BRANCH.isSome()) {
-    object.values["git_branch"] = build::GIT_BRANCH.get();
+    writer->field("git_branch", build::GIT_BRANCH.get());
   }
 
   if (build::GIT_TAG.isSome()) {
-    object.values["git_tag"] = build::GIT_TAG.get();
+    writer->field("git_tag", build::GIT_TAG.get());
   }
 
-  object.values["build_date"] = build::DATE;
-  object.values["build_time"] = build::TIME;
-  object.values["build_user"] = build::USER;
-  object.values["start_time"] = slave->startTime.secs();
-  object.values["id"] = slave->info.id().value();
-  object.values["pid"] = string(slave->self());
-  object.values["hostname"] = slave->info.hostname();
-  object.values["resources"] = model(slave->info.resources());
-  object.values["attributes"] = model(slave->info.attributes());
+  writer->field("build_date", build::DATE);
+  writer->field("build_time", build::TIME);
+  writer->field("build_user", build::USER);
+  writer->field("start_time", slave->startTime.secs());
+  writer->field("id", slave->info.id().value());
+  writer->field("pid", string(slave->self()));
+  writer->field("hostname", slave->info.hostname());
+  writer->field("resources", model(slave->info.resources()));
+  writer->field("attributes", model(slave->info.attributes()));
 
   if (slave->master.isSome()) {
     Try<string> hostname = net::getHostname(slave->master.get().address.ip);
     if (hostname.isSome()) {
-      object.values["master_hostname"] = hostname.get();
+      writer->field("master_hostname", hostname.get());
     }
   }
 
   if (slave->flags.log_dir.isSome()) {
-    object.values["log_dir"] = slave->flags.log_dir.get();
+    writer->field("log_dir", slave->flags.log_dir.get());
   }
 
   if (slave->flags.external_log_file.isSome()) {
-    object.values["external_log_file"] = slave->flags.external_log_file.get();
+    writer->field("external_log_file", slave->flags.external_log_file.get());
   }
 
-  JSON::Array frameworks;
+  writer->key("frameworks");
+  writer->beginArray();
+
   foreachvalue (Framework* framework, slave->frameworks) {
-    frameworks.values.push_back(model(*framework));
+    writer->value(model(*framework));
   }
-  object.values["frameworks"] = frameworks;
 
-  JSON::Array completedFrameworks;
+  writer->endArray();
+
+  writer->key("completed_frameworks");
+  writer->beginArray();
+
   foreach (const Owned<Framework>& framework, slave->completedFrameworks) {
-    completedFrameworks.values.push_back(model(*framework));
+    writer->value(model(*framework));
   }
-  object.values["completed_frameworks"] = completedFrameworks;
+
+  writer->endArray();
 
   JSON::Object flags;
   foreachpair (const string& name, const flags::Flag& flag, slave->flags) {
@@ -269,9 +284,9 @@ Future<Response> Slave::Http::state(const Request& request) const
       flags.values[name] = value.get();
     }
   }
-  object.values["flags"] = flags;
+  writer->field("flags", flags);
 
-  return OK(object, request.query.get("jsonp"));
+  writer->endObject();
 }
 
 } // namespace slave {
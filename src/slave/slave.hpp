@@ -46,6 +46,7 @@
 #include <stout/linkedhashmap.hpp>
 #include <stout/hashmap.hpp>
 #include <stout/hashset.hpp>
+#include <stout/json.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
 #include <stout/path.hpp>
@@ -405,6 +406,9 @@ private:
     static const std::string STATE_HELP;
 
   private:
+    // Writes the body of /slave/state.json.
+    void _state(JSON::Writer* writer) const;
+
     Slave* slave;
   };
 
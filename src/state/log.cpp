@@ -20,9 +20,11 @@
 #include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
 #include <stout/svn.hpp>
+#include <stout/unreachable.hpp>
 #include <stout/uuid.hpp>
 
 #include "log/log.hpp"
@@ -41,6 +43,15 @@ namespace mesos {
 namespace internal {
 namespace state {
 
+// Once the log (from its oldest necessary snapshot to its end) grows
+// beyond both this size and twice the size of all of the entries, the
+// oldest snapshots get relocated to the end of the log so that it can
+// be truncated. This bounds the size of the log, and therefore the
+// time it takes to recover it, by the size of the state itself.
+static const Bytes RELOCATION_MINIMUM = Megabytes(1);
+static const size_t RELOCATION_FACTOR = 2;
+
+
 // A storage implementation for State that uses the replicated
 // log. The log is made up of appended operations. Each state entry is
 // mapped to a log "snapshot".
@@ -90,6 +101,14 @@ private:
       const Log::Position& minimum,
       const Option<Log::Position>& position);
 
+  // Helper for relocating a snapshot to the end of the log (as part
+  // of truncation) so that it no longer holds back truncation.
+  Future<Nothing> relocate(const string& name);
+  Future<Nothing> _relocate(
+      const string& name,
+      size_t size,
+      const Option<Log::Position>& position);
+
   // Continuations.
   Future<Option<state::Entry> > _get(const string& name);
 
@@ -98,12 +117,14 @@ private:
   Future<bool> ___set(
       const state::Entry& entry,
       size_t diff,
+      size_t size,
       Option<Log::Position> position);
 
   Future<bool> _expunge(const state::Entry& entry);
   Future<bool> __expunge(const state::Entry& entry);
   Future<bool> ___expunge(
       const state::Entry& entry,
+      size_t size,
       const Option<Log::Position>& position);
 
   Future<std::set<string> > _names();
@@ -114,6 +135,11 @@ private:
   const size_t diffsBetweenSnapshots;
 
   // Used to serialize Log::Writer::append/truncate operations.
+  // NOTE: This keeps at most one append in flight, so LogStorage
+  // (and hence the registrar) doesn't benefit from the coordinator
+  // pipelining appends. Doing so would require issuing appends for
+  // different entries concurrently while still ordering those of the
+  // same entry, including the relocations done when truncating.
   Mutex mutex;
 
   // Whether or not we've started the ability to append to log.
@@ -125,6 +151,11 @@ private:
   // Last position in the log up to which we've truncated.
   Option<Log::Position> truncated;
 
+  // Total size of the entries we've read or written, used to
+  // determine the offset of each snapshot (and the end of the log)
+  // in bytes since positions can't be compared by distance.
+  uint64_t written;
+
   // Note that while it would be nice to just use Operation::Snapshot
   // modified to include a required field called 'position' we don't
   // know the position (nor can we determine it) before we've done the
@@ -132,9 +163,11 @@ private:
   struct Snapshot
   {
     Snapshot(const Log::Position& position,
+             uint64_t offset,
              const state::Entry& entry,
              size_t diffs = 0)
       : position(position),
+        offset(offset),
         entry(entry),
         diffs(diffs) {}
 
@@ -156,7 +189,7 @@ private:
       Entry entry(diff.entry());
       entry.set_value(patch.get());
 
-      return Snapshot(position, entry, diffs + 1);
+      return Snapshot(position, offset, entry, diffs + 1);
     }
 
     // Position in the log where this snapshot is located. NOTE: if
@@ -164,6 +197,11 @@ private:
     // the snapshot, not the last DIFF record in the log.
     const Log::Position position;
 
+    // Offset of 'position' in terms of 'written', used to determine
+    // how much of the log this snapshot is holding back from being
+    // truncated.
+    const uint64_t offset;
+
     // TODO(benh): Rather than storing the entire state::Entry we
     // should just store the position, name, and UUID and cache the
     // data so we don't use too much memory.
@@ -201,7 +239,8 @@ private:
 LogStorageProcess::LogStorageProcess(Log* log, size_t diffsBetweenSnapshots)
   : reader(log),
     writer(log),
-    diffsBetweenSnapshots(diffsBetweenSnapshots) {}
+    diffsBetweenSnapshots(diffsBetweenSnapshots),
+    written(0) {}
 
 
 LogStorageProcess::~LogStorageProcess() {}
@@ -286,63 +325,134 @@ Future<Nothing> LogStorageProcess::apply(const list<Log::Entry>& entries)
 {
   VLOG(2) << "Applying operations (" << entries.size() << " entries)";
 
-  // Only read and apply entries past our index.
+  // An operation (from an entry past our index) that needs applying.
+  struct Pending
+  {
+    Log::Position position;
+    uint64_t offset;
+    Operation operation;
+  };
+
+  // Determine where the entries past our index end (in bytes).
+  uint64_t offset = written;
+
   foreach (const Log::Entry& entry, entries) {
     if (index.isNone() || index.get() < entry.position) {
-      // Parse the Operation from the Log::Entry.
-      Operation operation;
+      offset += entry.data.size();
+    }
+  }
 
-      google::protobuf::io::ArrayInputStream stream(
-          entry.data.data(),
-          entry.data.size());
+  const uint64_t end = offset;
+
+  // Walk the entries backwards so that we can skip every operation
+  // on a variable that gets overwritten by a later SNAPSHOT or
+  // EXPUNGE. This way only the latest snapshot of each variable (and
+  // the diffs on top of it) are patched and kept around, instead of
+  // replaying the history of every variable in the log.
+  hashset<string> overwritten;
+  list<Pending> pending;
+  Option<Log::Position> last = None();
+
+  for (list<Log::Entry>::const_reverse_iterator iterator = entries.rbegin();
+       iterator != entries.rend();
+       ++iterator) {
+    const Log::Entry& entry = *iterator;
+
+    // Only read and apply entries past our index.
+    if (index.isSome() && entry.position <= index.get()) {
+      continue;
+    }
 
-      if (!operation.ParseFromZeroCopyStream(&stream)) {
-        return Failure("Failed to deserialize Operation");
-      }
+    offset -= entry.data.size();
+    last = max(last, entry.position);
 
-      switch (operation.type()) {
-        case Operation::SNAPSHOT: {
-          CHECK(operation.has_snapshot());
+    // Parse the Operation from the Log::Entry.
+    Operation operation;
 
-          // Add or update (override) the snapshot.
-          Snapshot snapshot(entry.position, operation.snapshot().entry());
-          snapshots.put(snapshot.entry.name(), snapshot);
-          break;
-        }
+    google::protobuf::io::ArrayInputStream stream(
+        entry.data.data(),
+        entry.data.size());
+
+    if (!operation.ParseFromZeroCopyStream(&stream)) {
+      return Failure("Failed to deserialize Operation");
+    }
 
-        case Operation::DIFF: {
-          CHECK(operation.has_diff());
+    string name;
+
+    switch (operation.type()) {
+      case Operation::SNAPSHOT:
+        CHECK(operation.has_snapshot());
+        name = operation.snapshot().entry().name();
+        break;
+      case Operation::DIFF:
+        CHECK(operation.has_diff());
+        name = operation.diff().entry().name();
+        break;
+      case Operation::EXPUNGE:
+        CHECK(operation.has_expunge());
+        name = operation.expunge().name();
+        break;
+      default:
+        return Failure("Unknown operation: " + stringify(operation.type()));
+    }
 
-          Option<Snapshot> snapshot =
-            snapshots.get(operation.diff().entry().name());
+    if (overwritten.contains(name)) {
+      continue;
+    }
 
-          CHECK_SOME(snapshot);
+    if (operation.type() != Operation::DIFF) {
+      overwritten.insert(name);
+    }
 
-          Try<Snapshot> patched = snapshot.get().patch(operation.diff());
+    pending.push_front(Pending{entry.position, offset, operation});
+  }
 
-          if (patched.isError()) {
-            return Failure("Failed to apply the diff: " + patched.error());
-          }
+  foreach (const Pending& operation, pending) {
+    switch (operation.operation.type()) {
+      case Operation::SNAPSHOT: {
+        // Add or update (override) the snapshot.
+        Snapshot snapshot(
+            operation.position,
+            operation.offset,
+            operation.operation.snapshot().entry());
+
+        snapshots.put(snapshot.entry.name(), snapshot);
+        break;
+      }
 
-          // Replace the snapshot with the patched snapshot.
-          snapshots.put(patched.get().entry.name(), patched.get());
-          break;
-        }
+      case Operation::DIFF: {
+        Option<Snapshot> snapshot =
+          snapshots.get(operation.operation.diff().entry().name());
+
+        CHECK_SOME(snapshot);
 
-        case Operation::EXPUNGE: {
-          CHECK(operation.has_expunge());
-          snapshots.erase(operation.expunge().name());
-          break;
+        Try<Snapshot> patched =
+          snapshot.get().patch(operation.operation.diff());
+
+        if (patched.isError()) {
+          return Failure("Failed to apply the diff: " + patched.error());
         }
 
-        default:
-          return Failure("Unknown operation: " + stringify(operation.type()));
+        // Replace the snapshot with the patched snapshot.
+        snapshots.put(patched.get().entry.name(), patched.get());
+        break;
+      }
+
+      case Operation::EXPUNGE: {
+        snapshots.erase(operation.operation.expunge().name());
+        break;
       }
 
-      index = entry.position;
+      default:
+        UNREACHABLE();
     }
   }
 
+  VLOG(2) << "Applied " << pending.size() << " operations";
+
+  index = max(index, last);
+  written = end;
+
   return Nothing();
 }
 
@@ -350,11 +460,6 @@ Future<Nothing> LogStorageProcess::apply(const list<Log::Entry>& entries)
 // TODO(benh): Truncation could be optimized by saving the "oldest"
 // snapshot and only doing a truncation if/when we update that
 // snapshot.
-// TODO(benh): Truncation is not enough to keep the log size small as
-// the log could get very fragmented. We'll need a way to defragment
-// the log as some state entries might not get set over a long period
-// of time and their associated snapshots are causing the log to grow
-// very big.
 void LogStorageProcess::truncate()
 {
   // We lock the truncation since it includes a call to
@@ -368,25 +473,43 @@ void LogStorageProcess::truncate()
 
 Future<Nothing> LogStorageProcess::_truncate()
 {
-  // Determine the minimum necessary position for all the snapshots.
-  Option<Log::Position> minimum = None();
+  // Determine the minimum necessary position for all the snapshots,
+  // i.e., the oldest snapshot, as well as the size of all entries.
+  Option<Snapshot> oldest = None();
+  Bytes size;
 
   foreachvalue (const Snapshot& snapshot, snapshots) {
-    minimum = min(minimum, snapshot.position);
+    if (oldest.isNone() || snapshot.position < oldest.get().position) {
+      oldest = snapshot;
+    }
+
+    size += Bytes(snapshot.entry.ByteSize());
   }
 
-  // TODO(benh): It's possible that the minimum position we've found
-  // will leave a lot of "unnecessary" entries in the log (e.g., a
-  // snapshot that has been overwritten at a later position). In this
-  // circumstance we should "compact/defrag" the log by writing/moving
-  // snapshots to the end of the log first applying any diffs as
-  // necessary.
+  // If the oldest snapshot is holding back too much of the log from
+  // being truncated (e.g., it hasn't been set in a long time while
+  // other entries have been set many times), we "defragment" the log
+  // by relocating the snapshot to the end of the log first. Note that
+  // this also applies any diffs of the snapshot.
+  if (oldest.isSome()) {
+    const Bytes length(written - oldest.get().offset);
+
+    if (length > std::max(RELOCATION_MINIMUM, size * RELOCATION_FACTOR)) {
+      VLOG(1) << "Relocating the snapshot of '" << oldest.get().entry.name()
+              << "' (" << Bytes(oldest.get().entry.ByteSize()) << ")"
+              << " as it holds back " << length << " of the log";
+
+      return relocate(oldest.get().entry.name());
+    }
+  }
 
   CHECK_SOME(truncated);
 
-  if (minimum.isSome() && minimum.get() > truncated.get()) {
-    return writer.truncate(minimum.get())
-      .then(defer(self(), &Self::__truncate, minimum.get(), lambda::_1));
+  if (oldest.isSome() && oldest.get().position > truncated.get()) {
+    const Log::Position minimum = oldest.get().position;
+
+    return writer.truncate(minimum)
+      .then(defer(self(), &Self::__truncate, minimum, lambda::_1));
 
     // NOTE: Any failure from Log::Writer::truncate doesn't propagate
     // since the expectation is any subsequent Log::Writer::append
@@ -415,6 +538,54 @@ Future<Nothing> LogStorageProcess::__truncate(
 }
 
 
+Future<Nothing> LogStorageProcess::relocate(const string& name)
+{
+  Option<Snapshot> snapshot = snapshots.get(name);
+  CHECK_SOME(snapshot);
+
+  // Rewrite the (patched) entry as is, including its UUID, so that
+  // the relocation is transparent to anyone holding a variable.
+  Operation operation;
+  operation.set_type(Operation::SNAPSHOT);
+  operation.mutable_snapshot()->mutable_entry()->CopyFrom(
+      snapshot.get().entry);
+
+  string value;
+  if (!operation.SerializeToString(&value)) {
+    return Failure("Failed to serialize SNAPSHOT Operation");
+  }
+
+  return writer.append(value)
+    .then(defer(self(), &Self::_relocate, name, value.size(), lambda::_1));
+}
+
+
+Future<Nothing> LogStorageProcess::_relocate(
+    const string& name,
+    size_t size,
+    const Option<Log::Position>& position)
+{
+  // Like truncation, don't bother retrying if we're demoted. The
+  // relocation will be retried after we've started again.
+  if (position.isNone()) {
+    starting = None(); // Reset 'starting' so we try again.
+    return Nothing();
+  }
+
+  index = max(index, position);
+
+  Option<Snapshot> snapshot = snapshots.get(name);
+  CHECK_SOME(snapshot);
+
+  snapshots.put(name, Snapshot(position.get(), written, snapshot.get().entry));
+
+  written += size;
+
+  // Continue truncating, which might relocate more snapshots.
+  return _truncate();
+}
+
+
 Future<Option<state::Entry> > LogStorageProcess::get(const string& name)
 {
   return start()
@@ -505,6 +676,7 @@ Future<bool> LogStorageProcess::__set(
                     &Self::___set,
                     entry,
                     snapshot.get().diffs + 1,
+                    value.size(),
                     lambda::_1));
     }
   }
@@ -520,13 +692,14 @@ Future<bool> LogStorageProcess::__set(
   }
 
   return writer.append(value)
-    .then(defer(self(), &Self::___set, entry, 0, lambda::_1));
+    .then(defer(self(), &Self::___set, entry, 0, value.size(), lambda::_1));
 }
 
 
 Future<bool> LogStorageProcess::___set(
     const state::Entry& entry,
     size_t diffs,
+    size_t size,
     Option<Log::Position> position)
 {
   if (position.isNone()) {
@@ -541,13 +714,19 @@ Future<bool> LogStorageProcess::___set(
   // Determine the position that represents the snapshot: if we just
   // wrote a diff then we want to use the existing position of the
   // snapshot, otherwise we just overwrote the snapshot so we should
-  // use the returned position (i.e., do nothing).
+  // use the returned position (i.e., do nothing). The same goes for
+  // the offset of the snapshot.
+  uint64_t offset = written;
+
   if (diffs > 0) {
     CHECK(snapshots.contains(entry.name()));
     position = snapshots.get(entry.name()).get().position;
+    offset = snapshots.get(entry.name()).get().offset;
   }
 
-  Snapshot snapshot(position.get(), entry, diffs);
+  written += size;
+
+  Snapshot snapshot(position.get(), offset, entry, diffs);
   snapshots.put(snapshot.entry.name(), snapshot);
 
   // And truncate the log if necessary.
@@ -597,12 +776,13 @@ Future<bool> LogStorageProcess::__expunge(const state::Entry& entry)
   }
 
   return writer.append(value)
-    .then(defer(self(), &Self::___expunge, entry, lambda::_1));
+    .then(defer(self(), &Self::___expunge, entry, value.size(), lambda::_1));
 }
 
 
 Future<bool> LogStorageProcess::___expunge(
     const state::Entry& entry,
+    size_t size,
     const Option<Log::Position>& position)
 {
   if (position.isNone()) {
@@ -610,6 +790,9 @@ Future<bool> LogStorageProcess::___expunge(
     return false;
   }
 
+  index = max(index, position);
+  written += size;
+
   // Remove from snapshots and truncate the log if possible.
   CHECK(snapshots.contains(entry.name()));
   snapshots.erase(entry.name());
@@ -18,13 +18,24 @@
 
 #include <gtest/gtest.h>
 
+#include <sys/resource.h>
+
+#include <iostream>
+#include <string>
 #include <vector>
 
 #include <mesos/mesos.hpp>
 #include <mesos/resources.hpp>
 
+#include <process/future.hpp>
+#include <process/gtest.hpp>
+#include <process/http.hpp>
+
+#include <stout/bytes.hpp>
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
 #include <stout/json.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 
 #include "common/http.hpp"
@@ -32,8 +43,18 @@
 
 #include "messages/messages.hpp"
 
+using process::Future;
+
+using process::http::Pipe;
+using process::http::Response;
+
+using std::cout;
+using std::endl;
+using std::string;
 using std::vector;
 
+using testing::WithParamInterface;
+
 using namespace mesos;
 using namespace mesos::internal;
 
@@ -148,3 +169,113 @@ TEST(HTTP, ModelResources)
   ASSERT_SOME(expected);
   EXPECT_EQ(expected.get(), object);
 }
+
+
+class HTTP_BENCHMARK_Test
+  : public ::testing::Test,
+    public WithParamInterface<size_t> {};
+
+
+// The number of tasks to model.
+INSTANTIATE_TEST_CASE_P(
+    Tasks,
+    HTTP_BENCHMARK_Test,
+    ::testing::Values(10000U, 100000U));
+
+
+// Returns the peak resident set size of this process, in kilobytes.
+static long maxrss()
+{
+  struct rusage usage;
+  CHECK_EQ(0, getrusage(RUSAGE_SELF, &usage));
+  return usage.ru_maxrss;
+}
+
+
+// Compares the latency and peak memory usage of generating JSON for
+// a large number of tasks (like '/state.json') by building up a
+// JSON::Array and stringifying it versus streaming each task into a
+// response using 'streamJSON' (and reading the response back). NOTE:
+// The peak resident set size never decreases, so the streamed
+// response is measured first, which means the increase reported for
+// building the array is a lower bound.
+TEST_P(HTTP_BENCHMARK_Test, ModelTasks)
+{
+  const size_t taskCount = GetParam();
+
+  FrameworkID frameworkId;
+  frameworkId.set_value("framework");
+
+  vector<Task> tasks;
+  tasks.reserve(taskCount);
+
+  for (size_t i = 0; i < taskCount; i++) {
+    TaskInfo task;
+    task.set_name("task-" + stringify(i));
+    task.mutable_task_id()->set_value(stringify(i));
+    task.mutable_slave_id()->set_value("slave-" + stringify(i % 1000));
+    task.mutable_resources()->CopyFrom(
+        Resources::parse("cpus:1;mem:128;ports:[31000-31001]").get());
+    task.mutable_command()->set_value("sleep 1000");
+
+    tasks.push_back(protobuf::createTask(task, TASK_RUNNING, frameworkId));
+  }
+
+  // Stream the tasks into a response using a JSON::Writer.
+  long rss = maxrss();
+
+  Stopwatch watch;
+  watch.start();
+
+  size_t written = 0;
+
+  {
+    Response response = streamJSON([&tasks](JSON::Writer* writer) {
+      writer->beginArray();
+      foreach (const Task& task, tasks) {
+        writer->value(model(task));
+      }
+      writer->endArray();
+    });
+
+    ASSERT_EQ(Response::PIPE, response.type);
+    ASSERT_SOME(response.reader);
+
+    Pipe::Reader reader = response.reader.get();
+
+    while (true) {
+      Future<string> chunk = reader.read();
+      AWAIT_READY(chunk);
+
+      if (chunk.get().empty()) {
+        break; // EOF.
+      }
+
+      written += chunk.get().size();
+    }
+  }
+
+  cout << "Streamed " << taskCount << " tasks (" << Bytes(written) << ")"
+       << " with a JSON::Writer in " << watch.elapsed() << " with a peak RSS"
+       << " increase of " << Kilobytes(maxrss() - rss) << endl;
+
+  // Build up a JSON::Array and then stringify it.
+  rss = maxrss();
+
+  watch.start(); // Reset.
+
+  {
+    JSON::Array array;
+    array.values.reserve(tasks.size());
+
+    foreach (const Task& task, tasks) {
+      array.values.push_back(model(task));
+    }
+
+    written = stringify(array).size();
+  }
+
+  cout << "Wrote " << taskCount << " tasks (" << Bytes(written) << ") with"
+       << " a JSON::Array in " << watch.elapsed() << " with a peak RSS"
+       << " increase of at least " << Kilobytes(maxrss() - rss) << endl;
+}
@@ -18,8 +18,12 @@
 
 #include <gmock/gmock.h>
 
+#include <algorithm>
 #include <atomic>
 #include <iostream>
+#include <mutex>
+#include <ostream>
+#include <random>
 #include <string>
 #include <queue>
 #include <vector>
@@ -38,6 +42,7 @@
 #include <stout/hashset.hpp>
 #include <stout/os.hpp>
 #include <stout/stopwatch.hpp>
+#include <stout/synchronized.hpp>
 #include <stout/utils.hpp>
 
 #include "master/constants.hpp"
@@ -46,6 +51,7 @@
 #include "master/allocator/mesos/hierarchical.hpp"
 
 #include "tests/mesos.hpp"
+#include "tests/utils.hpp"
 
 using mesos::internal::master::MIN_CPUS;
 using mesos::internal::master::MIN_MEM;
@@ -53,6 +59,8 @@ using mesos::internal::master::MIN_MEM;
 using mesos::master::allocator::Allocator;
 using mesos::master::RoleInfo;
 using mesos::internal::master::allocator::HierarchicalDRFAllocator;
+using mesos::internal::master::allocator::HierarchicalDRFAllocatorProcess;
+using mesos::internal::master::allocator::RolePartition;
 
 using process::Clock;
 using process::Future;
@@ -972,6 +980,415 @@ TEST_F(HierarchicalAllocatorTest, Whitelist)
 }
 
 
+// Checks that a filter installed when recovering resources only
+// applies to the slave that the resources were on, and only until
+// it expires.
+TEST_F(HierarchicalAllocatorTest, RefusedFilter)
+{
+  Clock::pause();
+
+  initialize(vector<string>{});
+
+  hashmap<FrameworkID, Resources> EMPTY;
+
+  SlaveInfo slave1 = createSlaveInfo("cpus:2;mem:1024;disk:0");
+  allocator->addSlave(slave1.id(), slave1, slave1.resources(), EMPTY);
+
+  SlaveInfo slave2 = createSlaveInfo("cpus:2;mem:1024;disk:0");
+  allocator->addSlave(slave2.id(), slave2, slave2.resources(), EMPTY);
+
+  FrameworkInfo framework = createFrameworkInfo("*");
+  allocator->addFramework(
+      framework.id(), framework, hashmap<SlaveID, Resources>());
+
+  Future<Allocation> allocation = queue.get();
+  AWAIT_READY(allocation);
+  EXPECT_EQ(framework.id(), allocation.get().frameworkId);
+  EXPECT_EQ(2u, allocation.get().resources.size());
+
+  // Decline the resources on slave1 for longer than the allocation
+  // interval, and those on slave2 without a filter.
+  Filters filters;
+  filters.set_refuse_seconds(flags.allocation_interval.secs() * 5);
+
+  allocator->recoverResources(
+      framework.id(),
+      slave1.id(),
+      allocation.get().resources.get(slave1.id()).get(),
+      filters);
+
+  allocator->recoverResources(
+      framework.id(),
+      slave2.id(),
+      allocation.get().resources.get(slave2.id()).get(),
+      None());
+
+  // Only slave2 should be offered in the next batch allocation.
+  Clock::advance(flags.allocation_interval);
+
+  allocation = queue.get();
+  AWAIT_READY(allocation);
+  EXPECT_EQ(framework.id(), allocation.get().frameworkId);
+  ASSERT_EQ(1u, allocation.get().resources.size());
+  EXPECT_TRUE(allocation.get().resources.contains(slave2.id()));
+
+  // Once the filter expires, slave1 should be offered again.
+  Clock::advance(flags.allocation_interval * 5);
+
+  allocation = queue.get();
+  AWAIT_READY(allocation);
+  EXPECT_EQ(framework.id(), allocation.get().frameworkId);
+  ASSERT_EQ(1u, allocation.get().resources.size());
+  EXPECT_TRUE(allocation.get().resources.contains(slave1.id()));
+}
+
+
+// Checks that slaves whose resources could not be allocated to any
+// framework are skipped in subsequent allocations until their
+// available resources change.
+TEST_F(HierarchicalAllocatorTest, SkipUnchangedSlaves)
+{
+  Clock::pause();
+
+  initialize(vector<string>{});
+
+  hashmap<FrameworkID, Resources> EMPTY;
+
+  SlaveInfo slave1 = createSlaveInfo("cpus:2;mem:1024;disk:0");
+  allocator->addSlave(slave1.id(), slave1, slave1.resources(), EMPTY);
+
+  SlaveInfo slave2 = createSlaveInfo("cpus:2;mem:1024;disk:0");
+  allocator->addSlave(slave2.id(), slave2, slave2.resources(), EMPTY);
+
+  FrameworkInfo framework = createFrameworkInfo("*");
+  allocator->addFramework(
+      framework.id(), framework, hashmap<SlaveID, Resources>());
+
+  Future<Allocation> allocation = queue.get();
+  AWAIT_READY(allocation);
+  EXPECT_EQ(2u, allocation.get().resources.size());
+
+  // Both slaves are now fully allocated, so the next batch allocation
+  // should not evaluate either of them.
+  Clock::advance(flags.allocation_interval);
+  Clock::settle();
+
+  JSON::Object metrics = Metrics();
+
+  ASSERT_EQ(1u, metrics.values.count("allocator/evaluated_pairs"));
+  EXPECT_EQ(0u, metrics.values["allocator/evaluated_pairs"]);
+
+  ASSERT_EQ(1u, metrics.values.count("allocator/skipped_pairs"));
+  EXPECT_EQ(2u, metrics.values["allocator/skipped_pairs"]);
+
+  // Recovering the resources on slave1 should get it considered (and
+  // its resources offered) in the next batch allocation.
+  allocator->recoverResources(
+      framework.id(),
+      slave1.id(),
+      allocation.get().resources.get(slave1.id()).get(),
+      None());
+
+  Clock::advance(flags.allocation_interval);
+
+  allocation = queue.get();
+  AWAIT_READY(allocation);
+  ASSERT_EQ(1u, allocation.get().resources.size());
+  EXPECT_TRUE(allocation.get().resources.contains(slave1.id()));
+
+  metrics = Metrics();
+
+  EXPECT_EQ(1u, metrics.values["allocator/evaluated_pairs"]);
+  EXPECT_EQ(1u, metrics.values["allocator/skipped_pairs"]);
+}
+
+
+// Checks that when allocating a quantum at a time, the resources of
+// a slave are split across the frameworks by their shares.
+TEST_F(HierarchicalAllocatorTest, AllocationQuantum)
+{
+  Clock::pause();
+
+  HierarchicalDRFAllocatorProcess::Options options;
+  options.quantum = Resources::parse("cpus:1;mem:512").get();
+
+  Try<Allocator*> fineGrained = HierarchicalDRFAllocator::create(options);
+  ASSERT_SOME(fineGrained);
+
+  delete allocator;
+  allocator = fineGrained.get();
+
+  initialize(vector<string>{});
+
+  FrameworkInfo framework1 = createFrameworkInfo("*");
+  allocator->addFramework(
+      framework1.id(), framework1, hashmap<SlaveID, Resources>());
+
+  FrameworkInfo framework2 = createFrameworkInfo("*");
+  allocator->addFramework(
+      framework2.id(), framework2, hashmap<SlaveID, Resources>());
+
+  hashmap<FrameworkID, Resources> EMPTY;
+
+  SlaveInfo slave = createSlaveInfo("cpus:4;mem:2048");
+  allocator->addSlave(slave.id(), slave, slave.resources(), EMPTY);
+
+  // Both frameworks should be offered half of the slave.
+  hashmap<FrameworkID, Allocation> allocations;
+
+  Future<Allocation> allocation = queue.get();
+  AWAIT_READY(allocation);
+  allocations[allocation.get().frameworkId] = allocation.get();
+
+  allocation = queue.get();
+  AWAIT_READY(allocation);
+  allocations[allocation.get().frameworkId] = allocation.get();
+
+  const Resources half = Resources::parse("cpus:2;mem:1024").get();
+
+  ASSERT_TRUE(allocations.contains(framework1.id()));
+  EXPECT_EQ(half, Resources::sum(allocations[framework1.id()].resources));
+
+  ASSERT_TRUE(allocations.contains(framework2.id()));
+  EXPECT_EQ(half, Resources::sum(allocations[framework2.id()].resources));
+}
+
+
+// Checks that when the slaves are split into shards for batch
+// allocations, the merged candidates still give each framework an
+// equal number of (coarse-grained) slaves.
+TEST_F(HierarchicalAllocatorTest, ShardedAllocation)
+{
+  Clock::pause();
+
+  HierarchicalDRFAllocatorProcess::Options options;
+  options.shards = 2;
+
+  Try<Allocator*> sharded = HierarchicalDRFAllocator::create(options);
+  ASSERT_SOME(sharded);
+
+  delete allocator;
+  allocator = sharded.get();
+
+  initialize(vector<string>{"role1", "role2"});
+
+  FrameworkInfo framework1 = createFrameworkInfo("role1");
+  allocator->addFramework(
+      framework1.id(), framework1, hashmap<SlaveID, Resources>());
+
+  FrameworkInfo framework2 = createFrameworkInfo("role2");
+  allocator->addFramework(
+      framework2.id(), framework2, hashmap<SlaveID, Resources>());
+
+  hashmap<FrameworkID, Resources> EMPTY;
+
+  // Each slave is allocated on its own as it is added. Return the
+  // resources so that the next batch allocation considers all of
+  // the slaves at once.
+  for (int i = 0; i < 4; i++) {
+    SlaveInfo slave = createSlaveInfo("cpus:2;mem:1024;disk:0");
+    allocator->addSlave(slave.id(), slave, slave.resources(), EMPTY);
+
+    Future<Allocation> allocation = queue.get();
+    AWAIT_READY(allocation);
+
+    allocator->recoverResources(
+        allocation.get().frameworkId,
+        slave.id(),
+        allocation.get().resources.get(slave.id()).get(),
+        None());
+  }
+
+  Clock::advance(flags.allocation_interval);
+
+  hashmap<FrameworkID, Allocation> allocations;
+
+  Future<Allocation> allocation = queue.get();
+  AWAIT_READY(allocation);
+  allocations[allocation.get().frameworkId] = allocation.get();
+
+  allocation = queue.get();
+  AWAIT_READY(allocation);
+  allocations[allocation.get().frameworkId] = allocation.get();
+
+  ASSERT_TRUE(allocations.contains(framework1.id()));
+  EXPECT_EQ(2u, allocations[framework1.id()].resources.size());
+
+  ASSERT_TRUE(allocations.contains(framework2.id()));
+  EXPECT_EQ(2u, allocations[framework2.id()].resources.size());
+}
+
+
+// Checks that a candidate picked by a shard is rejected when the
+// allocations merged before it make it unfair (beyond the fairness
+// tolerance), in which case the slave gets allocated as usual.
+TEST_F(HierarchicalAllocatorTest, ShardedAllocationFairness)
+{
+  Clock::pause();
+
+  HierarchicalDRFAllocatorProcess::Options options;
+  options.shards = 2;
+  options.fairnessTolerance = 0.0;
+
+  Try<Allocator*> sharded = HierarchicalDRFAllocator::create(options);
+  ASSERT_SOME(sharded);
+
+  delete allocator;
+  allocator = sharded.get();
+
+  initialize(vector<string>{"role1", "role2"});
+
+  hashmap<FrameworkID, Resources> EMPTY;
+
+  // The first framework gets (and holds on to) two slaves.
+  FrameworkInfo framework1 = createFrameworkInfo("role1");
+  allocator->addFramework(
+      framework1.id(), framework1, hashmap<SlaveID, Resources>());
+
+  for (int i = 0; i < 2; i++) {
+    SlaveInfo slave = createSlaveInfo("cpus:2;mem:1024;disk:0");
+    allocator->addSlave(slave.id(), slave, slave.resources(), EMPTY);
+
+    Future<Allocation> allocation = queue.get();
+    AWAIT_READY(allocation);
+    EXPECT_EQ(framework1.id(), allocation.get().frameworkId);
+  }
+
+  FrameworkInfo framework2 = createFrameworkInfo("role2");
+  allocator->addFramework(
+      framework2.id(), framework2, hashmap<SlaveID, Resources>());
+
+  // Each of these slaves is allocated to the second framework on its
+  // own as it is added. Return the resources so that the next batch
+  // allocation considers both of them at once.
+  for (int i = 0; i < 2; i++) {
+    SlaveInfo slave = createSlaveInfo("cpus:2;mem:1024;disk:0");
+    allocator->addSlave(slave.id(), slave, slave.resources(), EMPTY);
+
+    Future<Allocation> allocation = queue.get();
+    AWAIT_READY(allocation);
+    EXPECT_EQ(framework2.id(), allocation.get().frameworkId);
+
+    allocator->recoverResources(
+        allocation.get().frameworkId,
+        slave.id(),
+        allocation.get().resources.get(slave.id()).get(),
+        None());
+  }
+
+  // The first shard picks the second framework (which has the lowest
+  // share) for one slave, and the second shard picks the first
+  // framework for the other. Once the first pick is merged, the
+  // first framework's share is still above the second's, so its pick
+  // is rejected and the second framework gets both slaves.
+  Clock::advance(flags.allocation_interval);
+
+  Future<Allocation> allocation = queue.get();
+  AWAIT_READY(allocation);
+  EXPECT_EQ(framework2.id(), allocation.get().frameworkId);
+  EXPECT_EQ(2u, allocation.get().resources.size());
+
+  // Nothing is allocated to the first framework.
+  Clock::settle();
+
+  allocation = queue.get();
+  EXPECT_TRUE(allocation.isPending());
+}
+
+
+// Checks that the resources of a slave that are all reserved are
+// only allocated to the frameworks in the roles that they are
+// reserved for, including roles that are unknown to the allocator.
+TEST_F(HierarchicalAllocatorTest, ReservedOnlySlaves)
+{
+  Clock::pause();
+
+  initialize(vector<string>{"role1", "role2", "role3"});
+
+  FrameworkInfo framework1 = createFrameworkInfo("role1");
+  allocator->addFramework(
+      framework1.id(), framework1, hashmap<SlaveID, Resources>());
+
+  FrameworkInfo framework2 = createFrameworkInfo("role2");
+  allocator->addFramework(
+      framework2.id(), framework2, hashmap<SlaveID, Resources>());
+
+  FrameworkInfo framework3 = createFrameworkInfo("role3");
+  allocator->addFramework(
+      framework3.id(), framework3, hashmap<SlaveID, Resources>());
+
+  hashmap<FrameworkID, Resources> EMPTY;
+
+  SlaveInfo slave1 = createSlaveInfo(
+      "cpus(role1):1;mem(role1):512;cpus(role2):2;mem(role2):1024");
+  allocator->addSlave(slave1.id(), slave1, slave1.resources(), EMPTY);
+
+  hashmap<FrameworkID, Allocation> allocations;
+
+  Future<Allocation> allocation = queue.get();
+  AWAIT_READY(allocation);
+  allocations[allocation.get().frameworkId] = allocation.get();
+
+  allocation = queue.get();
+  AWAIT_READY(allocation);
+  allocations[allocation.get().frameworkId] = allocation.get();
+
+  ASSERT_TRUE(allocations.contains(framework1.id()));
+  EXPECT_EQ(Resources(slave1.resources()).reserved("role1"),
+            Resources::sum(allocations[framework1.id()].resources));
+
+  ASSERT_TRUE(allocations.contains(framework2.id()));
+  EXPECT_EQ(Resources(slave1.resources()).reserved("role2"),
+            Resources::sum(allocations[framework2.id()].resources));
+
+  // Nothing on this slave is allocatable to any known role.
+  SlaveInfo slave2 = createSlaveInfo("cpus(role4):2;mem(role4):1024");
+  allocator->addSlave(slave2.id(), slave2, slave2.resources(), EMPTY);
+
+  allocation = queue.get();
+
+  Clock::advance(flags.allocation_interval);
+  Clock::settle();
+
+  EXPECT_TRUE(allocation.isPending());
+}
+
+
+// Checks that a RolePartition tells whether the resources available
+// to a role are allocatable the same way that copying them out does.
+TEST(RolePartitionTest, Allocatable)
+{
+  Resources resources = Resources::parse(
+      "cpus:0.005;mem:16;cpus(role1):1;mem(role2):16").get();
+
+  Resource revocable = Resources::parse("mem", "32", "*").get();
+  revocable.mutable_revocable();
+  resources += revocable;
+
+  RolePartition partition(resources);
+
+  // Nothing is allocatable to '*' unless revocable resources are.
+  EXPECT_FALSE(partition.allocatable("*", false));
+  EXPECT_TRUE(partition.allocatable("*", true));
+
+  // The cpus reserved for role1 are allocatable.
+  EXPECT_TRUE(partition.allocatable("role1", false));
+
+  // The mem reserved for role2 is allocatable along with the
+  // unreserved mem.
+  EXPECT_TRUE(partition.allocatable("role2", false));
+
+  EXPECT_FALSE(partition.allocatable("role3", false));
+  EXPECT_TRUE(partition.allocatable("role3", true));
+
+  const hashset<string> reservations = partition.reservations();
+
+  EXPECT_EQ(2u, reservations.size());
+  EXPECT_TRUE(reservations.contains("role1"));
+  EXPECT_TRUE(reservations.contains("role2"));
+}
+
+
 class HierarchicalAllocator_BENCHMARK_Test
   : public HierarchicalAllocatorTestBase,
     public WithParamInterface<size_t>
@@ -1056,6 +1473,678 @@ TEST_P(HierarchicalAllocator_BENCHMARK_Test, AddAndUpdateSlave)
   cout << "Updated " << slaveCount << " slaves in " << watch.elapsed() << endl;
 }
 
+
+// This benchmark measures a full (batched) allocation cycle across
+// all of the slaves in a cluster with many roles and frameworks, in
+// which every slave has resources available to be allocated.
+TEST_P(HierarchicalAllocator_BENCHMARK_Test, FullAllocationCycle)
+{
+  Clock::pause();
+
+  const size_t roleCount = 300;
+  const size_t frameworkCount = 2000;
+  const size_t slaveCount = GetParam();
+
+  // The offers made so far. NOTE: The offer callback is invoked from
+  // the allocator process, hence the mutex.
+  std::mutex mutex;
+  vector<Allocation> allocations;
+
+  // Number of slaves offered. This is used to determine the
+  // termination condition.
+  atomic<size_t> offered(0);
+
+  auto offerCallback = [&](
+      const FrameworkID& frameworkId,
+      const hashmap<SlaveID, Resources>& resources) {
+    synchronized (mutex) {
+      Allocation allocation;
+      allocation.frameworkId = frameworkId;
+      allocation.resources = resources;
+      allocations.push_back(allocation);
+    }
+
+    offered += resources.size();
+  };
+
+  vector<string> roles;
+  for (size_t i = 0; i < roleCount; i++) {
+    roles.push_back("role" + stringify(i));
+  }
+
+  initialize(roles, master::Flags(), offerCallback);
+
+  vector<FrameworkInfo> frameworks;
+  for (size_t i = 0; i < frameworkCount; i++) {
+    frameworks.push_back(createFrameworkInfo(roles[i % roleCount]));
+    allocator->addFramework(frameworks.back().id(), frameworks.back(), {});
+  }
+
+  Stopwatch watch;
+  watch.start();
+
+  // Each slave has some resources in use by one of the frameworks so
+  // that the frameworks (and roles) end up with differing shares.
+  for (size_t i = 0; i < slaveCount; i++) {
+    SlaveInfo slave = createSlaveInfo(
+        "cpus:24;mem:4096;disk:4096;ports:[31000-32000]");
+
+    hashmap<FrameworkID, Resources> used;
+    used[frameworks[i % frameworkCount].id()] =
+      Resources::parse("cpus:" + stringify(1 + i % 8) + ";mem:512").get();
+
+    allocator->addSlave(slave.id(), slave, slave.resources(), used);
+  }
+
+  // Wait for the remaining resources of each slave to be offered.
+  while (offered.load() != slaveCount) {
+    os::sleep(Milliseconds(10));
+  }
+
+  cout << "Added " << slaveCount << " slaves in " << watch.elapsed() << endl;
+
+  // Decline all of the offers without filters, so that all of the
+  // slaves are considered in the next allocation cycle.
+  synchronized (mutex) {
+    foreach (const Allocation& allocation, allocations) {
+      foreachpair (const SlaveID& slaveId,
+                   const Resources& resources,
+                   allocation.resources) {
+        allocator->recoverResources(
+            allocation.frameworkId, slaveId, resources, None());
+      }
+    }
+  }
+
+  watch.start(); // Reset.
+
+  // Trigger a batch allocation.
+  Clock::advance(flags.allocation_interval);
+
+  while (offered.load() != 2 * slaveCount) {
+    os::sleep(Milliseconds(10));
+  }
+
+  cout << "Allocated " << slaveCount << " slaves to " << frameworkCount
+       << " frameworks in " << roleCount << " roles in "
+       << watch.elapsed() << endl;
+
+  Clock::resume();
+}
+
+
+// The parameters of a synthetic cluster trace, see
+// HierarchicalAllocatorTrace_BENCHMARK_Test below.
+struct Trace
+{
+  size_t slaveCount;
+  size_t frameworkCount;
+  size_t roleCount;
+
+  // Fraction of the slaves that have resources reserved for a role.
+  double reservedFraction;
+};
+
+
+std::ostream& operator << (std::ostream& stream, const Trace& trace)
+{
+  return stream << trace.slaveCount << " slaves, "
+                << trace.frameworkCount << " frameworks, "
+                << trace.roleCount << " roles, "
+                << trace.reservedFraction << " reserved";
+}
+
+
+class HierarchicalAllocatorTrace_BENCHMARK_Test
+  : public HierarchicalAllocatorTestBase,
+    public WithParamInterface<Trace>
+{};
+
+
+// The trace benchmark tests are parameterized by the shape of the
+// cluster.
+INSTANTIATE_TEST_CASE_P(
+    Cluster,
+    HierarchicalAllocatorTrace_BENCHMARK_Test,
+    ::testing::Values(
+        Trace{1000U, 100U, 10U, 0.0},
+        Trace{1000U, 1000U, 100U, 0.2},
+        Trace{5000U, 1000U, 100U, 0.2},
+        Trace{10000U, 2000U, 300U, 0.5}));
+
+
+// This benchmark replays a synthetic trace of cluster activity:
+// frameworks arrive over time, decline offers with filters or launch
+// tasks on them, tasks finish, and slaves leave and join. It reports
+// percentiles of the batch allocation cycle latency, the offer rate
+// and the fairness error, i.e., how far apart the dominant shares of
+// the roles are after each cycle.
+TEST_P(HierarchicalAllocatorTrace_BENCHMARK_Test, Replay)
+{
+  Clock::pause();
+
+  const Trace trace = GetParam();
+
+  const size_t cycles = 20;
+
+  // The trace is generated with a fixed seed, so that every run
+  // replays the same trace.
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> random(0.0, 1.0);
+
+  // The offers made but not yet acted upon. NOTE: The offer callback
+  // is invoked from the allocator process, hence the mutex.
+  std::mutex mutex;
+  vector<Allocation> allocations;
+
+  // Number of slaves offered. This is used to compute the offer rate.
+  atomic<size_t> offered(0);
+
+  auto offerCallback = [&](
+      const FrameworkID& frameworkId,
+      const hashmap<SlaveID, Resources>& resources) {
+    synchronized (mutex) {
+      Allocation allocation;
+      allocation.frameworkId = frameworkId;
+      allocation.resources = resources;
+      allocations.push_back(allocation);
+    }
+
+    offered += resources.size();
+  };
+
+  vector<string> roles;
+  for (size_t i = 0; i < trace.roleCount; i++) {
+    roles.push_back("role" + stringify(i));
+  }
+
+  initialize(roles, master::Flags(), offerCallback);
+
+  // The role of each framework, used to compute the role shares.
+  hashmap<FrameworkID, string> frameworkRoles;
+
+  vector<FrameworkInfo> frameworks;
+  for (size_t i = 0; i < trace.frameworkCount; i++) {
+    frameworks.push_back(createFrameworkInfo(roles[i % trace.roleCount]));
+    frameworkRoles[frameworks.back().id()] = frameworks.back().role();
+  }
+
+  // Half of the frameworks are there from the start, the rest arrive
+  // over the course of the trace.
+  size_t arrived = trace.frameworkCount / 2;
+  for (size_t i = 0; i < arrived; i++) {
+    allocator->addFramework(frameworks[i].id(), frameworks[i], {});
+  }
+
+  hashmap<FrameworkID, Resources> EMPTY;
+
+  // The slaves currently in the cluster, and their total resources.
+  vector<SlaveID> slaveIds;
+  hashmap<SlaveID, Resources> slaves;
+
+  auto addSlave = [&]() {
+    string resources = "cpus:24;mem:49152;disk:4096;ports:[31000-32000]";
+
+    if (random(generator) < trace.reservedFraction) {
+      const string& role = roles[generator() % trace.roleCount];
+      resources += ";cpus(" + role + "):8;mem(" + role + "):16384";
+    }
+
+    SlaveInfo slave = createSlaveInfo(resources);
+
+    slaveIds.push_back(slave.id());
+    slaves[slave.id()] = slave.resources();
+
+    allocator->addSlave(slave.id(), slave, slave.resources(), EMPTY);
+  };
+
+  for (size_t i = 0; i < trace.slaveCount; i++) {
+    addSlave();
+  }
+
+  // The tasks that are running, i.e., the resources that frameworks
+  // hold on to after accepting an offer.
+  vector<Allocation> tasks;
+
+  const Resources task = Resources::parse("cpus:1;mem:2048").get();
+
+  Filters filters;
+  filters.set_refuse_seconds(5);
+
+  vector<Duration> latencies;
+  vector<double> fairnessErrors;
+
+  size_t offers = 0;
+  Duration elapsed = Duration::zero();
+
+  for (size_t cycle = 0; cycle < cycles; cycle++) {
+    // Wait for the allocator to process the previous events (and to
+    // make any offers that they trigger).
+    Clock::settle();
+
+    vector<Allocation> pending;
+    synchronized (mutex) {
+      std::swap(pending, allocations);
+    }
+
+    // Decline 30% of the offers with a filter, and launch a task on
+    // the others, declining the rest of the offered resources.
+    foreach (const Allocation& allocation, pending) {
+      foreachpair (const SlaveID& slaveId,
+                   const Resources& resources,
+                   allocation.resources) {
+        if (!slaves.contains(slaveId)) {
+          continue;
+        }
+
+        Option<Resources> launched = resources.find(task);
+
+        if (random(generator) < 0.3 || launched.isNone()) {
+          allocator->recoverResources(
+              allocation.frameworkId, slaveId, resources, filters);
+          continue;
+        }
+
+        Allocation launch;
+        launch.frameworkId = allocation.frameworkId;
+        launch.resources[slaveId] = launched.get();
+        tasks.push_back(launch);
+
+        allocator->recoverResources(
+            allocation.frameworkId,
+            slaveId,
+            resources - launched.get(),
+            None());
+      }
+    }
+
+    // Finish 20% of the running tasks.
+    vector<Allocation> running;
+    foreach (const Allocation& launch, tasks) {
+      const SlaveID& slaveId = launch.resources.begin()->first;
+
+      if (!slaves.contains(slaveId)) {
+        continue;
+      }
+
+      if (random(generator) < 0.2) {
+        allocator->recoverResources(
+            launch.frameworkId,
+            slaveId,
+            launch.resources.begin()->second,
+            None());
+      } else {
+        running.push_back(launch);
+      }
+    }
+    std::swap(tasks, running);
+
+    // Wait for any offers made while recovering the resources above,
+    // so that none are outstanding on a slave that gets removed.
+    Clock::settle();
+
+    // Replace 1% of the slaves.
+    for (size_t i = 0; i < trace.slaveCount / 100; i++) {
+      const size_t index = generator() % slaveIds.size();
+      const SlaveID slaveId = slaveIds[index];
+
+      slaveIds[index] = slaveIds.back();
+      slaveIds.pop_back();
+      slaves.erase(slaveId);
+
+      // Like the master, recover the tasks and offers on the slave
+      // before removing it, because the sorters are only updated in
+      // recoverResources() (see MESOS-621).
+      vector<Allocation> remaining;
+      foreach (const Allocation& launch, tasks) {
+        if (launch.resources.begin()->first == slaveId) {
+          allocator->recoverResources(
+              launch.frameworkId,
+              slaveId,
+              launch.resources.begin()->second,
+              None());
+        } else {
+          remaining.push_back(launch);
+        }
+      }
+      std::swap(tasks, remaining);
+
+      synchronized (mutex) {
+        foreach (Allocation& allocation, allocations) {
+          if (allocation.resources.contains(slaveId)) {
+            allocator->recoverResources(
+                allocation.frameworkId,
+                slaveId,
+                allocation.resources[slaveId],
+                None());
+
+            allocation.resources.erase(slaveId);
+          }
+        }
+      }
+
+      allocator->removeSlave(slaveId);
+
+      addSlave();
+    }
+
+    // Let more frameworks arrive.
+    const size_t arrivals = (trace.frameworkCount + 1) / 2 / cycles + 1;
+    for (size_t i = 0; i < arrivals && arrived < trace.frameworkCount; i++) {
+      allocator->addFramework(
+          frameworks[arrived].id(), frameworks[arrived], {});
+      arrived++;
+    }
+
+    Clock::settle();
+
+    // Time a batch allocation.
+    const size_t before = offered.load();
+
+    Stopwatch watch;
+    watch.start();
+
+    Clock::advance(flags.allocation_interval);
+    Clock::settle();
+
+    latencies.push_back(watch.elapsed());
+    elapsed += latencies.back();
+    offers += offered.load() - before;
+
+    // Compute the dominant shares of the roles, of the resources
+    // held in tasks and in outstanding offers.
+    Resources total;
+    foreachvalue (const Resources& resources, slaves) {
+      total += resources;
+    }
+
+    const double totalCpus = total.cpus().get(0.0);
+    const double totalMem = total.mem().get(Bytes(0)).megabytes();
+
+    vector<Allocation> held = tasks;
+    synchronized (mutex) {
+      held.insert(held.end(), allocations.begin(), allocations.end());
+    }
+
+    hashmap<string, Resources> allocated;
+    foreach (const Allocation& allocation, held) {
+      foreachpair (const SlaveID& slaveId,
+                   const Resources& resources,
+                   allocation.resources) {
+        if (slaves.contains(slaveId)) {
+          allocated[frameworkRoles[allocation.frameworkId]] += resources;
+        }
+      }
+    }
+
+    double lowest = 1.0;
+    double highest = 0.0;
+
+    foreach (const string& role, roles) {
+      const Resources& resources = allocated[role];
+
+      const double share = std::max(
+          resources.cpus().get(0.0) / totalCpus,
+          resources.mem().get(Bytes(0)).megabytes() / totalMem);
+
+      lowest = std::min(lowest, share);
+      highest = std::max(highest, share);
+    }
+
+    fairnessErrors.push_back(highest - lowest);
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  auto percentile = [&latencies](double p) {
+    return latencies[std::min(
+        latencies.size() - 1,
+        static_cast<size_t>(p * latencies.size()))];
+  };
+
+  double fairnessError = 0.0;
+  foreach (double error, fairnessErrors) {
+    fairnessError += error;
+  }
+  fairnessError /= fairnessErrors.size();
+
+  cout << "Replayed " << cycles << " allocation cycles for "
+       << trace << endl;
+
+  cout << "Allocation cycle latency:"
+       << " p50 " << percentile(0.5)
+       << " p90 " << percentile(0.9)
+       << " p99 " << percentile(0.99)
+       << " max " << latencies.back() << endl;
+
+  cout << "Made " << offers << " offers in " << elapsed << " ("
+       << offers / elapsed.secs() << " offers/sec)" << endl;
+
+  cout << "Fairness error: mean " << fairnessError
+       << " max " << *std::max_element(
+           fairnessErrors.begin(), fairnessErrors.end()) << endl;
+
+  Clock::resume();
+}
+
+
+class HierarchicalAllocatorQuantum_BENCHMARK_Test
+  : public HierarchicalAllocatorTestBase,
+    public WithParamInterface<size_t>
+{};
+
+
+// The allocation quantum benchmark tests are parameterized by the
+// number of slaves.
+INSTANTIATE_TEST_CASE_P(
+    SlaveCount,
+    HierarchicalAllocatorQuantum_BENCHMARK_Test,
+    ::testing::Values(100U, 500U, 1000U));
+
+
+// This benchmark compares "coarse-grained" allocation with allocating
+// a quantum at a time, for a cluster with twice as many frameworks as
+// slaves where every framework wants to launch a few small tasks. It
+// reports the number of offers made and the launch latency of the
+// tasks, in allocation cycles.
+TEST_P(HierarchicalAllocatorQuantum_BENCHMARK_Test, LaunchLatency)
+{
+  Clock::pause();
+
+  const size_t slaveCount = GetParam();
+  const size_t frameworkCount = 2 * slaveCount;
+  const size_t tasksPerFramework = 4;
+
+  const Resources task = Resources::parse("cpus:1;mem:512").get();
+
+  // The offers made but not yet acted upon. NOTE: The offer callback
+  // is invoked from the allocator process, hence the mutex.
+  std::mutex mutex;
+  vector<Allocation> allocations;
+
+  auto offerCallback = [&](
+      const FrameworkID& frameworkId,
+      const hashmap<SlaveID, Resources>& resources) {
+    synchronized (mutex) {
+      Allocation allocation;
+      allocation.frameworkId = frameworkId;
+      allocation.resources = resources;
+      allocations.push_back(allocation);
+    }
+  };
+
+  const vector<Option<Resources>> quanta = {None(), task};
+
+  foreach (const Option<Resources>& quantum, quanta) {
+    HierarchicalDRFAllocatorProcess::Options options;
+    options.quantum = quantum;
+
+    Try<Allocator*> created = HierarchicalDRFAllocator::create(options);
+    ASSERT_SOME(created);
+
+    delete allocator;
+    allocator = created.get();
+
+    initialize({}, master::Flags(), offerCallback);
+
+    // The number of tasks that each framework has yet to launch.
+    hashmap<FrameworkID, size_t> pending;
+
+    for (size_t i = 0; i < frameworkCount; i++) {
+      FrameworkInfo framework = createFrameworkInfo("*");
+      pending[framework.id()] = tasksPerFramework;
+      allocator->addFramework(framework.id(), framework, {});
+    }
+
+    size_t offers = 0;
+    size_t launched = 0;
+    size_t latency = 0; // Sum of the launch latencies, in cycles.
+
+    Stopwatch watch;
+    watch.start();
+
+    hashmap<FrameworkID, Resources> EMPTY;
+
+    // The allocations made as the slaves are added make up the first
+    // allocation cycle.
+    for (size_t i = 0; i < slaveCount; i++) {
+      SlaveInfo slave = createSlaveInfo("cpus:16;mem:16384");
+      allocator->addSlave(slave.id(), slave, slave.resources(), EMPTY);
+    }
+
+    Clock::settle();
+
+    size_t cycle = 1;
+
+    while (true) {
+      vector<Allocation> made;
+      synchronized (mutex) {
+        std::swap(made, allocations);
+      }
+
+      // Launch as many of the pending tasks as fit in each offer, and
+      // decline the rest of the offered resources without a filter.
+      foreach (const Allocation& allocation, made) {
+        foreachpair (const SlaveID& slaveId,
+                     const Resources& resources,
+                     allocation.resources) {
+          offers++;
+
+          Resources remaining = resources;
+          size_t& tasks = pending[allocation.frameworkId];
+
+          while (tasks > 0 && remaining.contains(task)) {
+            remaining -= task;
+            tasks--;
+            launched++;
+            latency += cycle;
+          }
+
+          allocator->recoverResources(
+              allocation.frameworkId, slaveId, remaining, None());
+        }
+      }
+
+      if (launched == frameworkCount * tasksPerFramework) {
+        break;
+      }
+
+      cycle++;
+
+      Clock::advance(flags.allocation_interval);
+      Clock::settle();
+    }
+
+    cout << (quantum.isSome() ? "Fine-grained" : "Coarse-grained")
+         << " allocation launched " << launched << " tasks for "
+         << frameworkCount << " frameworks on " << slaveCount
+         << " slaves in " << cycle << " cycles (" << watch.elapsed()
+         << ") with " << offers << " offers and a mean launch latency of "
+         << static_cast<double>(latency) / launched << " cycles" << endl;
+  }
+
+  Clock::resume();
+}
+
+
+class RolePartition_BENCHMARK_Test : public WithParamInterface<size_t>,
+                                     public ::testing::Test {};
+
+
+// The RolePartition benchmark tests are parameterized by the number of
+// roles that have resources reserved on the slave.
+INSTANTIATE_TEST_CASE_P(
+    RoleCount,
+    RolePartition_BENCHMARK_Test,
+    ::testing::Values(1U, 10U, 100U));
+
+
+// This benchmark compares how long it takes to tell whether anything
+// on a slave is allocatable to each role, by copying out the resources
+// available to the role (as the allocator used to for every role and
+// framework) and by using a RolePartition.
+TEST_P(RolePartition_BENCHMARK_Test, Allocatable)
+{
+  const size_t roleCount = GetParam();
+  const size_t iterations = 1000;
+
+  Resources available = Resources::parse(
+      "cpus:16;mem:65536;disk:1048576;ports:[31000-32000]").get();
+
+  vector<string> roles;
+  for (size_t i = 0; i < roleCount; i++) {
+    roles.push_back("role" + stringify(i));
+
+    available += Resources::parse("cpus:1;mem:1024", roles.back()).get();
+  }
+
+  Resource revocable = Resources::parse("cpus", "8", "*").get();
+  revocable.mutable_revocable();
+  available += revocable;
+
+  size_t allocatable = 0;
+
+  Stopwatch watch;
+  watch.start();
+
+  for (size_t i = 0; i < iterations; i++) {
+    foreach (const string& role, roles) {
+      Resources resources =
+        available.unreserved() + available.reserved(role);
+
+      resources -= resources.revocable();
+
+      Option<double> cpus = resources.cpus();
+      Option<Bytes> mem = resources.mem();
+
+      if ((cpus.isSome() && cpus.get() >= MIN_CPUS) ||
+          (mem.isSome() && mem.get() >= MIN_MEM)) {
+        allocatable++;
+      }
+    }
+  }
+
+  cout << "Took " << watch.elapsed() << " to check " << roleCount
+       << " roles " << iterations << " times by copying resources" << endl;
+
+  watch.start();
+
+  for (size_t i = 0; i < iterations; i++) {
+    RolePartition partition(available);
+
+    foreach (const string& role, roles) {
+      if (partition.allocatable(role, false)) {
+        allocatable--;
+      }
+    }
+  }
+
+  cout << "Took " << watch.elapsed() << " to check " << roleCount
+       << " roles " << iterations << " times with a RolePartition" << endl;
+
+  EXPECT_EQ(0u, allocatable);
+}
+
 } // namespace tests {
 } // namespace internal {
 } // namespace mesos {
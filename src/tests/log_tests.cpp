@@ -20,9 +20,11 @@
 
 #include <stdint.h>
 
+#include <iostream>
 #include <list>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <process/clock.hpp>
 #include <process/future.hpp>
@@ -34,6 +36,7 @@
 #include <process/protobuf.hpp>
 #include <process/shared.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
 #include <stout/none.hpp>
 #include <stout/option.hpp>
@@ -63,9 +66,12 @@ using namespace mesos::internal::log;
 
 using namespace process;
 
+using std::cout;
+using std::endl;
 using std::list;
 using std::set;
 using std::string;
+using std::vector;
 
 using testing::_;
 using testing::Eq;
@@ -316,6 +322,71 @@ TYPED_TEST(LogStorageTest, TruncateWithManyHoles)
 }
 
 
+// Checks that the metadata and actions persisted in a single batch
+// (including a learned truncation) are all restored.
+TYPED_TEST(LogStorageTest, Batch)
+{
+  const string path = os::getcwd() + "/.log";
+
+  {
+    TypeParam storage;
+
+    Try<Storage::State> state = storage.restore(path);
+    ASSERT_SOME(state);
+
+    Metadata metadata;
+    metadata.set_status(Metadata::VOTING);
+    metadata.set_promised(2);
+
+    list<Action> actions;
+
+    for (uint64_t i = 0; i < 10; i++) {
+      Action action;
+      action.set_position(i);
+      action.set_promised(2);
+      action.set_performed(2);
+      action.set_learned(i % 2 == 0);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(stringify(i));
+
+      actions.push_back(action);
+    }
+
+    // Truncate to position 3 (at position 10).
+    Action truncate;
+    truncate.set_position(10);
+    truncate.set_promised(2);
+    truncate.set_performed(2);
+    truncate.set_learned(true);
+    truncate.set_type(Action::TRUNCATE);
+    truncate.mutable_truncate()->set_to(3);
+
+    actions.push_back(truncate);
+
+    ASSERT_SOME(storage.persist(metadata, actions));
+
+    EXPECT_ERROR(storage.read(2));
+
+    Try<Action> action = storage.read(3);
+    ASSERT_SOME(action);
+    EXPECT_EQ("3", action.get().append().bytes());
+  }
+
+  TypeParam storage;
+
+  Try<Storage::State> state = storage.restore(path);
+  ASSERT_SOME(state);
+
+  EXPECT_EQ(Metadata::VOTING, state.get().metadata.status());
+  EXPECT_EQ(2u, state.get().metadata.promised());
+  EXPECT_EQ(3u, state.get().begin);
+  EXPECT_EQ(10u, state.get().end);
+
+  EXPECT_TRUE(state.get().learned.contains(4));
+  EXPECT_TRUE(state.get().unlearned.contains(5));
+}
+
+
 class ReplicaTest : public TemporaryDirectoryTest
 {
 protected:
@@ -1196,6 +1267,62 @@ TEST_F(CoordinatorTest, MultipleAppends)
 }
 
 
+// Checks that appends issued without waiting for the previous ones
+// are pipelined (beyond the depth of the pipeline, they get queued)
+// and get written at consecutive positions, in order.
+TEST_F(CoordinatorTest, PipelinedAppends)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network(new Network(pids));
+
+  Coordinator coord(2, replica1, network, 4);
+
+  {
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  vector<Future<Option<uint64_t> > > appending;
+  for (uint64_t position = 1; position <= 10; position++) {
+    appending.push_back(coord.append(stringify(position)));
+  }
+
+  for (uint64_t position = 1; position <= 10; position++) {
+    AWAIT_READY(appending[position - 1]);
+    EXPECT_SOME_EQ(position, appending[position - 1].get());
+  }
+
+  {
+    Future<list<Action> > actions = replica1->read(1, 10);
+    AWAIT_READY(actions);
+    EXPECT_EQ(10u, actions.get().size());
+    foreach (const Action& action, actions.get()) {
+      ASSERT_TRUE(action.has_type());
+      ASSERT_EQ(Action::APPEND, action.type());
+      EXPECT_EQ(stringify(action.position()), action.append().bytes());
+    }
+  }
+
+  // The coordinator can be demoted once all of the writes are done.
+  AWAIT_EXPECT_EQ(10u, coord.demote());
+}
+
+
 TEST_F(CoordinatorTest, MultipleAppendsNotLearnedFill)
 {
   const string path1 = os::getcwd() + "/.log1";
@@ -1673,11 +1800,19 @@ TEST_F(RecoverTest, CatchupRetry)
   // promise phase even if replica1 reemerges later.
   DROP_MESSAGE(Eq(PromiseRequest().GetTypeName()), _, Eq(replica1->pid()));
 
+  // Also drop the read requests so that the catch-up process has to
+  // fall back to filling the positions.
+  DROP_MESSAGES(Eq(ReadRequest().GetTypeName()), _, _);
+
   Future<Nothing> catching =
     catchup(2, replica3, network2, None(), positions, Seconds(10));
 
   Clock::pause();
 
+  // Wait for the read to time out.
+  Clock::settle();
+  Clock::advance(Seconds(10));
+
   // Wait for the retry timer in 'catchup' to be setup.
   Clock::settle();
 
@@ -1699,6 +1834,83 @@ TEST_F(RecoverTest, CatchupRetry)
 }
 
 
+// Measures how long it takes for a replica to catch-up positions it
+// has missed, e.g., after it has been down for a while.
+TEST_F(RecoverTest, BENCHMARK_Catchup)
+{
+  const uint64_t POSITIONS = 100000;
+
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  const string path3 = os::getcwd() + "/.log3";
+
+  // Write the learned positions to the logs directly, as appending
+  // them using a coordinator would take much longer than catching
+  // them up.
+  vector<string> paths;
+  paths.push_back(path1);
+  paths.push_back(path2);
+
+  foreach (const string& path, paths) {
+    LevelDBStorage storage;
+    ASSERT_SOME(storage.restore(path));
+
+    list<Action> actions;
+
+    for (uint64_t position = 1; position <= POSITIONS; position++) {
+      Action action;
+      action.set_position(position);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_learned(true);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(string(100, 'a'));
+      actions.push_back(action);
+
+      if (actions.size() == 1000 || position == POSITIONS) {
+        ASSERT_SOME(storage.persist(None(), actions));
+        actions.clear();
+      }
+    }
+  }
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+  Shared<Replica> replica3(new Replica(path3));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+  pids.insert(replica3->pid());
+
+  Shared<Network> network(new Network(pids));
+
+  IntervalSet<uint64_t> positions(
+      Bound<uint64_t>::closed(1),
+      Bound<uint64_t>::closed(POSITIONS));
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  Future<Nothing> catching = catchup(2, replica3, network, None(), positions);
+
+  AWAIT_READY_FOR(catching, Minutes(10));
+
+  cout << "Caught-up " << POSITIONS << " positions in "
+       << stopwatch.elapsed() << endl;
+
+  Future<IntervalSet<uint64_t> > missing = replica3->missing(1, POSITIONS);
+  AWAIT_READY(missing);
+  EXPECT_TRUE(missing.get().empty());
+}
+
+
 TEST_F(RecoverTest, AutoInitialization)
 {
   const string path1 = os::getcwd() + "/.log1";
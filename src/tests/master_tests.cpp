@@ -2945,6 +2945,71 @@ TEST_F(MasterTest, StateSummaryEndpoint)
 }
 
 
+// This test verifies that the master reuses a rendering of its state
+// for up to '--state_staleness' and that requests carrying a matching
+// ETag get back a '304 Not Modified'.
+TEST_F(MasterTest, StateSnapshot)
+{
+  master::Flags flags = CreateMasterFlags();
+  flags.state_staleness = Seconds(10);
+
+  Try<PID<Master>> master = StartMaster(flags);
+  ASSERT_SOME(master);
+
+  Future<process::http::Response> response =
+    process::http::get(master.get(), "state.json");
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(process::http::OK().status, response);
+
+  Option<string> etag = response.get().headers.get("ETag");
+  ASSERT_SOME(etag);
+
+  Try<JSON::Object> parse = JSON::parse<JSON::Object>(response.get().body);
+  ASSERT_SOME(parse);
+  EXPECT_SOME_EQ(0u, parse.get().find<JSON::Number>("activated_slaves"));
+
+  // A matching ETag (possibly among others) yields no body.
+  hashmap<string, string> headers;
+  headers["If-None-Match"] = "\"foo\", " + etag.get();
+
+  response = process::http::get(master.get(), "state.json", None(), headers);
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      process::http::NotModified().status, response);
+  EXPECT_TRUE(response.get().body.empty());
+
+  Future<SlaveRegisteredMessage> slaveRegisteredMessage =
+    FUTURE_PROTOBUF(SlaveRegisteredMessage(), _, _);
+
+  Try<PID<Slave>> slave = StartSlave();
+  ASSERT_SOME(slave);
+
+  AWAIT_READY(slaveRegisteredMessage);
+
+  // The registered slave is not visible until the snapshot expires.
+  response = process::http::get(master.get(), "state.json", None(), headers);
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      process::http::NotModified().status, response);
+
+  Clock::pause();
+  Clock::advance(flags.state_staleness);
+
+  response = process::http::get(master.get(), "state.json", None(), headers);
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(process::http::OK().status, response);
+  EXPECT_NE(etag, response.get().headers.get("ETag"));
+
+  parse = JSON::parse<JSON::Object>(response.get().body);
+  ASSERT_SOME(parse);
+  EXPECT_SOME_EQ(1u, parse.get().find<JSON::Number>("activated_slaves"));
+
+  Clock::resume();
+
+  Shutdown();
+}
+
+
 // This test ensures that the web UI of a framework is included in the
 // state.json endpoint, if provided by the framework.
 TEST_F(MasterTest, FrameworkWebUIUrl)
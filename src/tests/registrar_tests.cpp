@@ -86,6 +86,7 @@ using state::LogStorage;
 using state::Storage;
 
 using state::protobuf::State;
+using state::protobuf::Variable;
 
 // TODO(xujyan): This class copies code from LogStateTest. It would
 // be nice to find a common location for log related base tests when
@@ -351,6 +352,77 @@ TEST_P(RegistrarTest, Bootstrap)
 }
 
 
+// This test ensures that the deltas stored on top of a snapshot are
+// replayed during recovery, across snapshots of the registry, and
+// that they are compacted into the registry once deltas are disabled.
+TEST_P(RegistrarTest, Deltas)
+{
+  flags.registry_deltas = true;
+
+  vector<SlaveInfo> infos;
+
+  for (int i = 0; i < 40; i++) {
+    SlaveInfo info;
+    info.set_hostname("localhost");
+    info.mutable_id()->set_value(stringify(i));
+    infos.push_back(info);
+
+    // Admit a slave (and remove every third one), then ensure a
+    // new registrar recovers every slave that was not removed.
+    {
+      Registrar registrar(flags, state);
+      AWAIT_READY(registrar.recover(master));
+
+      AWAIT_EQ(true, registrar.apply(Owned<Operation>(new AdmitSlave(info))));
+
+      if (i % 3 == 0) {
+        AWAIT_EQ(true,
+                 registrar.apply(Owned<Operation>(new RemoveSlave(info))));
+      }
+    }
+
+    Registrar registrar(flags, state);
+    Future<Registry> registry = registrar.recover(master);
+    AWAIT_READY(registry);
+
+    EXPECT_EQ(master, registry.get().master().info());
+
+    set<string> expected;
+    for (int j = 0; j <= i; j++) {
+      if (j % 3 != 0) {
+        expected.insert(infos[j].id().value());
+      }
+    }
+
+    set<string> actual;
+    foreach (const Registry::Slave& slave, registry.get().slaves().slaves()) {
+      actual.insert(slave.info().id().value());
+    }
+
+    EXPECT_EQ(expected, actual);
+  }
+
+  // A master without deltas enabled stores the entire registry when
+  // recovering, so that masters which don't know about the deltas
+  // (e.g., after a downgrade) don't miss any of the slaves.
+  flags.registry_deltas = false;
+
+  Registry expected;
+  {
+    Registrar registrar(flags, state);
+    Future<Registry> registry = registrar.recover(master);
+    AWAIT_READY(registry);
+    expected = registry.get();
+  }
+
+  Future<Variable<Registry> > variable = state->fetch<Registry>("registry");
+  AWAIT_READY(variable);
+
+  EXPECT_EQ(expected.slaves().slaves().size(),
+            variable.get().get().slaves().slaves().size());
+}
+
+
 class MockStorage : public Storage
 {
 public:
@@ -399,8 +471,10 @@ TEST_P(RegistrarTest, StoreTimeout)
 
   Registrar registrar(flags, &state);
 
+  // Both the registry and its deltas get fetched.
   EXPECT_CALL(storage, get(_))
-    .WillOnce(Return(None()));
+    .Times(2)
+    .WillRepeatedly(Return(None()));
 
   Future<Nothing> set;
   EXPECT_CALL(storage, set(_, _))
@@ -429,8 +503,10 @@ TEST_P(RegistrarTest, Abort)
 
   Registrar registrar(flags, &state);
 
+  // Both the registry and its deltas get fetched.
   EXPECT_CALL(storage, get(_))
-    .WillOnce(Return(None()));
+    .Times(2)
+    .WillRepeatedly(Return(None()));
 
   EXPECT_CALL(storage, set(_, _))
     .WillOnce(Return(Future<bool>(true)))              // Recovery.
@@ -461,6 +537,8 @@ INSTANTIATE_TEST_CASE_P(
 
 TEST_P(Registrar_BENCHMARK_Test, Performance)
 {
+  flags.registry_deltas = true;
+
   Registrar registrar(flags, state);
   AWAIT_READY(registrar.recover(master));
 
@@ -529,6 +607,41 @@ TEST_P(Registrar_BENCHMARK_Test, Performance)
   }
   AWAIT_READY_FOR(result, Minutes(5));
   cout << "Removed " << slaveCount << " slaves in " << watch.elapsed() << endl;
+
+  // Measure the latency of individual operations, i.e., without any
+  // batching, against a registry that holds all of the slaves.
+  foreach (const SlaveInfo& info, infos) {
+    result = registrar2.apply(Owned<Operation>(new AdmitSlave(info)));
+  }
+  AWAIT_READY_FOR(result, Minutes(5));
+
+  const size_t operations = 1000;
+
+  vector<Duration> latencies;
+  for (size_t i = 0; i < operations; ++i) {
+    const SlaveInfo& info = infos[i % infos.size()];
+
+    watch.start();
+    AWAIT_READY(registrar2.apply(Owned<Operation>(new RemoveSlave(info))));
+    latencies.push_back(watch.elapsed());
+
+    watch.start();
+    AWAIT_READY(registrar2.apply(Owned<Operation>(new AdmitSlave(info))));
+    latencies.push_back(watch.elapsed());
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  Duration total;
+  foreach (const Duration& latency, latencies) {
+    total += latency;
+  }
+
+  cout << "Performed " << latencies.size() << " operations against "
+       << slaveCount << " slaves with a mean latency of "
+       << total / latencies.size() << " (p50 "
+       << latencies[latencies.size() / 2] << ", p99 "
+       << latencies[latencies.size() * 99 / 100] << ")" << endl;
 }
 
 } // namespace tests {
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include <iostream>
 #include <set>
 #include <sstream>
 #include <string>
@@ -24,6 +25,8 @@
 
 #include <stout/bytes.hpp>
 #include <stout/gtest.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
 
 #include "master/master.hpp"
 
@@ -31,12 +34,16 @@
 
 using namespace mesos::internal::master;
 
+using std::cout;
+using std::endl;
 using std::map;
 using std::ostringstream;
 using std::pair;
 using std::set;
 using std::string;
 
+using testing::WithParamInterface;
+
 namespace mesos {
 namespace internal {
 namespace tests {
@@ -1360,6 +1367,173 @@ TEST(RevocableResourceTest, Filter)
   EXPECT_EQ(r1, (r1 + r2).revocable());
 }
 
+
+class Resources_BENCHMARK_Test : public WithParamInterface<size_t>,
+                                 public ::testing::Test {};
+
+
+// The Resources benchmark tests are parameterized by the number of
+// roles that have resources reserved for them.
+INSTANTIATE_TEST_CASE_P(
+    RoleCount,
+    Resources_BENCHMARK_Test,
+    ::testing::Values(1U, 10U, 100U));
+
+
+// This benchmark measures the arithmetic and filtering operations
+// that the allocator performs for each slave and framework, on the
+// resources of a slave with reservations for many roles.
+TEST_P(Resources_BENCHMARK_Test, Arithmetic)
+{
+  const size_t roleCount = GetParam();
+  const size_t iterations = 1000;
+
+  Resources total = Resources::parse(
+      "cpus:16;mem:65536;disk:1048576;ports:[31000-32000]").get();
+
+  for (size_t i = 0; i < roleCount; i++) {
+    const string role = "role" + stringify(i);
+
+    total += Resources::parse(
+        "cpus:1;mem:1024;disk:4096;ports:[" +
+        stringify(30000 + i) + "-" + stringify(30000 + i) + "]",
+        role).get();
+  }
+
+  Resource revocable = Resources::parse("cpus", "8", "*").get();
+  revocable.mutable_revocable();
+  total += revocable;
+
+  const Resources allocation = Resources::parse(
+      "cpus:1;mem:512;disk:1024;ports:[31000-31010]",
+      "role0").get();
+
+  Stopwatch watch;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    Resources result = total;
+    result += allocation;
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total += allocation' operations" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    Resources result = total;
+    result -= allocation;
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total -= allocation' operations" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    EXPECT_TRUE(total.contains(allocation));
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total.contains(allocation)' operations" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    total.unreserved();
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total.unreserved()' operations" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    total.reserved("role0");
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total.reserved(role)' operations" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    total.reserved();
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total.reserved()' operations" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    total.revocable();
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total.revocable()' operations" << endl;
+}
+
+class Ports_BENCHMARK_Test : public ::testing::Test {};
+
+
+// This benchmark measures the arithmetic operations on a slave's
+// port resources after they have been fragmented into 10k disjoint
+// ranges by the tasks running on it.
+TEST_F(Ports_BENCHMARK_Test, FragmentedArithmetic)
+{
+  const size_t fragments = 10000;
+  const size_t iterations = 1000;
+
+  // Every other port is in use, e.g., [10000-10000, 10002-10002, ...].
+  Resource ports;
+  ports.set_name("ports");
+  ports.set_type(Value::RANGES);
+  ports.set_role("*");
+
+  for (size_t i = 0; i < fragments; i++) {
+    Value::Range* range = ports.mutable_ranges()->add_range();
+    range->set_begin(10000 + 2 * i);
+    range->set_end(10000 + 2 * i);
+  }
+
+  const Resources total = Resources(ports) + Resources::parse(
+      "cpus:16;mem:65536").get();
+
+  // Recovering an allocation fills one of the holes.
+  const Resources allocation =
+    Resources::parse("cpus:1;mem:512;ports:[10001-10001]").get();
+
+  const Resources task =
+    Resources::parse("cpus:1;mem:512;ports:[20000-20000]").get();
+
+  Stopwatch watch;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    Resources result = total;
+    result -= task;
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total -= task' operations on " << fragments
+       << " port ranges" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    Resources result = total;
+    result += allocation;
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total += allocation' operations on " << fragments
+       << " port ranges" << endl;
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    EXPECT_TRUE(total.contains(task));
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'total.contains(task)' operations on " << fragments
+       << " port ranges" << endl;
+
+  const Value::Ranges& ranges = ports.ranges();
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    EXPECT_EQ(ranges, ranges + ranges);
+  }
+  cout << "Took " << watch.elapsed() << " to perform " << iterations
+       << " 'ranges == ranges + ranges' operations on " << fragments
+       << " port ranges" << endl;
+}
+
 } // namespace tests {
 } // namespace internal {
 } // namespace mesos {
@@ -35,6 +35,7 @@
 #include <stout/option.hpp>
 #include <stout/os.hpp>
 #include <stout/try.hpp>
+#include <stout/uuid.hpp>
 
 #include <stout/protobuf.hpp>
 
@@ -686,6 +687,93 @@ TEST_F(LogStateTest, Diff)
 }
 
 
+// This test ensures that an entry that doesn't get stored while
+// another one gets stored repeatedly is relocated to the end of the
+// log, so that the log gets truncated rather than growing unbounded,
+// and that the entries can still be recovered.
+TEST_F(LogStateTest, Relocation)
+{
+  Future<Variable<Slaves>> future1 = state->fetch<Slaves>("foo");
+  AWAIT_READY(future1);
+
+  Slaves foo;
+  foo.add_slaves()->mutable_info()->set_hostname("localhost");
+
+  Future<Option<Variable<Slaves>>> future2 =
+    state->store(future1.get().mutate(foo));
+  AWAIT_READY(future2);
+  ASSERT_SOME(future2.get());
+
+  future1 = state->fetch<Slaves>("bar");
+  AWAIT_READY(future1);
+
+  Variable<Slaves> variable = future1.get();
+
+  // Store 'bar' enough times for 'foo' to hold back more than a
+  // megabyte of the log. Random hostnames avoid storing diffs.
+  Slaves bar;
+  for (size_t i = 0; i < 32; i++) {
+    bar.Clear();
+    for (size_t j = 0; j < 2048; j++) {
+      bar.add_slaves()->mutable_info()->set_hostname(
+          UUID::random().toString());
+    }
+
+    future2 = state->store(variable.mutate(bar));
+    AWAIT_READY(future2);
+    ASSERT_SOME(future2.get());
+
+    variable = future2.get().get();
+  }
+
+  // Wait for the asynchronous truncation (see the Diff test above).
+  Clock::pause();
+  Clock::settle();
+  Clock::resume();
+
+  Log::Reader reader(log);
+
+  Future<Log::Position> beginning = reader.beginning();
+  Future<Log::Position> ending = reader.ending();
+
+  AWAIT_READY(beginning);
+  AWAIT_READY(ending);
+
+  Future<list<Log::Entry>> entries = reader.read(beginning.get(), ending.get());
+
+  AWAIT_READY(entries);
+
+  // The log should have been truncated past the original snapshot of
+  // 'foo', which must have been relocated.
+  size_t snapshots = 0;
+
+  foreach (const Log::Entry& entry, entries.get()) {
+    Operation operation;
+    ASSERT_TRUE(operation.ParseFromString(entry.data));
+
+    if (operation.type() == Operation::SNAPSHOT &&
+        operation.snapshot().entry().name() == "foo") {
+      snapshots++;
+    }
+  }
+
+  EXPECT_LT(entries.get().size(), 32u);
+  EXPECT_EQ(1u, snapshots);
+
+  // Now recover both entries from the log with a new storage.
+  state::LogStorage storage2(log);
+  State state2(&storage2);
+
+  future1 = state2.fetch<Slaves>("foo");
+  AWAIT_READY(future1);
+  EXPECT_EQ(foo.SerializeAsString(), future1.get().get().SerializeAsString());
+
+  future1 = state2.fetch<Slaves>("bar");
+  AWAIT_READY(future1);
+  EXPECT_EQ(bar.SerializeAsString(), future1.get().get().SerializeAsString());
+}
+
+
 #ifdef MESOS_HAS_JAVA
 class ZooKeeperStateTest : public tests::ZooKeeperTest
 {